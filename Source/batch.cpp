@@ -0,0 +1,110 @@
+#include "batch.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+static bool readVector(std::istringstream& stream, parser::Vec3f& value)
+{
+    return (bool)(stream >> value.x >> value.y >> value.z);
+}
+
+static bool parseJob(const std::string& text, BatchJob& job)
+{
+    std::istringstream stream(text);
+    if(!(stream >> job.scene >> job.output))
+        return false;
+    job.overrides = 0;
+    job.width = job.height = 0;
+    std::string name;
+    while(stream >> name)
+    {
+        if(name == "--position" && readVector(stream, job.position))
+        {
+            job.overrides |= BATCH_POSITION;
+        }
+        else if(name == "--gaze" && readVector(stream, job.gaze))
+        {
+            job.overrides |= BATCH_GAZE;
+        }
+        else if(name == "--up" && readVector(stream, job.up))
+        {
+            job.overrides |= BATCH_UP;
+        }
+        else if(name == "--size" && stream >> job.width >> job.height && job.width > 0 && job.height > 0)
+        {
+            job.overrides |= BATCH_SIZE;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readBatchJobs(const std::string& path, std::vector<BatchJob>& jobs)
+{
+    std::ifstream file(path.c_str());
+    if(!file)
+    {
+        fprintf(stderr, "Error: cannot read %s\n", path.c_str());
+        return false;
+    }
+    std::vector<BatchJob> listed;
+    std::map<std::string, int> firstSeen;
+    std::string text;
+    int line = 0;
+    while(std::getline(file, text))
+    {
+        line++;
+        size_t start = text.find_first_not_of(" \t\r");
+        if(start == std::string::npos || text[start] == '#')
+            continue;
+        BatchJob job;
+        job.line = line;
+        if(!parseJob(text, job))
+        {
+            fprintf(stderr, "Error: %s:%d: expected <scene.xml> <output> [--position x y z] [--gaze x y z] [--up x y z] [--size w h]\n",
+                path.c_str(), line);
+            return false;
+        }
+        if(firstSeen.find(job.scene) == firstSeen.end())
+            firstSeen[job.scene] = listed.size();
+        listed.push_back(job);
+    }
+    std::stable_sort(listed.begin(), listed.end(), [&firstSeen](const BatchJob& a, const BatchJob& b) {
+        return firstSeen[a.scene] < firstSeen[b.scene];
+    });
+    jobs.swap(listed);
+    return true;
+}
+
+parser::Camera batchCamera(const parser::Camera& camera, const BatchJob& job)
+{
+    parser::Camera result = camera;
+    if(job.overrides & BATCH_POSITION)
+        result.position = job.position;
+    if(job.overrides & BATCH_GAZE)
+        result.gaze = job.gaze;
+    if(job.overrides & BATCH_UP)
+        result.up = job.up;
+    if(job.overrides & BATCH_SIZE)
+    {
+        result.image_width = job.width;
+        result.image_height = job.height;
+    }
+    return result;
+}
+
+void clearScene(parser::Scene& scene)
+{
+    scene.point_lights.clear();
+    scene.materials.clear();
+    scene.vertex_data.clear();
+    scene.translations.clear();
+    scene.scalings.clear();
+    scene.rotations.clear();
+    scene.meshes.clear();
+}
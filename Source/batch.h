@@ -0,0 +1,44 @@
+#ifndef __HW3__BATCH__
+#define __HW3__BATCH__
+
+#include <string>
+#include <vector>
+#include "parser.h"
+
+// Camera settings a job replaces, one bit each
+enum BatchOverride
+{
+    BATCH_POSITION = 1,
+    BATCH_GAZE = 2,
+    BATCH_UP = 4,
+    BATCH_SIZE = 8
+};
+
+// One line of a --batch job list:
+//     <scene.xml> <output> [--position x y z] [--gaze x y z] [--up x y z] [--size w h]
+struct BatchJob
+{
+    int line;
+    std::string scene;
+    std::string output;
+    unsigned int overrides;
+    parser::Vec3f position;
+    parser::Vec3f gaze;
+    parser::Vec3f up;
+    int width, height;
+};
+
+// Reads the job list at path. Blank lines and lines starting with # are
+// skipped. Jobs come back grouped by scene file, in the order each file
+// first appears, so every scene is loaded once. Returns false and prints
+// the line at fault on a syntax error.
+bool readBatchJobs(const std::string& path, std::vector<BatchJob>& jobs);
+
+// The scene's camera with the job's overrides applied. A new size keeps
+// the near plane; the gaze is left as given.
+parser::Camera batchCamera(const parser::Camera& camera, const BatchJob& job);
+
+// Empties scene for the next loadFromXml, keeping the storage of its arrays.
+void clearScene(parser::Scene& scene);
+
+#endif
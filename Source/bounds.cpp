@@ -0,0 +1,115 @@
+#include "bounds.h"
+#include <cfloat>
+
+Bounds localMeshBounds(const parser::Scene& scene, const parser::Mesh& mesh)
+{
+    Bounds bounds;
+    bounds.min.x = bounds.min.y = bounds.min.z = FLT_MAX;
+    bounds.max.x = bounds.max.y = bounds.max.z = -FLT_MAX;
+    const std::vector<parser::Face>& faces = scene.meshFaces(mesh);
+    int fSize = faces.size();
+    for(int j = 0; j<fSize; j++)
+    {
+        const int ids[3] = { faces[j].v0_id, faces[j].v1_id, faces[j].v2_id };
+        for(int k = 0; k<3; k++)
+        {
+            const parser::Vec3f& v = scene.vertex_data[ids[k] - 1];
+            bounds.min.x = fminf(bounds.min.x, v.x);
+            bounds.min.y = fminf(bounds.min.y, v.y);
+            bounds.min.z = fminf(bounds.min.z, v.z);
+            bounds.max.x = fmaxf(bounds.max.x, v.x);
+            bounds.max.y = fmaxf(bounds.max.y, v.y);
+            bounds.max.z = fmaxf(bounds.max.z, v.z);
+        }
+    }
+    if(fSize == 0)
+    {
+        bounds.min.x = bounds.min.y = bounds.min.z = 0.0f;
+        bounds.max = bounds.min;
+    }
+
+    // sphere around the box center, tightened to the farthest vertex
+    bounds.center.x = 0.5f * (bounds.min.x + bounds.max.x);
+    bounds.center.y = 0.5f * (bounds.min.y + bounds.max.y);
+    bounds.center.z = 0.5f * (bounds.min.z + bounds.max.z);
+    float radius2 = 0.0f;
+    for(int j = 0; j<fSize; j++)
+    {
+        const int ids[3] = { faces[j].v0_id, faces[j].v1_id, faces[j].v2_id };
+        for(int k = 0; k<3; k++)
+        {
+            const parser::Vec3f& v = scene.vertex_data[ids[k] - 1];
+            float dx = v.x - bounds.center.x;
+            float dy = v.y - bounds.center.y;
+            float dz = v.z - bounds.center.z;
+            radius2 = fmaxf(radius2, dx*dx + dy*dy + dz*dz);
+        }
+    }
+    bounds.radius = sqrtf(radius2);
+    return bounds;
+}
+
+Bounds transformBounds(const Bounds& local, mat4x4 model)
+{
+    // transformed box: new center plus the extents through |M| (Arvo)
+    float center[3] = { 0.5f * (local.min.x + local.max.x), 0.5f * (local.min.y + local.max.y), 0.5f * (local.min.z + local.max.z) };
+    float extent[3] = { 0.5f * (local.max.x - local.min.x), 0.5f * (local.max.y - local.min.y), 0.5f * (local.max.z - local.min.z) };
+    float worldCenter[3];
+    float worldExtent[3];
+    for(int r = 0; r<3; r++)
+    {
+        worldCenter[r] = model[3][r];
+        worldExtent[r] = 0.0f;
+        for(int c = 0; c<3; c++)
+        {
+            worldCenter[r] += model[c][r] * center[c];
+            worldExtent[r] += fabsf(model[c][r]) * extent[c];
+        }
+    }
+
+    Bounds world;
+    world.min.x = worldCenter[0] - worldExtent[0];
+    world.min.y = worldCenter[1] - worldExtent[1];
+    world.min.z = worldCenter[2] - worldExtent[2];
+    world.max.x = worldCenter[0] + worldExtent[0];
+    world.max.y = worldCenter[1] + worldExtent[1];
+    world.max.z = worldCenter[2] + worldExtent[2];
+
+    float scale = 0.0f;
+    for(int c = 0; c<3; c++)
+    {
+        float length = sqrtf(model[c][0]*model[c][0] + model[c][1]*model[c][1] + model[c][2]*model[c][2]);
+        scale = fmaxf(scale, length);
+    }
+    world.center.x = model[0][0]*local.center.x + model[1][0]*local.center.y + model[2][0]*local.center.z + model[3][0];
+    world.center.y = model[0][1]*local.center.x + model[1][1]*local.center.y + model[2][1]*local.center.z + model[3][1];
+    world.center.z = model[0][2]*local.center.x + model[1][2]*local.center.y + model[2][2]*local.center.z + model[3][2];
+    world.radius = local.radius * scale;
+    return world;
+}
+
+void fillBoundsTable(const std::vector<Bounds>& bounds, BoundsTable& table)
+{
+    int count = bounds.size();
+    int padded = (count + BOUNDS_LANES - 1) / BOUNDS_LANES * BOUNDS_LANES;
+    table.count = count;
+    std::vector<float>* columns[] = { &table.center_x, &table.center_y, &table.center_z, &table.radius,
+                                      &table.min_x, &table.min_y, &table.min_z,
+                                      &table.max_x, &table.max_y, &table.max_z };
+    for(int c = 0; c<10; c++)
+        columns[c]->assign(padded, 0.0f);
+    for(int i = 0; i<count; i++)
+    {
+        const Bounds& b = bounds[i];
+        table.center_x[i] = b.center.x;
+        table.center_y[i] = b.center.y;
+        table.center_z[i] = b.center.z;
+        table.radius[i] = b.radius;
+        table.min_x[i] = b.min.x;
+        table.min_y[i] = b.min.y;
+        table.min_z[i] = b.min.z;
+        table.max_x[i] = b.max.x;
+        table.max_y[i] = b.max.y;
+        table.max_z[i] = b.max.z;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef __HW3__BOUNDS__
+#define __HW3__BOUNDS__
+
+#include <vector>
+#include "parser.h"
+#include "linmath.h"
+
+// Axis aligned box and bounding sphere of a mesh
+struct Bounds
+{
+    parser::Vec3f min;
+    parser::Vec3f max;
+    parser::Vec3f center;
+    float radius;
+};
+
+// Structure-of-arrays copy of a bounds list for SIMD tests, padded with
+// empty entries to a multiple of BOUNDS_LANES.
+#define BOUNDS_LANES 4
+
+struct BoundsTable
+{
+    int count;
+    std::vector<float> center_x, center_y, center_z, radius;
+    std::vector<float> min_x, min_y, min_z;
+    std::vector<float> max_x, max_y, max_z;
+};
+
+// Bounds of the vertices the mesh's faces refer to, in object space.
+Bounds localMeshBounds(const parser::Scene& scene, const parser::Mesh& mesh);
+// Box of the transformed box and a sphere scaled by the largest axis scale.
+Bounds transformBounds(const Bounds& local, mat4x4 model);
+void fillBoundsTable(const std::vector<Bounds>& bounds, BoundsTable& table);
+
+#endif
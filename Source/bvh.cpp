@@ -0,0 +1,184 @@
+#include "bvh.h"
+#include "culling.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+static void growBox(parser::Vec3f& min, parser::Vec3f& max, const parser::Vec3f& bmin, const parser::Vec3f& bmax)
+{
+    min.x = fminf(min.x, bmin.x);
+    min.y = fminf(min.y, bmin.y);
+    min.z = fminf(min.z, bmin.z);
+    max.x = fmaxf(max.x, bmax.x);
+    max.y = fmaxf(max.y, bmax.y);
+    max.z = fmaxf(max.z, bmax.z);
+}
+
+struct CentroidLess
+{
+    const std::vector<Bounds>* bounds;
+    int axis;
+    float key(int i) const
+    {
+        const Bounds& b = (*bounds)[i];
+        if(axis == 0) return b.min.x + b.max.x;
+        if(axis == 1) return b.min.y + b.max.y;
+        return b.min.z + b.max.z;
+    }
+    bool operator()(int a, int b) const { return key(a) < key(b); }
+};
+
+static int buildNode(BVH& bvh, const std::vector<Bounds>& bounds, int parent, int first, int count)
+{
+    int index = bvh.nodes.size();
+    BVHNode node;
+    node.min.x = node.min.y = node.min.z = FLT_MAX;
+    node.max.x = node.max.y = node.max.z = -FLT_MAX;
+    node.left = node.right = -1;
+    node.parent = parent;
+    node.first = first;
+    node.count = count;
+    parser::Vec3f cmin = node.min;
+    parser::Vec3f cmax = node.max;
+    for(int i = first; i<first + count; i++)
+    {
+        const Bounds& b = bounds[bvh.items[i]];
+        growBox(node.min, node.max, b.min, b.max);
+        parser::Vec3f c = { 0.5f * (b.min.x + b.max.x), 0.5f * (b.min.y + b.max.y), 0.5f * (b.min.z + b.max.z) };
+        growBox(cmin, cmax, c, c);
+    }
+    bvh.nodes.push_back(node);
+    if(count <= BVH_LEAF_SIZE)
+    {
+        for(int i = first; i<first + count; i++)
+            bvh.leaf_of[bvh.items[i]] = index;
+        return index;
+    }
+
+    // median split along the widest axis of the centroids
+    float extent[3] = { cmax.x - cmin.x, cmax.y - cmin.y, cmax.z - cmin.z };
+    CentroidLess less;
+    less.bounds = &bounds;
+    less.axis = extent[1] > extent[0] ? 1 : 0;
+    if(extent[2] > extent[less.axis])
+        less.axis = 2;
+    int half = count / 2;
+    std::nth_element(bvh.items.begin() + first, bvh.items.begin() + first + half, bvh.items.begin() + first + count, less);
+
+    int left = buildNode(bvh, bounds, index, first, half);
+    int right = buildNode(bvh, bounds, index, first + half, count - half);
+    bvh.nodes[index].left = left;
+    bvh.nodes[index].right = right;
+    return index;
+}
+
+void buildBVH(BVH& bvh, const std::vector<Bounds>& bounds)
+{
+    int count = bounds.size();
+    bvh.nodes.clear();
+    bvh.nodes.reserve(count > 0 ? 2 * count / BVH_LEAF_SIZE + 1 : 0);
+    bvh.items.resize(count);
+    bvh.leaf_of.assign(count, -1);
+    for(int i = 0; i<count; i++)
+        bvh.items[i] = i;
+    if(count)
+        buildNode(bvh, bounds, -1, 0, count);
+}
+
+static bool refitNode(BVH& bvh, const std::vector<Bounds>& bounds, int index)
+{
+    BVHNode& node = bvh.nodes[index];
+    parser::Vec3f min = { FLT_MAX, FLT_MAX, FLT_MAX };
+    parser::Vec3f max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    if(node.left < 0)
+    {
+        for(int i = node.first; i<node.first + node.count; i++)
+            growBox(min, max, bounds[bvh.items[i]].min, bounds[bvh.items[i]].max);
+    }
+    else
+    {
+        growBox(min, max, bvh.nodes[node.left].min, bvh.nodes[node.left].max);
+        growBox(min, max, bvh.nodes[node.right].min, bvh.nodes[node.right].max);
+    }
+    bool changed = memcmp(&min, &node.min, sizeof(min)) != 0 || memcmp(&max, &node.max, sizeof(max)) != 0;
+    node.min = min;
+    node.max = max;
+    return changed;
+}
+
+void refitBVH(BVH& bvh, const std::vector<Bounds>& bounds, const std::vector<int>& changed)
+{
+    int cSize = changed.size();
+    for(int c = 0; c<cSize; c++)
+    {
+        int index = bvh.leaf_of[changed[c]];
+        while(index >= 0 && refitNode(bvh, bounds, index))
+            index = bvh.nodes[index].parent;
+    }
+}
+
+// Classifies a box against the planes still set in mask: returns -1 when
+// it is outside one of them, otherwise clears the bits of the planes the
+// box is entirely inside of.
+static int classifyBox(const parser::Vec3f& min, const parser::Vec3f& max, const Frustum& frustum, int& mask)
+{
+    for(int p = 0; p<6; p++)
+    {
+        if(!(mask & (1 << p)))
+            continue;
+        const float* plane = frustum.planes[p];
+        // farthest and nearest corners along the plane normal
+        float px = plane[0] >= 0.0f ? max.x : min.x;
+        float py = plane[1] >= 0.0f ? max.y : min.y;
+        float pz = plane[2] >= 0.0f ? max.z : min.z;
+        float nx = plane[0] >= 0.0f ? min.x : max.x;
+        float ny = plane[1] >= 0.0f ? min.y : max.y;
+        float nz = plane[2] >= 0.0f ? min.z : max.z;
+        if(plane[0]*px + plane[1]*py + plane[2]*pz + plane[3] < 0.0f)
+            return -1;
+        if(plane[0]*nx + plane[1]*ny + plane[2]*nz + plane[3] >= 0.0f)
+            mask &= ~(1 << p);
+    }
+    return mask;
+}
+
+static int cullNode(const BVH& bvh, const std::vector<Bounds>& bounds, int index, const Frustum& frustum, int mask, std::vector<unsigned char>& visible)
+{
+    const BVHNode& node = bvh.nodes[index];
+    if(classifyBox(node.min, node.max, frustum, mask) < 0)
+        return 0;
+    if(mask == 0)
+    {
+        // the whole subtree is inside
+        for(int i = node.first; i<node.first + node.count; i++)
+            visible[bvh.items[i]] = 1;
+        return node.count;
+    }
+    if(node.left < 0)
+    {
+        // a leaf that straddles the frustum: test its items against the
+        // planes it crosses
+        int drawn = 0;
+        for(int i = node.first; i<node.first + node.count; i++)
+        {
+            const Bounds& b = bounds[bvh.items[i]];
+            int itemMask = mask;
+            if(classifyBox(b.min, b.max, frustum, itemMask) >= 0)
+            {
+                visible[bvh.items[i]] = 1;
+                drawn++;
+            }
+        }
+        return drawn;
+    }
+    return cullNode(bvh, bounds, node.left, frustum, mask, visible) + cullNode(bvh, bounds, node.right, frustum, mask, visible);
+}
+
+CullStats cullBVH(const BVH& bvh, const std::vector<Bounds>& bounds, const Frustum& frustum, std::vector<unsigned char>& visible)
+{
+    CullStats stats = { 0, 0 };
+    if(!bvh.nodes.empty())
+        stats.drawn = cullNode(bvh, bounds, 0, frustum, 0x3f, visible);
+    stats.culled = bvh.items.size() - stats.drawn;
+    return stats;
+}
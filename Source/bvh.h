@@ -0,0 +1,40 @@
+#ifndef __HW3__BVH__
+#define __HW3__BVH__
+
+#include <vector>
+#include "bounds.h"
+
+struct Frustum;
+struct CullStats;
+
+// Every node covers the contiguous range [first, first + count) of items,
+// so a subtree that is entirely inside or outside the frustum is accepted
+// or rejected without visiting its children.
+struct BVHNode
+{
+    parser::Vec3f min;
+    parser::Vec3f max;
+    int left;       // -1 for leaves
+    int right;
+    int parent;
+    int first;
+    int count;
+};
+
+struct BVH
+{
+    std::vector<BVHNode> nodes;
+    std::vector<int> items;     // bounds indices in leaf order
+    std::vector<int> leaf_of;   // bounds index -> leaf node
+};
+
+#define BVH_LEAF_SIZE 4
+
+void buildBVH(BVH& bvh, const std::vector<Bounds>& bounds);
+// Updates the leaves of the changed entries and their ancestors, stopping
+// at ancestors whose box no longer changes.
+void refitBVH(BVH& bvh, const std::vector<Bounds>& bounds, const std::vector<int>& changed);
+// visible must already hold one zeroed flag per bounds entry.
+CullStats cullBVH(const BVH& bvh, const std::vector<Bounds>& bounds, const Frustum& frustum, std::vector<unsigned char>& visible);
+
+#endif
@@ -0,0 +1,238 @@
+#include "capture.h"
+#include "image.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+// A frame handed to the writer: its number and the queue buffer holding
+// its rows, bottom row first as glReadPixels leaves them.
+struct QueuedFrame
+{
+    int index;
+    int buffer;
+};
+
+static std::string pattern;
+static FILE* video = NULL;
+static int width = 0;
+static int height = 0;
+static size_t frameSize = 0;
+static bool pixelBuffers = false;
+static GLuint packBuffers[CAPTURE_RING_SIZE] = { 0 };
+static int issued = 0;
+
+static std::vector<std::vector<unsigned char> > buffers;
+static std::deque<int> freeBuffers;
+static std::deque<QueuedFrame> queued;
+static std::mutex queueMutex;
+static std::condition_variable frameQueued;
+static std::condition_variable bufferFreed;
+static bool finishing = false;
+static std::thread writer;
+static int written = 0;
+static double waitSeconds = 0.0;
+
+// A printf pattern is accepted with exactly one integer conversion and
+// nothing else it could read.
+static bool validPattern(const std::string& text)
+{
+    int conversions = 0;
+    for(size_t i = 0; i<text.size(); i++)
+    {
+        if(text[i] != '%')
+            continue;
+        if(i + 1 < text.size() && text[i + 1] == '%')
+        {
+            i++;
+            continue;
+        }
+        i++;
+        while(i < text.size() && (text[i] == '0' || text[i] == '-' || text[i] == '+' || text[i] == ' '))
+            i++;
+        while(i < text.size() && text[i] >= '0' && text[i] <= '9')
+            i++;
+        if(i >= text.size() || text[i] != 'd')
+            return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+static void writerMain()
+{
+    std::vector<unsigned char> rgb(frameSize);
+    size_t rowSize = (size_t)width * 3;
+    for(;;)
+    {
+        QueuedFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            frameQueued.wait(lock, [] { return !queued.empty() || finishing; });
+            if(queued.empty())
+                break;
+            frame = queued.front();
+            queued.pop_front();
+        }
+        const std::vector<unsigned char>& rows = buffers[frame.buffer];
+        for(int y = 0; y<height; y++)
+            memcpy(&rgb[y * rowSize], &rows[(height - 1 - y) * rowSize], rowSize);
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            freeBuffers.push_back(frame.buffer);
+        }
+        bufferFreed.notify_one();
+
+        bool ok;
+        if(video)
+        {
+            ok = fwrite(&rgb[0], 1, frameSize, video) == frameSize && fflush(video) == 0;
+            if(!ok)
+                fprintf(stderr, "Error: writing raw video failed\n");
+        }
+        else
+        {
+            char path[4096];
+            snprintf(path, sizeof(path), pattern.c_str(), frame.index);
+            ok = writeImage(path, width, height, rgb);
+        }
+        if(ok)
+            written++;
+    }
+}
+
+// A free queue buffer, waiting for the writer when all are queued.
+static int takeBuffer()
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+    if(freeBuffers.empty())
+    {
+        std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+        bufferFreed.wait(lock, [] { return !freeBuffers.empty(); });
+        waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    int buffer = freeBuffers.front();
+    freeBuffers.pop_front();
+    return buffer;
+}
+
+static void queueFrame(int index, int buffer)
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        QueuedFrame frame = { index, buffer };
+        queued.push_back(frame);
+    }
+    frameQueued.notify_one();
+}
+
+// Maps the ring buffer frame index was read into and queues a copy of it.
+static void collectFrame(int index)
+{
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[index % CAPTURE_RING_SIZE]);
+    const void* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    int buffer = takeBuffer();
+    if(pixels)
+        memcpy(&buffers[buffer][0], pixels, frameSize);
+    else
+        memset(&buffers[buffer][0], 0, frameSize);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    queueFrame(index, buffer);
+}
+
+bool initCapture(const std::string& target, int imageWidth, int imageHeight)
+{
+    pattern = target;
+    if(pattern == "-")
+    {
+        // the stream keeps the real stdout; messages go to stderr
+        fflush(stdout);
+        int fd = dup(STDOUT_FILENO);
+        video = fd >= 0 ? fdopen(fd, "wb") : NULL;
+        if(!video || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+        {
+            fprintf(stderr, "Error: cannot stream video to stdout\n");
+            return false;
+        }
+    }
+    else if(!validPattern(pattern))
+    {
+        fprintf(stderr, "Error: --capture takes a file pattern with one %%d, like frames/%%04d.png, or - for raw video\n");
+        return false;
+    }
+    width = imageWidth;
+    height = imageHeight;
+    frameSize = (size_t)width * height * 3;
+    issued = 0;
+    written = 0;
+    waitSeconds = 0.0;
+    finishing = false;
+
+    pixelBuffers = GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object;
+    if(pixelBuffers)
+    {
+        glGenBuffers(CAPTURE_RING_SIZE, packBuffers);
+        for(int i = 0; i<CAPTURE_RING_SIZE; i++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    buffers.assign(CAPTURE_QUEUE_FRAMES, std::vector<unsigned char>(frameSize));
+    freeBuffers.clear();
+    for(int i = 0; i<CAPTURE_QUEUE_FRAMES; i++)
+        freeBuffers.push_back(i);
+    writer = std::thread(writerMain);
+    return true;
+}
+
+void captureFrame(GLuint framebuffer)
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    if(!pixelBuffers)
+    {
+        int buffer = takeBuffer();
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &buffers[buffer][0]);
+        queueFrame(issued++, buffer);
+        return;
+    }
+    // the slot still holds the frame read CAPTURE_RING_SIZE frames ago
+    if(issued >= CAPTURE_RING_SIZE)
+        collectFrame(issued - CAPTURE_RING_SIZE);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[issued % CAPTURE_RING_SIZE]);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    issued++;
+}
+
+CaptureStats finishCapture()
+{
+    if(pixelBuffers)
+    {
+        for(int index = std::max(0, issued - CAPTURE_RING_SIZE); index<issued; index++)
+            collectFrame(index);
+        glDeleteBuffers(CAPTURE_RING_SIZE, packBuffers);
+        memset(packBuffers, 0, sizeof(packBuffers));
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        finishing = true;
+    }
+    frameQueued.notify_one();
+    writer.join();
+    if(video)
+        fclose(video);
+    video = NULL;
+    buffers.clear();
+    CaptureStats stats = { written, (float)(waitSeconds * 1000.0), pixelBuffers };
+    return stats;
+}
@@ -0,0 +1,34 @@
+#ifndef __HW3__CAPTURE__
+#define __HW3__CAPTURE__
+
+#include <string>
+#include <GL/glew.h>
+
+// Frames read back but not yet mapped; a frame is mapped this many frames
+// after its glReadPixels, by when the copy has long finished.
+#define CAPTURE_RING_SIZE 3
+// Frames waiting for the writer thread at most; beyond that the render
+// thread waits for it.
+#define CAPTURE_QUEUE_FRAMES 8
+
+struct CaptureStats
+{
+    int frames;         // frames written
+    float wait_ms;      // render thread time spent waiting for the writer
+    bool pixel_buffers; // false when reads fell back to plain glReadPixels
+};
+
+// --capture: every frame is read into a ring of pixel pack buffers, so
+// glReadPixels returns without waiting for the frame, and mapped
+// CAPTURE_RING_SIZE frames later. A writer thread encodes the frames:
+// pattern is a file name with one %d conversion, like frames/%04d.png,
+// PNG for .png and PPM otherwise, or "-" for raw RGB24 video on stdout.
+// For raw video, stdout is moved to stderr, so messages stay out of the
+// stream. Returns false and prints an error on failure.
+bool initCapture(const std::string& pattern, int width, int height);
+// After a frame is drawn into framebuffer.
+void captureFrame(GLuint framebuffer);
+// Reads the frames still in the ring and waits for the writer.
+CaptureStats finishCapture();
+
+#endif
@@ -0,0 +1,237 @@
+#include "culling.h"
+#include "transform.h"
+#include "bvh.h"
+#include <cstring>
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static std::vector<Bounds> localBounds;
+static std::vector<Bounds> worldBounds;
+static BoundsTable boundsTable;
+static BVH meshBVH;
+
+void frustumFromMatrix(mat4x4 m, Frustum& frustum)
+{
+    // Gribb/Hartmann: planes are sums and differences of the matrix rows
+    for(int p = 0; p<6; p++)
+    {
+        int row = p / 2;
+        float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+        float length = 0.0f;
+        for(int c = 0; c<4; c++)
+        {
+            frustum.planes[p][c] = m[c][3] + sign * m[c][row];
+        }
+        length = sqrtf(frustum.planes[p][0]*frustum.planes[p][0] + frustum.planes[p][1]*frustum.planes[p][1] + frustum.planes[p][2]*frustum.planes[p][2]);
+        if(length > 0.0f)
+        {
+            for(int c = 0; c<4; c++)
+                frustum.planes[p][c] /= length;
+        }
+    }
+}
+
+void cameraFrustum(const parser::Camera& camera, Frustum& frustum)
+{
+    mat4x4 view;
+    mat4x4 projection;
+    mat4x4 viewProjection;
+    cameraViewMatrix(camera, view);
+    cameraProjectionMatrix(camera, projection);
+    mat4x4_mul(viewProjection, projection, view);
+    frustumFromMatrix(viewProjection, frustum);
+}
+
+void buildMeshBounds(const parser::Scene& scene)
+{
+    int mSize = scene.meshes.size();
+    localBounds.resize(mSize);
+    worldBounds.resize(mSize);
+    for(int i = 0; i<mSize; i++)
+    {
+        const parser::Mesh& mesh = scene.meshes[i];
+        if(mesh.base_mesh_id)
+            localBounds[i] = localBounds[mesh.base_mesh_id - 1];
+        else
+            localBounds[i] = localMeshBounds(scene, mesh);
+        mat4x4 model;
+        meshModelMatrix(scene, mesh, model);
+        worldBounds[i] = transformBounds(localBounds[i], model);
+    }
+    fillBoundsTable(worldBounds, boundsTable);
+    if(mSize >= BVH_MIN_MESHES)
+        buildBVH(meshBVH, worldBounds);
+    else
+        meshBVH = BVH();
+}
+
+void updateMeshBounds(const parser::Scene& scene, const std::vector<int>& changed)
+{
+    int cSize = changed.size();
+    for(int c = 0; c<cSize; c++)
+    {
+        int i = changed[c];
+        mat4x4 model;
+        meshModelMatrix(scene, scene.meshes[i], model);
+        Bounds& b = worldBounds[i] = transformBounds(localBounds[i], model);
+        boundsTable.center_x[i] = b.center.x;
+        boundsTable.center_y[i] = b.center.y;
+        boundsTable.center_z[i] = b.center.z;
+        boundsTable.radius[i] = b.radius;
+        boundsTable.min_x[i] = b.min.x;
+        boundsTable.min_y[i] = b.min.y;
+        boundsTable.min_z[i] = b.min.z;
+        boundsTable.max_x[i] = b.max.x;
+        boundsTable.max_y[i] = b.max.y;
+        boundsTable.max_z[i] = b.max.z;
+    }
+    if(!meshBVH.nodes.empty())
+        refitBVH(meshBVH, worldBounds, changed);
+}
+
+const std::vector<Bounds>& meshLocalBounds()
+{
+    return localBounds;
+}
+
+const std::vector<Bounds>& meshWorldBounds()
+{
+    return worldBounds;
+}
+
+const BoundsTable& meshBoundsTable()
+{
+    return boundsTable;
+}
+
+CullStats frustumCull(const Frustum& frustum, std::vector<unsigned char>& visible)
+{
+    if(!meshBVH.nodes.empty())
+    {
+        visible.resize(worldBounds.size());
+        if(!visible.empty())
+            memset(&visible[0], 0, visible.size());
+        return cullBVH(meshBVH, worldBounds, frustum, visible);
+    }
+
+    const BoundsTable& t = boundsTable;
+    int padded = t.radius.size();
+    visible.resize(t.count);
+    CullStats stats = { 0, 0 };
+
+    for(int i = 0; i<padded; i += BOUNDS_LANES)
+    {
+        int mask = 0;
+#if defined(__SSE2__)
+        __m128 cx = _mm_loadu_ps(&t.center_x[i]);
+        __m128 cy = _mm_loadu_ps(&t.center_y[i]);
+        __m128 cz = _mm_loadu_ps(&t.center_z[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&t.radius[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int p = 0; p<6; p++)
+        {
+            const float* plane = frustum.planes[p];
+            __m128 a = _mm_set1_ps(plane[0]);
+            __m128 b = _mm_set1_ps(plane[1]);
+            __m128 c = _mm_set1_ps(plane[2]);
+            __m128 d = _mm_set1_ps(plane[3]);
+            // sphere: signed distance of the center against -radius
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)), _mm_add_ps(_mm_mul_ps(c, cz), d));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+            // box: the corner farthest along the plane normal must be inside
+            __m128 px = _mm_loadu_ps(plane[0] >= 0.0f ? &t.max_x[i] : &t.min_x[i]);
+            __m128 py = _mm_loadu_ps(plane[1] >= 0.0f ? &t.max_y[i] : &t.min_y[i]);
+            __m128 pz = _mm_loadu_ps(plane[2] >= 0.0f ? &t.max_z[i] : &t.min_z[i]);
+            distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, px), _mm_mul_ps(b, py)), _mm_add_ps(_mm_mul_ps(c, pz), d));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+        }
+        mask = _mm_movemask_ps(inside);
+#else
+        for(int lane = 0; lane<BOUNDS_LANES; lane++)
+        {
+            int k = i + lane;
+            bool inside = true;
+            for(int p = 0; p<6 && inside; p++)
+            {
+                const float* plane = frustum.planes[p];
+                float distance = plane[0]*t.center_x[k] + plane[1]*t.center_y[k] + plane[2]*t.center_z[k] + plane[3];
+                float px = plane[0] >= 0.0f ? t.max_x[k] : t.min_x[k];
+                float py = plane[1] >= 0.0f ? t.max_y[k] : t.min_y[k];
+                float pz = plane[2] >= 0.0f ? t.max_z[k] : t.min_z[k];
+                inside = distance >= -t.radius[k] && plane[0]*px + plane[1]*py + plane[2]*pz + plane[3] >= 0.0f;
+            }
+            mask |= inside ? 1 << lane : 0;
+        }
+#endif
+        for(int lane = 0; lane<BOUNDS_LANES && i + lane < t.count; lane++)
+        {
+            unsigned char in = (mask >> lane) & 1;
+            visible[i + lane] = in;
+            if(in)
+                stats.drawn++;
+            else
+                stats.culled++;
+        }
+    }
+    return stats;
+}
+
+SmallObjectStats smallObjectCull(const parser::Camera& camera, float minPixels,
+    std::vector<unsigned char>& visible, std::vector<int>* impostors)
+{
+    SmallObjectStats stats = { 0, 0 };
+    const BoundsTable& t = boundsTable;
+    int padded = t.radius.size();
+    visible.resize(t.count, 1);
+    if(impostors)
+        impostors->clear();
+
+    // A sphere of radius r whose center is d away covers a disc of radius
+    // r / sqrt(d^2 - r^2) at distance 1, so with pixelsX * pixelsY pixels per
+    // square unit there it covers pi * r^2 * pixelsX * pixelsY / (d^2 - r^2)
+    // pixels. Comparing r^2 * k < d^2 - r^2 avoids the division and keeps
+    // the meshes the camera is inside of.
+    float pixelsX = camera.image_width * camera.near_distance / (camera.near_plane.y - camera.near_plane.x);
+    float pixelsY = camera.image_height * camera.near_distance / (camera.near_plane.w - camera.near_plane.z);
+    float k = 3.14159265f * pixelsX * pixelsY / fmaxf(minPixels, 1e-6f);
+
+    for(int i = 0; i<padded; i += BOUNDS_LANES)
+    {
+        int mask = 0;
+#if defined(__SSE2__)
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(&t.center_x[i]), _mm_set1_ps(camera.position.x));
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(&t.center_y[i]), _mm_set1_ps(camera.position.y));
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(&t.center_z[i]), _mm_set1_ps(camera.position.z));
+        __m128 r = _mm_loadu_ps(&t.radius[i]);
+        __m128 r2 = _mm_mul_ps(r, r);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        mask = _mm_movemask_ps(_mm_cmplt_ps(_mm_mul_ps(r2, _mm_set1_ps(k)), _mm_sub_ps(d2, r2)));
+#else
+        for(int lane = 0; lane<BOUNDS_LANES; lane++)
+        {
+            int j = i + lane;
+            float dx = t.center_x[j] - camera.position.x;
+            float dy = t.center_y[j] - camera.position.y;
+            float dz = t.center_z[j] - camera.position.z;
+            float r2 = t.radius[j]*t.radius[j];
+            if(r2 * k < dx*dx + dy*dy + dz*dz - r2)
+                mask |= 1 << lane;
+        }
+#endif
+        for(int lane = 0; lane<BOUNDS_LANES && i + lane < t.count; lane++)
+        {
+            if(!((mask >> lane) & 1) || !visible[i + lane])
+                continue;
+            visible[i + lane] = 0;
+            stats.culled++;
+            if(impostors)
+            {
+                impostors->push_back(i + lane);
+                stats.impostors++;
+            }
+        }
+    }
+    return stats;
+}
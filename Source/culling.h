@@ -0,0 +1,57 @@
+#ifndef __HW3__CULLING__
+#define __HW3__CULLING__
+
+#include <vector>
+#include "parser.h"
+#include "bounds.h"
+
+// Six planes (a, b, c, d) with normals pointing into the frustum:
+// left, right, bottom, top, near, far
+struct Frustum
+{
+    float planes[6][4];
+};
+
+struct CullStats
+{
+    int drawn;
+    int culled;
+};
+
+struct SmallObjectStats
+{
+    int culled;
+    int impostors;
+};
+
+// Planes of the glFrustum/gluLookAt pair that cameraInit sets up.
+void cameraFrustum(const parser::Camera& camera, Frustum& frustum);
+void frustumFromMatrix(mat4x4 viewProjection, Frustum& frustum);
+
+// Scenes with at least this many meshes are culled through a BVH over the
+// world bounds; smaller ones are tested flat.
+#define BVH_MIN_MESHES 64
+
+// Load time: bounds of every mesh, taken through its transformation chain.
+// Instances reuse the object space bounds of their base mesh.
+void buildMeshBounds(const parser::Scene& scene);
+// Recomputes the world bounds of meshes whose transformations changed and
+// refits the BVH above them.
+void updateMeshBounds(const parser::Scene& scene, const std::vector<int>& changed);
+const std::vector<Bounds>& meshLocalBounds();
+const std::vector<Bounds>& meshWorldBounds();
+const BoundsTable& meshBoundsTable();
+
+// Per frame: visible[i] is 1 when mesh i may intersect the frustum. Large
+// scenes walk the BVH and accept or reject whole subtrees; small ones test
+// spheres, then boxes, BOUNDS_LANES meshes at a time.
+CullStats frustumCull(const Frustum& frustum, std::vector<unsigned char>& visible);
+
+// Per frame, after the frustum: projects the bounding sphere of every mesh
+// still in visible through the cameraInit frustum and clears those covering
+// fewer than minPixels pixels. When impostors is given, the cleared meshes
+// are listed there to be drawn as points.
+SmallObjectStats smallObjectCull(const parser::Camera& camera, float minPixels,
+    std::vector<unsigned char>& visible, std::vector<int>* impostors);
+
+#endif
@@ -0,0 +1,323 @@
+#include "distributed.h"
+#include "scenecache.h"
+#include "transform.h"
+#include "image.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// One tile request; a width of 0 tells the worker to stop. Both ends are
+// the same binary on the same machine, so it travels in host layout.
+struct TileMessage
+{
+    int x, y;
+    int width, height;
+};
+
+// A connected worker; which process it is does not matter.
+struct WorkerConnection
+{
+    int socket;     // -1 after it hung up or was told to stop
+    int tile;       // index of the tile it renders, -1 when idle
+};
+
+static bool sendAll(int fd, const void* data, size_t size)
+{
+    const char* at = (const char*)data;
+    while(size > 0)
+    {
+        ssize_t sent = send(fd, at, size, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR)
+            continue;
+        if(sent <= 0)
+            return false;
+        at += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static bool recvAll(int fd, void* data, size_t size)
+{
+    char* at = (char*)data;
+    while(size > 0)
+    {
+        ssize_t received = recv(fd, at, size, 0);
+        if(received < 0 && errno == EINTR)
+            continue;
+        if(received <= 0)
+            return false;
+        at += received;
+        size -= received;
+    }
+    return true;
+}
+
+static bool socketAddress(const std::string& path, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Error: socket path %s is too long\n", path.c_str());
+        return false;
+    }
+    strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+// The worker's command line: ours without --distribute, --output and
+// --target-ms, and with the socket and the scene cache appended. Tiles are
+// drawn at full resolution, as posters are.
+static std::vector<std::string> workerArguments(int argc, char* argv[], const std::string& socketPath, const std::string& cachePath)
+{
+    std::vector<std::string> arguments;
+    arguments.push_back(argv[0]);
+    arguments.push_back(argv[1]);
+    for(int i = 2; i<argc; i++)
+    {
+        if((strcmp(argv[i], "--distribute") == 0 || strcmp(argv[i], "--output") == 0 ||
+            strcmp(argv[i], "--worker") == 0 || strcmp(argv[i], "--scene-cache") == 0 ||
+            strcmp(argv[i], "--target-ms") == 0) && i + 1 < argc)
+        {
+            i++;
+            continue;
+        }
+        arguments.push_back(argv[i]);
+    }
+    arguments.push_back("--worker");
+    arguments.push_back(socketPath);
+    arguments.push_back("--scene-cache");
+    arguments.push_back(cachePath);
+    return arguments;
+}
+
+static pid_t startWorker(const std::vector<std::string>& arguments)
+{
+    pid_t pid = fork();
+    if(pid != 0)
+        return pid;
+    std::vector<char*> pointers;
+    for(size_t i = 0; i<arguments.size(); i++)
+        pointers.push_back(const_cast<char*>(arguments[i].c_str()));
+    pointers.push_back(NULL);
+    execv("/proc/self/exe", &pointers[0]);
+    fprintf(stderr, "Error: cannot start a worker: %s\n", strerror(errno));
+    _exit(127);
+}
+
+static void closeConnection(WorkerConnection& worker)
+{
+    if(worker.socket >= 0)
+        close(worker.socket);
+    worker.socket = -1;
+    worker.tile = -1;
+}
+
+bool runCoordinator(const parser::Scene& scene, int workerCount, int tileSize, const std::string& output, int argc, char* argv[])
+{
+    if(workerCount < 1 || tileSize < 1)
+    {
+        fprintf(stderr, "Error: --distribute needs at least one worker and a tile size above 0\n");
+        return false;
+    }
+    const parser::Camera& camera = scene.camera;
+    std::vector<TileMessage> tiles;
+    for(int y = 0; y<camera.image_height; y += tileSize)
+    {
+        for(int x = 0; x<camera.image_width; x += tileSize)
+        {
+            TileMessage tile = { x, y, std::min(tileSize, camera.image_width - x), std::min(tileSize, camera.image_height - y) };
+            tiles.push_back(tile);
+        }
+    }
+    workerCount = std::min(workerCount, (int)tiles.size());
+
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "/tmp/hw3-%d", (int)getpid());
+    std::string socketPath = std::string(prefix) + ".sock";
+    std::string cachePath = std::string(prefix) + ".scene";
+    if(!writeSceneCache(scene, cachePath))
+        return false;
+
+    sockaddr_un address;
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if(listener < 0 || !socketAddress(socketPath, address) ||
+        bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, workerCount) != 0)
+    {
+        fprintf(stderr, "Error: cannot listen on %s\n", socketPath.c_str());
+        if(listener >= 0)
+            close(listener);
+        unlink(cachePath.c_str());
+        return false;
+    }
+
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    std::vector<std::string> arguments = workerArguments(argc, argv, socketPath, cachePath);
+    int alive = 0;
+    for(int i = 0; i<workerCount; i++)
+    {
+        if(startWorker(arguments) > 0)
+            alive++;
+        else
+            fprintf(stderr, "Warning: cannot start worker %d: %s\n", i, strerror(errno));
+    }
+
+    std::vector<unsigned char> image(camera.image_width * camera.image_height * 3, 0);
+    std::vector<unsigned char> pixels;
+    std::vector<WorkerConnection> workers;
+    std::deque<int> pending;
+    for(size_t i = 0; i<tiles.size(); i++)
+        pending.push_back(i);
+    int done = 0;
+    int requeued = 0;
+
+    // idle workers stay connected until the last tile is in, so the tile of
+    // a worker that dies always has someone to go to
+    while(done < (int)tiles.size() && alive > 0)
+    {
+        for(size_t i = 0; i<workers.size() && !pending.empty(); i++)
+        {
+            WorkerConnection& worker = workers[i];
+            if(worker.socket < 0 || worker.tile >= 0)
+                continue;
+            worker.tile = pending.front();
+            pending.pop_front();
+            if(!sendAll(worker.socket, &tiles[worker.tile], sizeof(TileMessage)))
+            {
+                pending.push_front(worker.tile);
+                closeConnection(worker);
+            }
+        }
+
+        std::vector<pollfd> polled;
+        std::vector<int> polledWorkers;
+        pollfd listening = { listener, POLLIN, 0 };
+        polled.push_back(listening);
+        polledWorkers.push_back(-1);
+        for(size_t i = 0; i<workers.size(); i++)
+        {
+            if(workers[i].socket < 0)
+                continue;
+            pollfd connection = { workers[i].socket, POLLIN, 0 };
+            polled.push_back(connection);
+            polledWorkers.push_back(i);
+        }
+        // with a timeout, so workers dying before they connect are noticed
+        if(poll(&polled[0], polled.size(), 100) < 0 && errno != EINTR)
+            break;
+
+        for(size_t p = 1; p<polled.size(); p++)
+        {
+            WorkerConnection& worker = workers[polledWorkers[p]];
+            if(polled[p].revents == 0)
+                continue;
+            if(worker.tile < 0)
+            {
+                // an idle worker has nothing to say; it hung up
+                closeConnection(worker);
+                continue;
+            }
+            const TileMessage& tile = tiles[worker.tile];
+            pixels.resize(tile.width * tile.height * 3);
+            if(!recvAll(worker.socket, &pixels[0], pixels.size()))
+            {
+                pending.push_front(worker.tile);
+                requeued++;
+                closeConnection(worker);
+                continue;
+            }
+            for(int row = 0; row<tile.height; row++)
+                memcpy(&image[((tile.y + row) * camera.image_width + tile.x) * 3], &pixels[row * tile.width * 3], tile.width * 3);
+            worker.tile = -1;
+            done++;
+        }
+        if(polled[0].revents & POLLIN)
+        {
+            int connection = accept(listener, NULL, NULL);
+            if(connection >= 0)
+            {
+                WorkerConnection worker = { connection, -1 };
+                workers.push_back(worker);
+            }
+        }
+
+        int status;
+        pid_t exited;
+        while((exited = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            alive--;
+            if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                fprintf(stderr, "Warning: worker %d exited abnormally\n", (int)exited);
+        }
+    }
+
+    TileMessage stop = { 0, 0, 0, 0 };
+    for(size_t i = 0; i<workers.size(); i++)
+    {
+        if(workers[i].socket >= 0)
+            sendAll(workers[i].socket, &stop, sizeof(stop));
+        closeConnection(workers[i]);
+    }
+    close(listener);
+    while(alive > 0 && wait(NULL) > 0)
+        alive--;
+    unlink(socketPath.c_str());
+    unlink(cachePath.c_str());
+
+    if(done < (int)tiles.size())
+    {
+        fprintf(stderr, "Error: the workers are gone with %d of %d tiles left\n", (int)tiles.size() - done, (int)tiles.size());
+        return false;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Distributed: %d tiles of %d px on %d workers in %.3f s, %d re-queued\n",
+        (int)tiles.size(), tileSize, (int)workers.size(), seconds, requeued);
+    if(!writeImage(output, camera.image_width, camera.image_height, image))
+        return false;
+    printf("Wrote %s\n", output.c_str());
+    return true;
+}
+
+bool runWorker(const std::string& socketPath, const parser::Camera& camera,
+    const std::function<void(const parser::Camera&, std::vector<unsigned char>&)>& renderTile)
+{
+    sockaddr_un address;
+    if(!socketAddress(socketPath, address))
+        return false;
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(connection < 0 || connect(connection, (sockaddr*)&address, sizeof(address)) != 0)
+    {
+        fprintf(stderr, "Error: cannot connect to %s\n", socketPath.c_str());
+        if(connection >= 0)
+            close(connection);
+        return false;
+    }
+    std::vector<unsigned char> rgb;
+    TileMessage tile;
+    bool ok = false;
+    while(recvAll(connection, &tile, sizeof(tile)))
+    {
+        if(tile.width <= 0)
+        {
+            ok = true;
+            break;
+        }
+        renderTile(tileCamera(camera, tile.x, tile.y, tile.width, tile.height), rgb);
+        if(!sendAll(connection, &rgb[0], tile.width * tile.height * 3))
+            break;
+    }
+    close(connection);
+    if(!ok)
+        fprintf(stderr, "Error: lost the coordinator at %s\n", socketPath.c_str());
+    return ok;
+}
@@ -0,0 +1,23 @@
+#ifndef __HW3__DISTRIBUTED__
+#define __HW3__DISTRIBUTED__
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "parser.h"
+
+// --distribute: writes the scene to a cache file and starts workerCount
+// copies of this program on it, given the command line minus --distribute
+// and --output plus --worker and --scene-cache. Tiles of tileSize pixels
+// are handed out over a Unix socket one at a time, so faster workers take
+// more of them, and a dead worker's tile goes to another. The assembled
+// image is written to output. Returns false and prints an error on failure.
+bool runCoordinator(const parser::Scene& scene, int workerCount, int tileSize, const std::string& output, int argc, char* argv[]);
+
+// --worker: connects to the coordinator, and for every tile it is sent
+// calls renderTile with the camera of that tile and streams the tile's
+// pixels back, top row first, until the coordinator says stop.
+bool runWorker(const std::string& socketPath, const parser::Camera& camera,
+    const std::function<void(const parser::Camera&, std::vector<unsigned char>&)>& renderTile);
+
+#endif
@@ -0,0 +1,163 @@
+#include "headless.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static EGLSurface surface = EGL_NO_SURFACE;
+static GLuint framebuffer = 0;
+static GLuint colorBuffer = 0;
+static GLuint depthBuffer = 0;
+static int framebufferWidth = 0;
+static int framebufferHeight = 0;
+
+static bool hasExtension(const char* extensions, const char* name)
+{
+    if(!extensions)
+        return false;
+    size_t length = strlen(name);
+    for(const char* found = strstr(extensions, name); found; found = strstr(found + length, name))
+    {
+        if((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+static EGLDisplay openDisplay()
+{
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if(hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if(getPlatformDisplay)
+        {
+            EGLDisplay surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+            if(surfaceless != EGL_NO_DISPLAY)
+                return surfaceless;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool createHeadlessContext()
+{
+    display = openDisplay();
+    EGLint major = 0, minor = 0;
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    {
+        fprintf(stderr, "Error: cannot initialize an EGL display\n");
+        return false;
+    }
+    if(!eglBindAPI(EGL_OPENGL_API))
+    {
+        fprintf(stderr, "Error: EGL does not provide desktop OpenGL\n");
+        return false;
+    }
+    EGLint attributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+    if(!eglChooseConfig(display, attributes, &config, 1, &configs) || configs < 1)
+    {
+        fprintf(stderr, "Error: no EGL config for offscreen OpenGL\n");
+        return false;
+    }
+    // no version attributes: a compatibility context, as GLFW gives by default
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+    if(context == EGL_NO_CONTEXT)
+    {
+        fprintf(stderr, "Error: cannot create an EGL context\n");
+        return false;
+    }
+    bool current = false;
+    if(hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context"))
+        current = eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+    if(!current)
+    {
+        EGLint size[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, size);
+        current = surface != EGL_NO_SURFACE && eglMakeCurrent(display, surface, surface, context);
+    }
+    if(!current)
+    {
+        fprintf(stderr, "Error: cannot make the EGL context current\n");
+        return false;
+    }
+    return true;
+}
+
+static void releaseHeadlessFramebuffer()
+{
+    if(framebuffer)
+        glDeleteFramebuffers(1, &framebuffer);
+    if(colorBuffer)
+        glDeleteRenderbuffers(1, &colorBuffer);
+    if(depthBuffer)
+        glDeleteRenderbuffers(1, &depthBuffer);
+    framebuffer = colorBuffer = depthBuffer = 0;
+    framebufferWidth = framebufferHeight = 0;
+}
+
+bool initHeadlessFramebuffer(int width, int height)
+{
+    releaseHeadlessFramebuffer();
+    framebufferWidth = width;
+    framebufferHeight = height;
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH32F_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Error: the headless framebuffer is incomplete\n");
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+bool reserveHeadlessFramebuffer(int width, int height)
+{
+    if(width <= framebufferWidth && height <= framebufferHeight)
+        return true;
+    return initHeadlessFramebuffer(std::max(width, framebufferWidth), std::max(height, framebufferHeight));
+}
+
+GLuint headlessFramebuffer()
+{
+    return framebuffer;
+}
+
+void destroyHeadlessContext()
+{
+    releaseHeadlessFramebuffer();
+    if(display != EGL_NO_DISPLAY)
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if(context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        if(surface != EGL_NO_SURFACE)
+            eglDestroySurface(display, surface);
+        eglTerminate(display);
+    }
+    display = EGL_NO_DISPLAY;
+    context = EGL_NO_CONTEXT;
+    surface = EGL_NO_SURFACE;
+}
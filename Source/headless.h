@@ -0,0 +1,21 @@
+#ifndef __HW3__HEADLESS__
+#define __HW3__HEADLESS__
+
+#include <GL/glew.h>
+
+// Offscreen rendering without a window system: an EGL context on Mesa's
+// surfaceless platform, or on the default display when that is missing,
+// made current without a surface where EGL_KHR_surfaceless_context allows
+// and on a 1x1 pbuffer otherwise. Returns false and prints an error on
+// failure.
+bool createHeadlessContext();
+// After glewInit: creates and binds the framebuffer object frames are drawn
+// into, with a 32 bit float depth buffer.
+bool initHeadlessFramebuffer(int width, int height);
+// Grows the framebuffer to hold width x height, keeping it when it does
+// already; smaller frames are drawn into its corner.
+bool reserveHeadlessFramebuffer(int width, int height);
+GLuint headlessFramebuffer();
+void destroyHeadlessContext();
+
+#endif
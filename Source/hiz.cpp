@@ -0,0 +1,395 @@
+#include "hiz.h"
+#include "culling.h"
+#include "lod.h"
+#include "shaders.h"
+#include "threadpool.h"
+#include "transform.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Occluder triangles in buffer space: x and y in pixels, z as depth in [0, 1]
+struct ScreenTriangle
+{
+    float x[3], y[3], z[3];
+};
+
+static int width = 0;
+static int height = 0;
+// level 0 is the depth buffer, each further level the max of 2x2 texels below
+static std::vector<std::vector<float> > pyramid;
+static std::vector<int> levelWidth;
+static std::vector<int> levelHeight;
+static std::vector<std::vector<ScreenTriangle> > occluderTriangles;
+
+static void transformPoint(mat4x4 m, const parser::Vec3f& p, float clip[4])
+{
+#if defined(__SSE2__)
+    __m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m[0]), _mm_set1_ps(p.x)), _mm_mul_ps(_mm_loadu_ps(m[1]), _mm_set1_ps(p.y))),
+                          _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m[2]), _mm_set1_ps(p.z)), _mm_loadu_ps(m[3])));
+    _mm_storeu_ps(clip, c);
+#else
+    for(int r = 0; r<4; r++)
+        clip[r] = m[0][r] * p.x + m[1][r] * p.y + m[2][r] * p.z + m[3][r];
+#endif
+}
+
+// Drops the faces GL culls: y points up here, so counterclockwise, front
+// facing triangles have a positive area. GL writes no depth for them, and
+// an occluder drawn with them would hide what lies inside it.
+static void emitScreenTriangle(const float* a, const float* b, const float* c, CullMode cull, std::vector<ScreenTriangle>& out)
+{
+    const float* v[3] = { a, b, c };
+    ScreenTriangle t;
+    for(int k = 0; k<3; k++)
+    {
+        float invW = 1.0f / v[k][3];
+        t.x[k] = (v[k][0] * invW * 0.5f + 0.5f) * width;
+        t.y[k] = (v[k][1] * invW * 0.5f + 0.5f) * height;
+        t.z[k] = v[k][2] * invW * 0.5f + 0.5f;
+    }
+    if(cull != CULL_NONE)
+    {
+        float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+        if(cull == CULL_BACK ? area <= 0.0f : area >= 0.0f)
+            return;
+    }
+    out.push_back(t);
+}
+
+// Clips against the near plane (z > -w in clip space) and emits a fan.
+static void clipTriangle(const float clip[3][4], CullMode cull, std::vector<ScreenTriangle>& out)
+{
+    float polygon[4][4];
+    int count = 0;
+    for(int k = 0; k<3; k++)
+    {
+        const float* a = clip[k];
+        const float* b = clip[(k + 1) % 3];
+        float da = a[2] + a[3];
+        float db = b[2] + b[3];
+        if(da >= 0.0f)
+        {
+            for(int c = 0; c<4; c++)
+                polygon[count][c] = a[c];
+            count++;
+        }
+        if((da >= 0.0f) != (db >= 0.0f))
+        {
+            float t = da / (da - db);
+            for(int c = 0; c<4; c++)
+                polygon[count][c] = a[c] + t * (b[c] - a[c]);
+            count++;
+        }
+    }
+    for(int k = 2; k<count; k++)
+        emitScreenTriangle(polygon[0], polygon[k - 1], polygon[k], cull, out);
+}
+
+static void transformOccluder(const parser::Scene& scene, mat4x4 viewProjection, int mesh,
+    const std::vector<parser::Face>& faces, std::vector<ScreenTriangle>& out)
+{
+    mat4x4 model;
+    mat4x4 mvp;
+    meshModelMatrix(scene, scene.meshes[mesh], model);
+    mat4x4_mul(mvp, viewProjection, model);
+    CullMode cull = cullModeOf(scene);
+    out.clear();
+    int fSize = faces.size();
+    for(int j = 0; j<fSize; j++)
+    {
+        float clip[3][4];
+        transformPoint(mvp, scene.vertex_data[faces[j].v0_id - 1], clip[0]);
+        transformPoint(mvp, scene.vertex_data[faces[j].v1_id - 1], clip[1]);
+        transformPoint(mvp, scene.vertex_data[faces[j].v2_id - 1], clip[2]);
+        if(clip[0][2] + clip[0][3] >= 0.0f && clip[1][2] + clip[1][3] >= 0.0f && clip[2][2] + clip[2][3] >= 0.0f)
+        {
+            emitScreenTriangle(clip[0], clip[1], clip[2], cull, out);
+        }
+        else
+        {
+            clipTriangle(clip, cull, out);
+        }
+    }
+}
+
+// Rasterizes the rows [rowBegin, rowEnd) of one triangle with a min depth
+// test, four pixel centers at a time. Both windings are drawn; culled faces
+// never get here.
+static void rasterTriangle(const ScreenTriangle& t, int rowBegin, int rowEnd, float* depth)
+{
+    float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+    if(fabsf(area) < 1e-8f)
+        return;
+    int i1 = area > 0.0f ? 1 : 2;
+    int i2 = area > 0.0f ? 2 : 1;
+    area = fabsf(area);
+    float x0 = t.x[0], y0 = t.y[0], z0 = t.z[0];
+    float x1 = t.x[i1], y1 = t.y[i1], z1 = t.z[i1];
+    float x2 = t.x[i2], y2 = t.y[i2], z2 = t.z[i2];
+
+    int minY = std::max(rowBegin, (int)floorf(std::min(y0, std::min(y1, y2))));
+    int maxY = std::min(rowEnd - 1, (int)ceilf(std::max(y0, std::max(y1, y2))));
+    int minX = std::max(0, (int)floorf(std::min(x0, std::min(x1, x2)))) & ~3;
+    int maxX = std::min(width - 1, (int)ceilf(std::max(x0, std::max(x1, x2))));
+    if(minY > maxY || minX > maxX)
+        return;
+
+    // edge functions E = A x + B y + C, non-negative inside; edge k is
+    // opposite vertex k
+    float a0 = y1 - y2, b0 = x2 - x1, c0 = -(a0 * x1 + b0 * y1);
+    float a1 = y2 - y0, b1 = x0 - x2, c1 = -(a1 * x2 + b1 * y2);
+    float a2 = y0 - y1, b2 = x1 - x0, c2 = -(a2 * x0 + b2 * y0);
+    // depth plane from the barycentrics E1 / area and E2 / area
+    float za = (a1 * (z1 - z0) + a2 * (z2 - z0)) / area;
+    float zb = (b1 * (z1 - z0) + b2 * (z2 - z0)) / area;
+    float zc = z0 + (c1 * (z1 - z0) + c2 * (z2 - z0)) / area;
+
+    for(int y = minY; y<=maxY; y++)
+    {
+        float py = y + 0.5f;
+        float* row = depth + (size_t)y * width;
+#if defined(__SSE2__)
+        __m128 e0Row = _mm_set1_ps(b0 * py + c0);
+        __m128 e1Row = _mm_set1_ps(b1 * py + c1);
+        __m128 e2Row = _mm_set1_ps(b2 * py + c2);
+        __m128 zRow = _mm_set1_ps(zb * py + zc);
+        __m128 zero = _mm_setzero_ps();
+        for(int x = minX; x<=maxX; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a0), px), e0Row);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a1), px), e1Row);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a2), px), e2Row);
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+            if(!_mm_movemask_ps(inside))
+                continue;
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), zRow);
+            __m128 old = _mm_loadu_ps(row + x);
+            __m128 nearer = _mm_min_ps(old, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+        }
+#else
+        for(int x = minX; x<=maxX; x++)
+        {
+            float px = x + 0.5f;
+            if(a0 * px + b0 * py + c0 < 0.0f || a1 * px + b1 * py + c1 < 0.0f || a2 * px + b2 * py + c2 < 0.0f)
+                continue;
+            float z = za * px + zb * py + zc;
+            if(z < row[x])
+                row[x] = z;
+        }
+#endif
+    }
+}
+
+static void resizeBuffer(const parser::Camera& camera)
+{
+    int h = (int)(HIZ_WIDTH * (float)camera.image_height / camera.image_width + 0.5f);
+    if(h < 1)
+        h = 1;
+    if(width == HIZ_WIDTH && height == h)
+        return;
+    width = HIZ_WIDTH;
+    height = h;
+    pyramid.clear();
+    levelWidth.clear();
+    levelHeight.clear();
+    int w = width;
+    h = height;
+    for(;;)
+    {
+        pyramid.push_back(std::vector<float>((size_t)w * h, 1.0f));
+        levelWidth.push_back(w);
+        levelHeight.push_back(h);
+        if(w == 1 && h == 1)
+            break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+}
+
+static void buildPyramid()
+{
+    int lSize = pyramid.size();
+    for(int l = 1; l<lSize; l++)
+    {
+        const std::vector<float>& below = pyramid[l - 1];
+        std::vector<float>& level = pyramid[l];
+        int bw = levelWidth[l - 1], bh = levelHeight[l - 1];
+        int w = levelWidth[l], h = levelHeight[l];
+        for(int y = 0; y<h; y++)
+        {
+            int y0 = 2 * y, y1 = std::min(2 * y + 1, bh - 1);
+            for(int x = 0; x<w; x++)
+            {
+                int x0 = 2 * x, x1 = std::min(2 * x + 1, bw - 1);
+                level[y * w + x] = std::max(std::max(below[y0 * bw + x0], below[y0 * bw + x1]),
+                                            std::max(below[y1 * bw + x0], below[y1 * bw + x1]));
+            }
+        }
+    }
+}
+
+// True when the whole box is farther than the occluders over its screen
+// rectangle.
+static bool boxOccluded(mat4x4 viewProjection, const Bounds& b)
+{
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float minZ = FLT_MAX;
+    for(int k = 0; k<8; k++)
+    {
+        parser::Vec3f corner = { (k & 1) ? b.max.x : b.min.x, (k & 2) ? b.max.y : b.min.y, (k & 4) ? b.max.z : b.min.z };
+        float clip[4];
+        transformPoint(viewProjection, corner, clip);
+        // the box reaches past the near plane; its projection is unbounded
+        if(clip[2] + clip[3] <= 0.0f)
+            return false;
+        float invW = 1.0f / clip[3];
+        float x = (clip[0] * invW * 0.5f + 0.5f) * width;
+        float y = (clip[1] * invW * 0.5f + 0.5f) * height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        minZ = std::min(minZ, clip[2] * invW * 0.5f + 0.5f);
+    }
+    int x0 = std::max(0, (int)floorf(minX));
+    int x1 = std::min(width - 1, (int)floorf(maxX));
+    int y0 = std::max(0, (int)floorf(minY));
+    int y1 = std::min(height - 1, (int)floorf(maxY));
+    if(x0 > x1 || y0 > y1)
+        return false;
+
+    // coarsest level at which the rectangle still spans at most 4x4 texels
+    int l = 0;
+    int lSize = pyramid.size();
+    while(l + 1 < lSize && ((x1 >> l) - (x0 >> l) >= 4 || (y1 >> l) - (y0 >> l) >= 4))
+        l++;
+    const std::vector<float>& level = pyramid[l];
+    int w = levelWidth[l];
+    for(int y = y0 >> l; y<=(y1 >> l); y++)
+    {
+        for(int x = x0 >> l; x<=(x1 >> l); x++)
+        {
+            if(level[y * w + x] >= minZ)
+                return false;
+        }
+    }
+    return true;
+}
+
+HiZStats hizCull(const parser::Scene& scene, int maxOccluders, std::vector<unsigned char>& visible)
+{
+    HiZStats stats = { 0, 0, 0 };
+    const parser::Camera& camera = scene.camera;
+    resizeBuffer(camera);
+    mat4x4 view;
+    mat4x4 projection;
+    mat4x4 viewProjection;
+    cameraViewMatrix(camera, view);
+    cameraProjectionMatrix(camera, projection);
+    mat4x4_mul(viewProjection, projection, view);
+
+    // the solid meshes that look largest from the camera occlude the rest
+    const std::vector<Bounds>& world = meshWorldBounds();
+    const std::vector<Bounds>& local = meshLocalBounds();
+    std::vector<std::pair<float, int> > candidates;
+    int mSize = world.size();
+    for(int i = 0; i<mSize; i++)
+    {
+        if(!visible[i] || meshKindOf(scene.meshes[i]) != MESH_SOLID)
+            continue;
+        const Bounds& b = world[i];
+        float dx = b.center.x - camera.position.x;
+        float dy = b.center.y - camera.position.y;
+        float dz = b.center.z - camera.position.z;
+        float distance = fmaxf(sqrtf(dx*dx + dy*dy + dz*dz) - b.radius, camera.near_distance);
+        candidates.push_back(std::make_pair(-b.radius / distance, i));
+    }
+    int oSize = std::min((int)candidates.size(), maxOccluders);
+    std::partial_sort(candidates.begin(), candidates.begin() + oSize, candidates.end());
+    occluderTriangles.resize(oSize);
+    std::vector<unsigned char> isOccluder(mSize, 0);
+    for(int o = 0; o<oSize; o++)
+        isOccluder[candidates[o].second] = 1;
+
+    // pixels of the buffer per world unit at distance 1, for picking proxies
+    float pixelsPerUnit = height * camera.near_distance / (camera.near_plane.w - camera.near_plane.z);
+    parallelFor(oSize, [&](int o)
+    {
+        int mesh = candidates[o].second;
+        int level = meshLodCount(mesh) - 1;
+        if(level > 0)
+        {
+            const Bounds& b = world[mesh];
+            float dx = b.center.x - camera.position.x;
+            float dy = b.center.y - camera.position.y;
+            float dz = b.center.z - camera.position.z;
+            float distance = fmaxf(sqrtf(dx*dx + dy*dy + dz*dz) - b.radius, camera.near_distance);
+            float scale = local[mesh].radius > 0.0f ? b.radius / local[mesh].radius : 1.0f;
+            while(level > 0 && meshLod(mesh, level).error * scale * pixelsPerUnit / distance > 1.0f)
+                level--;
+        }
+        const std::vector<parser::Face>& faces = level ? meshLod(mesh, level).faces : scene.meshFaces(scene.meshes[mesh]);
+        transformOccluder(scene, viewProjection, mesh, faces, occluderTriangles[o]);
+    });
+
+    float* depth = &pyramid[0][0];
+    int bands = (height + HIZ_BAND_ROWS - 1) / HIZ_BAND_ROWS;
+    parallelFor(bands, [&](int band)
+    {
+        int rowBegin = band * HIZ_BAND_ROWS;
+        int rowEnd = std::min(height, rowBegin + HIZ_BAND_ROWS);
+        std::fill(depth + (size_t)rowBegin * width, depth + (size_t)rowEnd * width, 1.0f);
+        for(int o = 0; o<oSize; o++)
+        {
+            const std::vector<ScreenTriangle>& triangles = occluderTriangles[o];
+            int tSize = triangles.size();
+            for(int j = 0; j<tSize; j++)
+            {
+                const ScreenTriangle& t = triangles[j];
+                if(std::max(t.y[0], std::max(t.y[1], t.y[2])) < rowBegin || std::min(t.y[0], std::min(t.y[1], t.y[2])) > rowEnd)
+                    continue;
+                rasterTriangle(t, rowBegin, rowEnd, depth);
+            }
+        }
+    });
+    buildPyramid();
+
+    std::atomic<int> occluded(0);
+    const int chunk = 64;
+    parallelFor((mSize + chunk - 1) / chunk, [&](int c)
+    {
+        int hidden = 0;
+        for(int i = c * chunk; i<std::min(mSize, (c + 1) * chunk); i++)
+        {
+            if(!visible[i] || isOccluder[i])
+                continue;
+            if(boxOccluded(viewProjection, world[i]))
+            {
+                visible[i] = 0;
+                hidden++;
+            }
+        }
+        occluded += hidden;
+    });
+
+    stats.occluders = oSize;
+    for(int o = 0; o<oSize; o++)
+        stats.triangles += occluderTriangles[o].size();
+    stats.occluded = occluded;
+    return stats;
+}
+
+void releaseHiZ()
+{
+    pyramid.clear();
+    levelWidth.clear();
+    levelHeight.clear();
+    occluderTriangles.clear();
+    width = height = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef __HW3__HIZ__
+#define __HW3__HIZ__
+
+#include <vector>
+#include "parser.h"
+
+// Width of the CPU depth buffer; the height follows the camera's aspect.
+// Must be a multiple of 4, the SIMD width of the rasterizer.
+#define HIZ_WIDTH 256
+// Rows each raster job covers; jobs own their rows, so no locking is needed.
+#define HIZ_BAND_ROWS 8
+
+struct HiZStats
+{
+    int occluders;
+    int triangles;  // occluder triangles rasterized
+    int occluded;   // meshes hidden by the occluders
+};
+
+// Per frame, before anything is submitted: the largest solid meshes on
+// screen are rasterized into a small depth buffer, a max-depth pyramid is
+// built over it, and every other mesh in visible whose screen rectangle is
+// behind the pyramid at a coarse enough level is cleared from visible.
+// Occluders use the coarsest level of detail whose error stays under one
+// buffer pixel. Work is spread over the thread pool.
+HiZStats hizCull(const parser::Scene& scene, int maxOccluders, std::vector<unsigned char>& visible);
+void releaseHiZ();
+
+#endif
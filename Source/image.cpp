@@ -0,0 +1,192 @@
+#include "image.h"
+#include <GL/glew.h>
+#include <cstdio>
+#include <cstring>
+
+static bool endsWith(const std::string& text, const char* suffix)
+{
+    size_t length = strlen(suffix);
+    if(text.size() < length)
+        return false;
+    for(size_t i = 0; i<length; i++)
+    {
+        char c = text[text.size() - length + i];
+        if(c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if(c != suffix[i])
+            return false;
+    }
+    return true;
+}
+
+static unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+{
+    static unsigned int table[256];
+    static bool tableReady = false;
+    if(!tableReady)
+    {
+        for(unsigned int n = 0; n<256; n++)
+        {
+            unsigned int c = n;
+            for(int k = 0; k<8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+    crc = ~crc;
+    for(size_t i = 0; i<size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putBigEndian(std::vector<unsigned char>& out, unsigned int value)
+{
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static void writeChunk(FILE* file, const char* type, const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> chunk;
+    putBigEndian(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBigEndian(chunk, crc32(&chunk[4], chunk.size() - 4));
+    fwrite(&chunk[0], 1, chunk.size(), file);
+}
+
+// Rendered frames are written once per run, so the zlib stream uses stored
+// (uncompressed) deflate blocks and the writer needs no library.
+static void beginPng(ImageWriter& writer)
+{
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, 8, writer.file);
+
+    std::vector<unsigned char> header;
+    putBigEndian(header, writer.width);
+    putBigEndian(header, writer.height);
+    header.push_back(8);    // bit depth
+    header.push_back(2);    // truecolor
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    writeChunk(writer.file, "IHDR", header);
+    writer.adler_a = 1;
+    writer.adler_b = 0;
+}
+
+// One IDAT chunk continuing the zlib stream; the last rows end it.
+static void writePngRows(ImageWriter& writer, const unsigned char* rgb, int rows)
+{
+    // every row starts with filter type 0
+    size_t rowSize = (size_t)writer.width * 3;
+    std::vector<unsigned char> raw;
+    raw.reserve((rowSize + 1) * rows);
+    for(int y = 0; y<rows; y++)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb + y * rowSize, rgb + (y + 1) * rowSize);
+    }
+
+    std::vector<unsigned char> stream;
+    if(writer.rows == 0)
+    {
+        stream.push_back(0x78);
+        stream.push_back(0x01);
+    }
+    bool finished = writer.rows + rows == writer.height;
+    size_t offset = 0;
+    do
+    {
+        size_t block = raw.size() - offset;
+        if(block > 65535)
+            block = 65535;
+        bool last = finished && offset + block == raw.size();
+        stream.push_back(last ? 1 : 0);
+        stream.push_back(block & 0xFF);
+        stream.push_back(block >> 8);
+        stream.push_back(~block & 0xFF);
+        stream.push_back((~block >> 8) & 0xFF);
+        stream.insert(stream.end(), raw.begin() + offset, raw.begin() + offset + block);
+        offset += block;
+    } while(offset < raw.size());
+    unsigned int a = writer.adler_a, b = writer.adler_b;
+    for(size_t i = 0; i<raw.size(); i++)
+    {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    writer.adler_a = a;
+    writer.adler_b = b;
+    if(finished)
+        putBigEndian(stream, (b << 16) | a);
+    writeChunk(writer.file, "IDAT", stream);
+    if(finished)
+        writeChunk(writer.file, "IEND", std::vector<unsigned char>());
+}
+
+bool beginImage(ImageWriter& writer, const std::string& path, int width, int height)
+{
+    writer.path = path;
+    writer.png = endsWith(path, ".png");
+    writer.width = width;
+    writer.height = height;
+    writer.rows = 0;
+    writer.file = fopen(path.c_str(), "wb");
+    if(!writer.file)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", path.c_str());
+        return false;
+    }
+    if(writer.png)
+        beginPng(writer);
+    else
+        fprintf(writer.file, "P6\n%d %d\n255\n", width, height);
+    return true;
+}
+
+bool writeImageRows(ImageWriter& writer, const unsigned char* rgb, int rows)
+{
+    if(rows <= 0 || writer.rows + rows > writer.height)
+        return false;
+    if(writer.png)
+        writePngRows(writer, rgb, rows);
+    else
+        fwrite(rgb, 1, (size_t)writer.width * 3 * rows, writer.file);
+    writer.rows += rows;
+    return !ferror(writer.file);
+}
+
+bool endImage(ImageWriter& writer)
+{
+    bool written = writer.rows == writer.height && !ferror(writer.file);
+    if(fclose(writer.file) != 0 || !written)
+    {
+        fprintf(stderr, "Error: writing %s failed\n", writer.path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool writeImage(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb)
+{
+    ImageWriter writer;
+    if(!beginImage(writer, path, width, height))
+        return false;
+    writeImageRows(writer, &rgb[0], height);
+    return endImage(writer);
+}
+
+void readFramebuffer(int width, int height, std::vector<unsigned char>& rgb)
+{
+    size_t rowSize = (size_t)width * 3;
+    std::vector<unsigned char> rows(rowSize * height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &rows[0]);
+    rgb.resize(rows.size());
+    for(int y = 0; y<height; y++)
+        memcpy(&rgb[y * rowSize], &rows[(height - 1 - y) * rowSize], rowSize);
+}
@@ -0,0 +1,36 @@
+#ifndef __HW3__IMAGE__
+#define __HW3__IMAGE__
+
+#include <string>
+#include <vector>
+
+#include <cstdio>
+
+// Writes tightly packed 8 bit RGB pixels, top row first. The format follows
+// the extension: ".png" writes a PNG, anything else a binary PPM (P6).
+// Returns false and prints an error when the file cannot be written.
+bool writeImage(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb);
+
+// The same files written a band of rows at a time, for images too large to
+// hold in memory. A PNG gets one IDAT chunk per band.
+struct ImageWriter
+{
+    FILE* file;
+    std::string path;
+    bool png;
+    int width, height;
+    int rows;               // rows written so far
+    unsigned int adler_a, adler_b;
+};
+
+bool beginImage(ImageWriter& writer, const std::string& path, int width, int height);
+// rgb holds rows whole rows, the next ones from the top.
+bool writeImageRows(ImageWriter& writer, const unsigned char* rgb, int rows);
+// Fails when fewer than height rows were written.
+bool endImage(ImageWriter& writer);
+
+// Reads the RGB pixels of the bound read framebuffer, flipped so the top
+// row comes first.
+void readFramebuffer(int width, int height, std::vector<unsigned char>& rgb);
+
+#endif
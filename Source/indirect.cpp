@@ -0,0 +1,465 @@
+#include "indirect.h"
+#include "instancing.h"
+#include "transform.h"
+#include "lod.h"
+#include "culling.h"
+#include <cstdio>
+
+static std::vector<IndirectBucket> buckets;
+static std::vector<IndirectCommand> commands;
+static std::vector<int> commandMesh;
+// index ranges of every level of detail; a command's levels start at commandLevels[c]
+static std::vector<GLuint> levelFirst;
+static std::vector<GLuint> levelCount;
+static std::vector<GLfloat> levelError;
+static std::vector<int> commandLevels;
+static std::vector<IndirectCommand> frameCommands;
+static GLuint indexBuffer = 0;
+static GLuint commandBuffer = 0;
+static GLuint drawIdBuffer = 0;
+static GLuint drawBuffer = 0;
+static GLuint materialBuffer = 0;
+static GLuint positionBuffer = 0;
+static GLuint normalsBuffer = 0;
+// GPU culling: inputs, the compacted commands and one draw count per bucket
+static bool gpuCulling = false;
+static bool gpuDrawCount = false;
+static GLuint cullProgram = 0;
+static GLuint cullBuffer = 0;
+static GLuint levelBuffer = 0;
+static GLuint culledCommandBuffer = 0;
+static GLuint drawCountBuffer = 0;
+// what the CPU side passes left visible, one flag per command
+static GLuint maskBuffer = 0;
+static std::vector<GLuint> frameMask;
+
+static const char* cullSource =
+    "#version 430\n"
+    "layout(local_size_x = GPU_CULL_GROUP_SIZE) in;\n"
+    "struct CullRecord { vec4 sphere; vec4 boxMin; vec4 boxMax; ivec4 levels; };\n"
+    "struct LevelRecord { uint firstIndex; uint count; float error; float padding; };\n"
+    "layout(std430, binding = 0) readonly buffer Culls { CullRecord culls[]; };\n"
+    "layout(std430, binding = 1) readonly buffer Levels { LevelRecord levels[]; };\n"
+    "layout(std430, binding = 2) buffer Commands { uint commands[]; };\n"
+    "layout(std430, binding = 3) buffer DrawCounts { uint drawCounts[]; };\n"
+    "layout(std430, binding = 4) readonly buffer Masks { uint masks[]; };\n"
+    "uniform vec4 planes[6];\n"
+    "uniform vec3 eye;\n"
+    "uniform float pixelsPerUnit;\n"
+    "uniform float nearDistance;\n"
+    "uniform float maxError;\n"
+    "uniform uint commandCount;\n"
+    "uniform bool clearTail;\n"
+    "uniform bool useMask;\n"
+    "void main()\n"
+    "{\n"
+    "    uint c = gl_GlobalInvocationID.x;\n"
+    "    if(c >= commandCount)\n"
+    "        return;\n"
+    "    ivec4 range = culls[c].levels;\n"
+    "    if(clearTail)\n"
+    "    {\n"
+    "        // slots past the bucket's count still hold earlier frames' commands\n"
+    "        if(c - uint(range.w) >= drawCounts[range.z])\n"
+    "            commands[5u * c + 1u] = 0u;\n"
+    "        return;\n"
+    "    }\n"
+    "    if(useMask && masks[c] == 0u)\n"
+    "        return;\n"
+    "    vec3 center = culls[c].sphere.xyz;\n"
+    "    float radius = culls[c].sphere.w;\n"
+    "    vec3 boxMin = culls[c].boxMin.xyz;\n"
+    "    vec3 boxMax = culls[c].boxMax.xyz;\n"
+    "    // the same sphere and box tests as frustumCull\n"
+    "    for(int p = 0; p<6; p++)\n"
+    "    {\n"
+    "        vec3 corner = mix(boxMin, boxMax, step(0.0, planes[p].xyz));\n"
+    "        if(dot(planes[p].xyz, center) + planes[p].w < -radius || dot(planes[p].xyz, corner) + planes[p].w < 0.0)\n"
+    "            return;\n"
+    "    }\n"
+    "    int level = 0;\n"
+    "    if(maxError > 0.0 && range.y > 1)\n"
+    "    {\n"
+    "        float distance = max(length(center - eye) - radius, nearDistance);\n"
+    "        float pixels = culls[c].boxMin.w * pixelsPerUnit / distance;\n"
+    "        level = range.y - 1;\n"
+    "        while(level > 0 && levels[range.x + level].error * pixels > maxError)\n"
+    "            level--;\n"
+    "    }\n"
+    "    uint slot = uint(range.w) + atomicAdd(drawCounts[range.z], 1u);\n"
+    "    commands[5u * slot] = levels[range.x + level].count;\n"
+    "    commands[5u * slot + 1u] = 1u;\n"
+    "    commands[5u * slot + 2u] = levels[range.x + level].firstIndex;\n"
+    "    commands[5u * slot + 3u] = 0u;\n"
+    "    // the original position stays the draw id\n"
+    "    commands[5u * slot + 4u] = c;\n"
+    "}\n";
+
+bool indirectSupported()
+{
+    return GLEW_VERSION_4_3 != 0;
+}
+
+void buildIndirectScene(const parser::Scene& scene, GLuint vertexBuffer, GLuint normalBuffer)
+{
+    releaseIndirectScene();
+    positionBuffer = vertexBuffer;
+    normalsBuffer = normalBuffer;
+
+    // one index range per distinct face list and level of detail
+    std::vector<int> shapeOwner;
+    std::vector<int> shapes = meshShapes(scene, shapeOwner);
+    std::vector<GLuint> indices;
+    std::vector<int> shapeLevels(shapeOwner.size());
+    int sSize = shapeOwner.size();
+    for(int s = 0; s<sSize; s++)
+    {
+        shapeLevels[s] = levelFirst.size();
+        int lSize = meshLodCount(shapeOwner[s]);
+        for(int l = 0; l<lSize; l++)
+        {
+            const std::vector<parser::Face>& faces = l ? meshLod(shapeOwner[s], l).faces : scene.meshes[shapeOwner[s]].faces;
+            levelFirst.push_back(indices.size());
+            int fSize = faces.size();
+            for(int j = 0; j<fSize; j++)
+            {
+                indices.push_back(faces[j].v0_id - 1);
+                indices.push_back(faces[j].v1_id - 1);
+                indices.push_back(faces[j].v2_id - 1);
+            }
+            levelCount.push_back(indices.size() - levelFirst.back());
+            levelError.push_back(l ? meshLod(shapeOwner[s], l).error : 0.0f);
+        }
+    }
+
+    // commands are ordered by bucket; a command's position is its draw id
+    std::vector<DrawRecord> draws;
+    std::vector<GLfloat> drawIds;
+    int mSize = scene.meshes.size();
+    for(int kind = MESH_SOLID; kind <= MESH_WIREFRAME; kind++)
+    {
+        IndirectBucket bucket;
+        bucket.mesh_kind = (MeshKind)kind;
+        bucket.first_command = commands.size();
+        for(int i = 0; i<mSize; i++)
+        {
+            const parser::Mesh& mesh = scene.meshes[i];
+            if(meshKindOf(mesh) != kind)
+                continue;
+            IndirectCommand command;
+            command.count = levelCount[shapeLevels[shapes[i]]];
+            command.instance_count = 1;
+            command.first_index = levelFirst[shapeLevels[shapes[i]]];
+            command.base_vertex = 0;
+            command.base_instance = commands.size();
+            commands.push_back(command);
+            commandMesh.push_back(i);
+            commandLevels.push_back(shapeLevels[shapes[i]]);
+
+            DrawRecord record;
+            mat4x4 model;
+            meshModelMatrix(scene, mesh, model);
+            for(int c = 0; c<4; c++)
+                for(int r = 0; r<4; r++)
+                    record.model[4 * c + r] = model[c][r];
+            record.material[0] = mesh.material_id - 1;
+            record.material[1] = record.material[2] = record.material[3] = 0;
+            draws.push_back(record);
+            drawIds.push_back((GLfloat)command.base_instance);
+        }
+        bucket.command_count = commands.size() - bucket.first_command;
+        if(bucket.command_count)
+            buckets.push_back(bucket);
+    }
+
+    std::vector<MaterialRecord> materials(scene.materials.size());
+    int matSize = scene.materials.size();
+    for(int i = 0; i<matSize; i++)
+    {
+        const parser::Material& material = scene.materials[i];
+        MaterialRecord& record = materials[i];
+        record.ambient[0] = material.ambient.x;
+        record.ambient[1] = material.ambient.y;
+        record.ambient[2] = material.ambient.z;
+        record.ambient[3] = 1.0f;
+        record.diffuse[0] = material.diffuse.x;
+        record.diffuse[1] = material.diffuse.y;
+        record.diffuse[2] = material.diffuse.z;
+        record.diffuse[3] = 1.0f;
+        record.specular[0] = material.specular.x;
+        record.specular[1] = material.specular.y;
+        record.specular[2] = material.specular.z;
+        record.specular[3] = material.phong_exponent;
+    }
+
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &commandBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(IndirectCommand), commands.empty() ? NULL : &commands[0], GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenBuffers(1, &drawIdBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+    glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(GLfloat), drawIds.empty() ? NULL : &drawIds[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &drawBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, draws.size() * sizeof(DrawRecord), draws.empty() ? NULL : &draws[0], GL_STATIC_DRAW);
+    glGenBuffers(1, &materialBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(MaterialRecord), materials.empty() ? NULL : &materials[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    std::printf("Indirect: %d draws from %d index ranges in %d buckets\n", (int)commands.size(), (int)levelFirst.size(), (int)buckets.size());
+}
+
+void drawIndirectScene(const parser::Scene& scene, const std::vector<unsigned char>* visible,
+    const std::vector<unsigned char>* levels)
+{
+    if(commands.empty())
+        return;
+    CullMode cullMode = cullModeOf(scene);
+
+    if(!gpuCulling && (visible || levels))
+    {
+        // culled meshes keep their command with no instances
+        frameCommands = commands;
+        int cSize = frameCommands.size();
+        for(int c = 0; c<cSize; c++)
+        {
+            if(visible)
+                frameCommands[c].instance_count = (*visible)[commandMesh[c]] ? 1 : 0;
+            if(levels)
+            {
+                int range = commandLevels[c] + (*levels)[commandMesh[c]];
+                frameCommands[c].first_index = levelFirst[range];
+                frameCommands[c].count = levelCount[range];
+            }
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, cSize * sizeof(IndirectCommand), &frameCommands[0]);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(parser::Vec3f), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, normalsBuffer);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glNormalPointer(GL_FLOAT, sizeof(parser::Vec3f), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+    glEnableVertexAttribArray(ATTRIB_DRAW_ID);
+    glVertexAttribPointer(ATTRIB_DRAW_ID, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), 0);
+    glVertexAttribDivisor(ATTRIB_DRAW_ID, 1);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DRAWS, drawBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_MATERIALS, materialBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gpuCulling ? culledCommandBuffer : commandBuffer);
+    if(gpuDrawCount)
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, drawCountBuffer);
+
+    int bSize = buckets.size();
+    for(int b = 0; b<bSize; b++)
+    {
+        const IndirectBucket& bucket = buckets[b];
+        ShaderVariantKey key;
+        key.light_bucket = lightBucket(scene.point_lights.size());
+        key.draw_path = DRAW_INDIRECT;
+        key.depth_only = false;
+        GLuint program = shaderVariant(key);
+        if(!program)
+            continue;
+        glUseProgram(program);
+        applyRasterState(cullMode, bucket.mesh_kind);
+        if(gpuDrawCount)
+            glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT,
+                (const void*)(bucket.first_command * sizeof(IndirectCommand)), b * sizeof(GLuint), bucket.command_count, 0);
+        else
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                (const void*)(bucket.first_command * sizeof(IndirectCommand)), bucket.command_count, 0);
+    }
+    if(gpuDrawCount)
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+
+    glVertexAttribDivisor(ATTRIB_DRAW_ID, 0);
+    glDisableVertexAttribArray(ATTRIB_DRAW_ID);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+}
+
+void releaseIndirectScene()
+{
+    GLuint owned[] = { indexBuffer, commandBuffer, drawIdBuffer, drawBuffer, materialBuffer,
+                       cullBuffer, levelBuffer, culledCommandBuffer, drawCountBuffer, maskBuffer };
+    for(int i = 0; i<10; i++)
+    {
+        if(owned[i])
+            glDeleteBuffers(1, &owned[i]);
+    }
+    indexBuffer = commandBuffer = drawIdBuffer = drawBuffer = materialBuffer = 0;
+    cullBuffer = levelBuffer = culledCommandBuffer = drawCountBuffer = maskBuffer = 0;
+    if(cullProgram)
+        glDeleteProgram(cullProgram);
+    cullProgram = 0;
+    gpuCulling = gpuDrawCount = false;
+    buckets.clear();
+    commands.clear();
+    commandMesh.clear();
+    commandLevels.clear();
+    frameMask.clear();
+    levelFirst.clear();
+    levelCount.clear();
+    levelError.clear();
+}
+
+bool gpuCullingSupported()
+{
+    return GLEW_VERSION_4_3 != 0;
+}
+
+bool initGpuCulling()
+{
+    std::string source = cullSource;
+    char groupSize[64];
+    snprintf(groupSize, sizeof(groupSize), "#define GPU_CULL_GROUP_SIZE %d\n", GPU_CULL_GROUP_SIZE);
+    // the #define has to follow #version
+    source.insert(source.find('\n') + 1, groupSize);
+    cullProgram = buildComputeProgram(source, "Cull");
+    if(!cullProgram)
+        return false;
+
+    const std::vector<Bounds>& local = meshLocalBounds();
+    const std::vector<Bounds>& world = meshWorldBounds();
+    std::vector<CullRecord> culls(commands.size());
+    int bSize = buckets.size();
+    for(int b = 0; b<bSize; b++)
+    {
+        const IndirectBucket& bucket = buckets[b];
+        for(int c = bucket.first_command; c<bucket.first_command + bucket.command_count; c++)
+        {
+            int i = commandMesh[c];
+            CullRecord& record = culls[c];
+            record.sphere[0] = world[i].center.x;
+            record.sphere[1] = world[i].center.y;
+            record.sphere[2] = world[i].center.z;
+            record.sphere[3] = world[i].radius;
+            record.box_min[0] = world[i].min.x;
+            record.box_min[1] = world[i].min.y;
+            record.box_min[2] = world[i].min.z;
+            record.box_min[3] = local[i].radius > 0.0f ? world[i].radius / local[i].radius : 1.0f;
+            record.box_max[0] = world[i].max.x;
+            record.box_max[1] = world[i].max.y;
+            record.box_max[2] = world[i].max.z;
+            record.box_max[3] = 0.0f;
+            record.levels[0] = commandLevels[c];
+            record.levels[1] = meshLodCount(i);
+            record.levels[2] = b;
+            record.levels[3] = bucket.first_command;
+        }
+    }
+    std::vector<LevelRecord> levelRecords(levelFirst.size());
+    int lSize = levelFirst.size();
+    for(int l = 0; l<lSize; l++)
+    {
+        levelRecords[l].first_index = levelFirst[l];
+        levelRecords[l].count = levelCount[l];
+        levelRecords[l].error = levelError[l];
+        levelRecords[l].padding = 0.0f;
+    }
+
+    glGenBuffers(1, &cullBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, culls.size() * sizeof(CullRecord), culls.empty() ? NULL : &culls[0], GL_STATIC_DRAW);
+    glGenBuffers(1, &levelBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, levelBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, levelRecords.size() * sizeof(LevelRecord), levelRecords.empty() ? NULL : &levelRecords[0], GL_STATIC_DRAW);
+    // starts as a copy so slots no dispatch has written yet are valid commands
+    glGenBuffers(1, &culledCommandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, culledCommandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, commands.size() * sizeof(IndirectCommand), commands.empty() ? NULL : &commands[0], GL_DYNAMIC_COPY);
+    glGenBuffers(1, &drawCountBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawCountBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, buckets.size() * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glGenBuffers(1, &maskBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, maskBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, commands.size() * sizeof(GLuint), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    frameMask.resize(commands.size());
+
+    gpuCulling = true;
+    gpuDrawCount = GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
+    std::printf("Indirect: culling %d draws on the GPU%s\n", (int)commands.size(),
+        gpuDrawCount ? ", draw counts from GL_ARB_indirect_parameters" : "");
+    return true;
+}
+
+void gpuCull(const parser::Camera& camera, float lodError, const std::vector<unsigned char>* visible)
+{
+    if(!gpuCulling || commands.empty())
+        return;
+    Frustum frustum;
+    cameraFrustum(camera, frustum);
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawCountBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    if(visible)
+    {
+        int cSize = commands.size();
+        for(int c = 0; c<cSize; c++)
+            frameMask[c] = (*visible)[commandMesh[c]];
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, maskBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, cSize * sizeof(GLuint), &frameMask[0]);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glUseProgram(cullProgram);
+    glUniform4fv(glGetUniformLocation(cullProgram, "planes"), 6, &frustum.planes[0][0]);
+    glUniform3f(glGetUniformLocation(cullProgram, "eye"), camera.position.x, camera.position.y, camera.position.z);
+    glUniform1f(glGetUniformLocation(cullProgram, "pixelsPerUnit"),
+        camera.image_height * camera.near_distance / (camera.near_plane.w - camera.near_plane.z));
+    glUniform1f(glGetUniformLocation(cullProgram, "nearDistance"), camera.near_distance);
+    glUniform1f(glGetUniformLocation(cullProgram, "maxError"), lodError);
+    glUniform1ui(glGetUniformLocation(cullProgram, "commandCount"), commands.size());
+    glUniform1i(glGetUniformLocation(cullProgram, "clearTail"), 0);
+    glUniform1i(glGetUniformLocation(cullProgram, "useMask"), visible ? 1 : 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, cullBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, levelBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, culledCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, drawCountBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, maskBuffer);
+    GLuint groups = (commands.size() + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE;
+    glDispatchCompute(groups, 1, 1);
+    if(!gpuDrawCount)
+    {
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glUniform1i(glGetUniformLocation(cullProgram, "clearTail"), 1);
+        glDispatchCompute(groups, 1, 1);
+    }
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+    glUseProgram(0);
+}
+
+int gpuCulledDraws()
+{
+    if(!gpuCulling || buckets.empty())
+        return 0;
+    std::vector<GLuint> counts(buckets.size());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawCountBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, counts.size() * sizeof(GLuint), &counts[0]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    int drawn = 0;
+    int bSize = counts.size();
+    for(int b = 0; b<bSize; b++)
+        drawn += counts[b];
+    return drawn;
+}
@@ -0,0 +1,92 @@
+#ifndef __HW3__INDIRECT__
+#define __HW3__INDIRECT__
+
+#include <vector>
+#include <GL/glew.h>
+#include "parser.h"
+#include "shaders.h"
+
+// Layout of GL_DRAW_INDIRECT_BUFFER entries for glMultiDrawElementsIndirect
+struct IndirectCommand
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLuint base_vertex;
+    GLuint base_instance;   // doubles as the draw id, see shaders.cpp
+};
+
+// std430 records read by indirect shader variants
+struct DrawRecord
+{
+    GLfloat model[16];
+    GLint material[4];
+};
+
+struct MaterialRecord
+{
+    GLfloat ambient[4];
+    GLfloat diffuse[4];
+    GLfloat specular[4];    // w holds the phong exponent
+};
+
+// Commands that share raster state are contiguous and go out in one call.
+struct IndirectBucket
+{
+    MeshKind mesh_kind;
+    int first_command;
+    int command_count;
+};
+
+// Per-command input of the culling compute shader
+struct CullRecord
+{
+    GLfloat sphere[4];      // world bounds center and radius
+    GLfloat box_min[4];     // w: world radius over object radius, as in selectMeshLods
+    GLfloat box_max[4];
+    GLint levels[4];        // x: first level range, y: level count, z: bucket, w: bucket's first command
+};
+
+// Index range of one level of detail, read by the culling compute shader
+struct LevelRecord
+{
+    GLuint first_index;
+    GLuint count;
+    GLfloat error;
+    GLfloat padding;
+};
+
+// Threads per work group of the culling compute shader
+#define GPU_CULL_GROUP_SIZE 64
+
+bool indirectSupported();
+// Packs every distinct face list and its levels of detail into one index buffer, records one command
+// per mesh and uploads the per-draw storage buffer.
+// vertexBuffer and normalBuffer hold scene.vertex_data and the vertex normals.
+void buildIndirectScene(const parser::Scene& scene, GLuint vertexBuffer, GLuint normalBuffer);
+// visible, when given, holds one flag per mesh; hidden meshes draw no instances.
+// levels, when given, picks the index range of every mesh's level of detail.
+// Both are ignored once initGpuCulling has succeeded.
+void drawIndirectScene(const parser::Scene& scene, const std::vector<unsigned char>* visible,
+    const std::vector<unsigned char>* levels);
+void releaseIndirectScene();
+
+// GPU driven culling: a compute shader tests every command's bounds against
+// the frustum, picks its level of detail and appends the survivors to the
+// bucket's range of a second command buffer, which is what gets drawn. The
+// CPU only uploads the camera. Needs GL 4.3; the number of draws is taken
+// from the GPU with GL_ARB_indirect_parameters when present, otherwise the
+// unused tail of every bucket is cleared by a second dispatch.
+bool gpuCullingSupported();
+// After buildIndirectScene and buildMeshBounds. Returns false when the
+// compute program cannot be built.
+bool initGpuCulling();
+// Per frame, before drawIndirectScene. lodError is the largest projected
+// error in pixels; 0 draws every mesh at full detail. visible, when given,
+// holds the meshes the CPU side passes (--min-pixels, --hiz-cull and
+// --occlusion-cull) left; the others are dropped before the frustum test.
+void gpuCull(const parser::Camera& camera, float lodError, const std::vector<unsigned char>* visible);
+// Commands the last gpuCull kept; reads back from the GPU, so it stalls.
+int gpuCulledDraws();
+
+#endif
@@ -0,0 +1,324 @@
+#include "instancing.h"
+#include "transform.h"
+#include "lod.h"
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+static std::vector<InstanceGroup> groups;
+static GLuint instanceBuffer = 0;
+static GLuint visibleBuffer = 0;
+static GLuint positionBuffer = 0;
+static GLuint normalsBuffer = 0;
+static std::vector<GLfloat> materialUniforms;
+// static per-instance data and the subset rebuilt each culled or LOD frame,
+// ordered by group and then by level
+static std::vector<GLfloat> instanceData;
+static std::vector<GLfloat> frameData;
+static std::vector<int> frameFirst;
+static std::vector<int> frameCount;
+
+static unsigned long long hashFaces(const std::vector<parser::Face>& faces)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    const unsigned char* bytes = faces.empty() ? NULL : (const unsigned char*)&faces[0];
+    size_t size = faces.size() * sizeof(parser::Face);
+    for(size_t i = 0; i<size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool sameFaces(const std::vector<parser::Face>& a, const std::vector<parser::Face>& b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], a.size() * sizeof(parser::Face)) == 0);
+}
+
+bool instancingSupported()
+{
+    return GLEW_VERSION_3_3 || (GLEW_ARB_instanced_arrays && GLEW_ARB_draw_instanced);
+}
+
+const std::vector<InstanceGroup>& instanceGroups()
+{
+    return groups;
+}
+
+std::vector<int> meshShapes(const parser::Scene& scene, std::vector<int>& shapeOwner)
+{
+    int mSize = scene.meshes.size();
+    std::vector<int> shapes(mSize, -1);
+    std::multimap<unsigned long long, int> byHash;
+    for(int i = 0; i<mSize; i++)
+    {
+        const parser::Mesh& mesh = scene.meshes[i];
+        if(mesh.base_mesh_id)
+            continue;
+        unsigned long long hash = hashFaces(mesh.faces);
+        std::pair<std::multimap<unsigned long long, int>::iterator,
+                  std::multimap<unsigned long long, int>::iterator> range = byHash.equal_range(hash);
+        for(std::multimap<unsigned long long, int>::iterator it = range.first; it != range.second; ++it)
+        {
+            if(sameFaces(scene.meshes[shapeOwner[it->second]].faces, mesh.faces))
+            {
+                shapes[i] = it->second;
+                break;
+            }
+        }
+        if(shapes[i] < 0)
+        {
+            shapes[i] = shapeOwner.size();
+            shapeOwner.push_back(i);
+            byHash.insert(std::make_pair(hash, shapes[i]));
+        }
+    }
+    for(int i = 0; i<mSize; i++)
+    {
+        if(scene.meshes[i].base_mesh_id)
+            shapes[i] = shapes[scene.meshes[i].base_mesh_id - 1];
+    }
+    return shapes;
+}
+
+void buildInstanceGroups(const parser::Scene& scene, GLuint vertexBuffer, GLuint normalBuffer)
+{
+    releaseInstanceGroups();
+    positionBuffer = vertexBuffer;
+    normalsBuffer = normalBuffer;
+
+    std::vector<int> shapeOwner;
+    std::vector<int> shapes = meshShapes(scene, shapeOwner);
+
+    // one group per (shape, mesh type)
+    std::map<std::pair<int, int>, int> groupOf;
+    int mSize = scene.meshes.size();
+    for(int i = 0; i<mSize; i++)
+    {
+        MeshKind kind = meshKindOf(scene.meshes[i]);
+        std::pair<int, int> key(shapes[i], kind);
+        std::map<std::pair<int, int>, int>::iterator found = groupOf.find(key);
+        if(found == groupOf.end())
+        {
+            InstanceGroup group;
+            group.mesh_kind = kind;
+            group.index_buffer = 0;
+            group.index_count = 0;
+            group.first_instance = 0;
+            found = groupOf.insert(std::make_pair(key, (int)groups.size())).first;
+            groups.push_back(group);
+        }
+        groups[found->second].meshes.push_back(i);
+    }
+
+    instanceData.clear();
+    std::vector<GLuint> indices;
+    int gSize = groups.size();
+    for(int g = 0; g<gSize; g++)
+    {
+        InstanceGroup& group = groups[g];
+        indices.clear();
+        int lSize = meshLodCount(group.meshes[0]);
+        for(int l = 0; l<lSize; l++)
+        {
+            const std::vector<parser::Face>& faces = l ? meshLod(group.meshes[0], l).faces : scene.meshFaces(scene.meshes[group.meshes[0]]);
+            group.level_first.push_back(indices.size());
+            int fSize = faces.size();
+            for(int j = 0; j<fSize; j++)
+            {
+                indices.push_back(faces[j].v0_id - 1);
+                indices.push_back(faces[j].v1_id - 1);
+                indices.push_back(faces[j].v2_id - 1);
+            }
+            group.level_count.push_back(indices.size() - group.level_first[l]);
+        }
+        group.index_count = group.level_count[0];
+        glGenBuffers(1, &group.index_buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, group.index_buffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+
+        group.first_instance = instanceData.size() / INSTANCE_FLOATS;
+        int iSize = group.meshes.size();
+        for(int k = 0; k<iSize; k++)
+        {
+            const parser::Mesh& mesh = scene.meshes[group.meshes[k]];
+            mat4x4 model;
+            meshModelMatrix(scene, mesh, model);
+            for(int c = 0; c<4; c++)
+                for(int r = 0; r<4; r++)
+                    instanceData.push_back(model[c][r]);
+            int material = mesh.material_id - 1;
+            if(material >= MAX_INSTANCED_MATERIALS)
+                material = MAX_INSTANCED_MATERIALS - 1;
+            instanceData.push_back((GLfloat)material);
+        }
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instanceData.size() * sizeof(GLfloat), instanceData.empty() ? NULL : &instanceData[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    int matSize = scene.materials.size();
+    if(matSize > MAX_INSTANCED_MATERIALS)
+    {
+        fprintf(stderr, "Warning: only the first %d materials are available to instanced draws\n", MAX_INSTANCED_MATERIALS);
+        matSize = MAX_INSTANCED_MATERIALS;
+    }
+    materialUniforms.assign(3 * 4 * MAX_INSTANCED_MATERIALS, 0.0f);
+    for(int i = 0; i<matSize; i++)
+    {
+        const parser::Material& material = scene.materials[i];
+        GLfloat* slot = &materialUniforms[12 * i];
+        slot[0] = material.ambient.x;
+        slot[1] = material.ambient.y;
+        slot[2] = material.ambient.z;
+        slot[4] = material.diffuse.x;
+        slot[5] = material.diffuse.y;
+        slot[6] = material.diffuse.z;
+        slot[8] = material.specular.x;
+        slot[9] = material.specular.y;
+        slot[10] = material.specular.z;
+        slot[11] = material.phong_exponent;
+    }
+
+    int instanced = 0;
+    for(int g = 0; g<gSize; g++)
+        instanced += groups[g].meshes.size() > 1 ? groups[g].meshes.size() : 0;
+    std::printf("Instancing: %d meshes in %d groups, %d of them share a group\n", mSize, gSize, instanced);
+}
+
+static void bindInstanceAttributes(GLuint buffer, int firstInstance)
+{
+    const GLsizei stride = INSTANCE_FLOATS * sizeof(GLfloat);
+    const char* base = (const char*)0 + (size_t)firstInstance * stride;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for(int c = 0; c<4; c++)
+    {
+        glVertexAttribPointer(ATTRIB_INSTANCE_MODEL + c, 4, GL_FLOAT, GL_FALSE, stride, base + c * 4 * sizeof(GLfloat));
+    }
+    glVertexAttribPointer(ATTRIB_INSTANCE_MATERIAL, 1, GL_FLOAT, GL_FALSE, stride, base + 16 * sizeof(GLfloat));
+}
+
+// Copies the instances that survived culling into frameData, sorted by group
+// and level, and streams them into the instance buffer. Range g *
+// LOD_MAX_LEVELS + l of frameFirst/frameCount holds group g at level l.
+static void compactVisibleInstances(const std::vector<unsigned char>* visible, const std::vector<unsigned char>* levels)
+{
+    frameData.clear();
+    int gSize = groups.size();
+    frameFirst.assign(gSize * LOD_MAX_LEVELS, 0);
+    frameCount.assign(gSize * LOD_MAX_LEVELS, 0);
+    for(int g = 0; g<gSize; g++)
+    {
+        const InstanceGroup& group = groups[g];
+        int lSize = group.level_first.size();
+        for(int l = 0; l<lSize; l++)
+        {
+            int range = g * LOD_MAX_LEVELS + l;
+            frameFirst[range] = frameData.size() / INSTANCE_FLOATS;
+            int iSize = group.meshes.size();
+            for(int k = 0; k<iSize; k++)
+            {
+                int mesh = group.meshes[k];
+                if(visible && !(*visible)[mesh])
+                    continue;
+                if((levels ? (*levels)[mesh] : 0) != l)
+                    continue;
+                const GLfloat* instance = &instanceData[(group.first_instance + k) * INSTANCE_FLOATS];
+                frameData.insert(frameData.end(), instance, instance + INSTANCE_FLOATS);
+            }
+            frameCount[range] = frameData.size() / INSTANCE_FLOATS - frameFirst[range];
+        }
+    }
+    if(!visibleBuffer)
+        glGenBuffers(1, &visibleBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, visibleBuffer);
+    // orphan the old storage so the driver need not wait for last frame's draws
+    glBufferData(GL_ARRAY_BUFFER, instanceData.size() * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+    if(!frameData.empty())
+        glBufferSubData(GL_ARRAY_BUFFER, 0, frameData.size() * sizeof(GLfloat), &frameData[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawInstanceGroups(const parser::Scene& scene, const std::vector<unsigned char>* visible,
+    const std::vector<unsigned char>* levels)
+{
+    if(groups.empty())
+        return;
+    CullMode cullMode = cullModeOf(scene);
+    bool compacted = visible || levels;
+    if(compacted)
+        compactVisibleInstances(visible, levels);
+
+    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(parser::Vec3f), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, normalsBuffer);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glNormalPointer(GL_FLOAT, sizeof(parser::Vec3f), 0);
+    for(int a = 0; a<5; a++)
+    {
+        glEnableVertexAttribArray(ATTRIB_INSTANCE_MODEL + a);
+        glVertexAttribDivisor(ATTRIB_INSTANCE_MODEL + a, 1);
+    }
+
+    GLuint bound = 0;
+    int gSize = groups.size();
+    for(int g = 0; g<gSize; g++)
+    {
+        const InstanceGroup& group = groups[g];
+        ShaderVariantKey key = variantKeyFor(scene);
+        key.draw_path = DRAW_INSTANCED;
+        GLuint program = shaderVariant(key);
+        if(!program)
+            continue;
+        int lSize = compacted ? group.level_first.size() : 1;
+        for(int l = 0; l<lSize; l++)
+        {
+            int first = compacted ? frameFirst[g * LOD_MAX_LEVELS + l] : group.first_instance;
+            int count = compacted ? frameCount[g * LOD_MAX_LEVELS + l] : group.meshes.size();
+            if(count == 0)
+                continue;
+            if(program != bound)
+            {
+                glUseProgram(program);
+                glUniform4fv(glGetUniformLocation(program, "materials"), 3 * MAX_INSTANCED_MATERIALS, &materialUniforms[0]);
+                bound = program;
+            }
+            applyRasterState(cullMode, group.mesh_kind);
+            bindInstanceAttributes(compacted ? visibleBuffer : instanceBuffer, first);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, group.index_buffer);
+            glDrawElementsInstanced(GL_TRIANGLES, group.level_count[l], GL_UNSIGNED_INT,
+                (const void*)(group.level_first[l] * sizeof(GLuint)), count);
+        }
+    }
+
+    for(int a = 0; a<5; a++)
+    {
+        glVertexAttribDivisor(ATTRIB_INSTANCE_MODEL + a, 0);
+        glDisableVertexAttribArray(ATTRIB_INSTANCE_MODEL + a);
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+}
+
+void releaseInstanceGroups()
+{
+    int gSize = groups.size();
+    for(int g = 0; g<gSize; g++)
+    {
+        glDeleteBuffers(1, &groups[g].index_buffer);
+    }
+    groups.clear();
+    if(instanceBuffer)
+        glDeleteBuffers(1, &instanceBuffer);
+    if(visibleBuffer)
+        glDeleteBuffers(1, &visibleBuffer);
+    instanceBuffer = visibleBuffer = 0;
+}
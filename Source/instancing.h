@@ -0,0 +1,42 @@
+#ifndef __HW3__INSTANCING__
+#define __HW3__INSTANCING__
+
+#include <vector>
+#include <GL/glew.h>
+#include "parser.h"
+#include "shaders.h"
+
+// Meshes with the same face list and mesh type differ only in their
+// transformations and material, so each such group is drawn with a single
+// glDrawElementsInstanced call.
+struct InstanceGroup
+{
+    MeshKind mesh_kind;
+    std::vector<int> meshes;    // indices into scene.meshes
+    GLuint index_buffer;
+    int index_count;
+    // index ranges of the group's levels of detail in index_buffer
+    std::vector<int> level_first;
+    std::vector<int> level_count;
+    int first_instance;         // offset of the group in the instance buffer
+};
+
+// Floats per instance: a column major model matrix and the material index.
+#define INSTANCE_FLOATS 17
+
+bool instancingSupported();
+// Every mesh gets a shape id; meshes share one when their face lists are equal.
+// Instances inherit the shape of their base mesh without hashing their faces.
+// shapeOwner receives the first mesh of every shape.
+std::vector<int> meshShapes(const parser::Scene& scene, std::vector<int>& shapeOwner);
+// Groups the scene's meshes and uploads index and per-instance buffers.
+// vertexBuffer and normalBuffer hold scene.vertex_data and the vertex normals.
+void buildInstanceGroups(const parser::Scene& scene, GLuint vertexBuffer, GLuint normalBuffer);
+// visible, when given, holds one flag per mesh; hidden instances are left out.
+// levels, when given, holds the level of detail of every mesh.
+void drawInstanceGroups(const parser::Scene& scene, const std::vector<unsigned char>* visible,
+    const std::vector<unsigned char>* levels);
+void releaseInstanceGroups();
+const std::vector<InstanceGroup>& instanceGroups();
+
+#endif
@@ -0,0 +1,382 @@
+#include "lod.h"
+#include "culling.h"
+#include "instancing.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <queue>
+
+// Symmetric 4x4 quadric: a00 a01 a02 a03 a11 a12 a13 a22 a23 a33
+struct Quadric
+{
+    double a[10];
+};
+
+struct Collapse
+{
+    double cost;
+    int from, to;
+    unsigned from_stamp, to_stamp;
+
+    bool operator>(const Collapse& other) const
+    {
+        return cost > other.cost;
+    }
+};
+
+static std::vector<std::vector<LodLevel> > shapeLods;
+static std::vector<int> meshShape;
+
+static void addPlane(Quadric& q, double nx, double ny, double nz, double d)
+{
+    q.a[0] += nx*nx; q.a[1] += nx*ny; q.a[2] += nx*nz; q.a[3] += nx*d;
+    q.a[4] += ny*ny; q.a[5] += ny*nz; q.a[6] += ny*d;
+    q.a[7] += nz*nz; q.a[8] += nz*d;
+    q.a[9] += d*d;
+}
+
+static double evaluate(const Quadric& q, const Quadric& r, const parser::Vec3f& v)
+{
+    double a[10];
+    for(int k = 0; k<10; k++)
+        a[k] = q.a[k] + r.a[k];
+    double x = v.x, y = v.y, z = v.z;
+    double cost = a[0]*x*x + 2*a[1]*x*y + 2*a[2]*x*z + 2*a[3]*x
+                + a[4]*y*y + 2*a[5]*y*z + 2*a[6]*y
+                + a[7]*z*z + 2*a[8]*z
+                + a[9];
+    return cost > 0.0 ? cost : 0.0;
+}
+
+static parser::Vec3f faceNormal(const parser::Vec3f& p0, const parser::Vec3f& p1, const parser::Vec3f& p2)
+{
+    parser::Vec3f a = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+    parser::Vec3f b = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+    parser::Vec3f n = { a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x };
+    return n;
+}
+
+// Progressive half-edge collapse (Garland and Heckbert) over one face list.
+class Simplifier
+{
+public:
+    Simplifier(const parser::Scene& scene, const std::vector<parser::Face>& faces)
+    {
+        std::map<int, int> localOf;
+        int fSize = faces.size();
+        tris.resize(3 * fSize);
+        for(int j = 0; j<fSize; j++)
+        {
+            const int ids[3] = { faces[j].v0_id, faces[j].v1_id, faces[j].v2_id };
+            for(int k = 0; k<3; k++)
+            {
+                std::map<int, int>::iterator found = localOf.find(ids[k]);
+                if(found == localOf.end())
+                {
+                    found = localOf.insert(std::make_pair(ids[k], (int)globalId.size())).first;
+                    globalId.push_back(ids[k]);
+                    positions.push_back(scene.vertex_data[ids[k] - 1]);
+                }
+                tris[3 * j + k] = found->second;
+            }
+        }
+        int vSize = globalId.size();
+        Quadric zero = { { 0 } };
+        quadrics.assign(vSize, zero);
+        vertexFaces.resize(vSize);
+        stamps.assign(vSize, 0);
+        alive.assign(vSize, 1);
+        faceAlive.assign(fSize, 1);
+        liveFaces = fSize;
+        maxCost = 0.0;
+
+        // plane of every face, plus a plane through each border edge at right
+        // angles to its face so open borders do not shrink
+        std::map<std::pair<int, int>, int> edgeUses;
+        for(int j = 0; j<fSize; j++)
+        {
+            const int* t = &tris[3 * j];
+            for(int k = 0; k<3; k++)
+            {
+                vertexFaces[t[k]].push_back(j);
+                std::pair<int, int> edge(std::min(t[k], t[(k + 1) % 3]), std::max(t[k], t[(k + 1) % 3]));
+                edgeUses[edge]++;
+            }
+        }
+        for(int j = 0; j<fSize; j++)
+        {
+            const int* t = &tris[3 * j];
+            parser::Vec3f n = faceNormal(positions[t[0]], positions[t[1]], positions[t[2]]);
+            double len = sqrt((double)n.x*n.x + (double)n.y*n.y + (double)n.z*n.z);
+            if(len == 0.0)
+                continue;
+            double nx = n.x / len, ny = n.y / len, nz = n.z / len;
+            const parser::Vec3f& p = positions[t[0]];
+            Quadric q = zero;
+            addPlane(q, nx, ny, nz, -(nx*p.x + ny*p.y + nz*p.z));
+            for(int k = 0; k<3; k++)
+            {
+                int a = t[k], b = t[(k + 1) % 3];
+                if(edgeUses[std::make_pair(std::min(a, b), std::max(a, b))] == 1)
+                {
+                    const parser::Vec3f& pa = positions[a];
+                    const parser::Vec3f& pb = positions[b];
+                    double ex = pb.x - pa.x, ey = pb.y - pa.y, ez = pb.z - pa.z;
+                    double bx = ey*nz - ez*ny, by = ez*nx - ex*nz, bz = ex*ny - ey*nx;
+                    double blen = sqrt(bx*bx + by*by + bz*bz);
+                    if(blen > 0.0)
+                    {
+                        bx /= blen; by /= blen; bz /= blen;
+                        Quadric border = zero;
+                        addPlane(border, bx, by, bz, -(bx*pa.x + by*pa.y + bz*pa.z));
+                        for(int m = 0; m<10; m++)
+                        {
+                            quadrics[a].a[m] += border.a[m];
+                            quadrics[b].a[m] += border.a[m];
+                        }
+                    }
+                }
+                for(int m = 0; m<10; m++)
+                    quadrics[t[k]].a[m] += q.a[m];
+            }
+        }
+        for(std::map<std::pair<int, int>, int>::iterator it = edgeUses.begin(); it != edgeUses.end(); ++it)
+            pushEdge(it->first.first, it->first.second);
+    }
+
+    int faceCount() const
+    {
+        return liveFaces;
+    }
+
+    // Collapses the cheapest edges until at most target faces remain or no
+    // collapse is left that keeps every face facing the same way.
+    void simplify(int target)
+    {
+        while(liveFaces > target && !heap.empty())
+        {
+            Collapse c = heap.top();
+            heap.pop();
+            if(!alive[c.from] || !alive[c.to] || stamps[c.from] != c.from_stamp || stamps[c.to] != c.to_stamp)
+                continue;
+            if(flips(c.from, c.to))
+                continue;
+            collapse(c.from, c.to);
+            maxCost = std::max(maxCost, c.cost);
+        }
+    }
+
+    LodLevel level() const
+    {
+        LodLevel lod;
+        int fSize = faceAlive.size();
+        for(int j = 0; j<fSize; j++)
+        {
+            if(!faceAlive[j])
+                continue;
+            parser::Face face;
+            face.v0_id = globalId[tris[3 * j]];
+            face.v1_id = globalId[tris[3 * j + 1]];
+            face.v2_id = globalId[tris[3 * j + 2]];
+            lod.faces.push_back(face);
+        }
+        lod.error = (float)sqrt(maxCost);
+        return lod;
+    }
+
+private:
+    std::vector<int> globalId;
+    std::vector<parser::Vec3f> positions;
+    std::vector<int> tris;
+    std::vector<Quadric> quadrics;
+    std::vector<std::vector<int> > vertexFaces;
+    std::vector<unsigned> stamps;
+    std::vector<unsigned char> alive;
+    std::vector<unsigned char> faceAlive;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > heap;
+    int liveFaces;
+    double maxCost;
+
+    // pushes the cheaper direction of the edge
+    void pushEdge(int a, int b)
+    {
+        double toB = evaluate(quadrics[a], quadrics[b], positions[b]);
+        double toA = evaluate(quadrics[a], quadrics[b], positions[a]);
+        Collapse c;
+        c.cost = toB <= toA ? toB : toA;
+        c.from = toB <= toA ? a : b;
+        c.to = toB <= toA ? b : a;
+        c.from_stamp = stamps[c.from];
+        c.to_stamp = stamps[c.to];
+        heap.push(c);
+    }
+
+    bool flips(int from, int to) const
+    {
+        const std::vector<int>& around = vertexFaces[from];
+        int aSize = around.size();
+        for(int i = 0; i<aSize; i++)
+        {
+            int f = around[i];
+            if(!faceAlive[f])
+                continue;
+            const int* t = &tris[3 * f];
+            if(t[0] == to || t[1] == to || t[2] == to)
+                continue;
+            parser::Vec3f p[3];
+            for(int k = 0; k<3; k++)
+                p[k] = positions[t[k]];
+            parser::Vec3f before = faceNormal(p[0], p[1], p[2]);
+            for(int k = 0; k<3; k++)
+            {
+                if(t[k] == from)
+                    p[k] = positions[to];
+            }
+            parser::Vec3f after = faceNormal(p[0], p[1], p[2]);
+            bool degenerate = before.x == 0.0f && before.y == 0.0f && before.z == 0.0f;
+            if(!degenerate && before.x*after.x + before.y*after.y + before.z*after.z <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+
+    void collapse(int from, int to)
+    {
+        std::vector<int>& around = vertexFaces[from];
+        int aSize = around.size();
+        for(int i = 0; i<aSize; i++)
+        {
+            int f = around[i];
+            if(!faceAlive[f])
+                continue;
+            int* t = &tris[3 * f];
+            if(t[0] == to || t[1] == to || t[2] == to)
+            {
+                faceAlive[f] = 0;
+                liveFaces--;
+                continue;
+            }
+            for(int k = 0; k<3; k++)
+            {
+                if(t[k] == from)
+                    t[k] = to;
+            }
+            vertexFaces[to].push_back(f);
+        }
+        around.clear();
+        for(int m = 0; m<10; m++)
+            quadrics[to].a[m] += quadrics[from].a[m];
+        alive[from] = 0;
+        stamps[to]++;
+
+        // the quadric of to changed, so every edge around it gets a new entry
+        std::vector<int> neighbours;
+        std::vector<int>& faces = vertexFaces[to];
+        int live = 0;
+        int fSize = faces.size();
+        for(int i = 0; i<fSize; i++)
+        {
+            int f = faces[i];
+            if(!faceAlive[f])
+                continue;
+            faces[live++] = f;
+            for(int k = 0; k<3; k++)
+            {
+                if(tris[3 * f + k] != to)
+                    neighbours.push_back(tris[3 * f + k]);
+            }
+        }
+        faces.resize(live);
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        int nSize = neighbours.size();
+        for(int i = 0; i<nSize; i++)
+            pushEdge(neighbours[i], to);
+    }
+};
+
+void buildMeshLods(const parser::Scene& scene)
+{
+    std::vector<int> shapeOwner;
+    meshShape = meshShapes(scene, shapeOwner);
+    int sSize = shapeOwner.size();
+    shapeLods.assign(sSize, std::vector<LodLevel>());
+    int simplified = 0;
+    for(int s = 0; s<sSize; s++)
+    {
+        const std::vector<parser::Face>& faces = scene.meshes[shapeOwner[s]].faces;
+        LodLevel full;
+        full.faces = faces;
+        full.error = 0.0f;
+        shapeLods[s].push_back(full);
+        if((int)faces.size() < LOD_MIN_FACES)
+            continue;
+
+        Simplifier simplifier(scene, faces);
+        for(int l = 1; l<LOD_MAX_LEVELS; l++)
+        {
+            int previous = shapeLods[s].back().faces.size();
+            simplifier.simplify(previous / 2);
+            // stop once collapses no longer pay for another level
+            if(simplifier.faceCount() > previous * 3 / 4)
+                break;
+            shapeLods[s].push_back(simplifier.level());
+        }
+        simplified++;
+        std::printf("LOD: mesh %d:", shapeOwner[s] + 1);
+        int lSize = shapeLods[s].size();
+        for(int l = 0; l<lSize; l++)
+            std::printf(" %d tris (error %g)%s", (int)shapeLods[s][l].faces.size(), shapeLods[s][l].error, l + 1 < lSize ? "," : "\n");
+    }
+    std::printf("LOD: %d of %d face lists simplified\n", simplified, sSize);
+}
+
+int meshLodCount(int mesh)
+{
+    if(meshShape.empty())
+        return 1;
+    return shapeLods[meshShape[mesh]].size();
+}
+
+const LodLevel& meshLod(int mesh, int level)
+{
+    return shapeLods[meshShape[mesh]][level];
+}
+
+LodStats selectMeshLods(const parser::Camera& camera, float maxPixels,
+    const std::vector<unsigned char>* visible, std::vector<unsigned char>& level)
+{
+    LodStats stats = { 0, 0 };
+    const std::vector<Bounds>& local = meshLocalBounds();
+    const std::vector<Bounds>& world = meshWorldBounds();
+    // pixels covered by one world unit at distance 1
+    float pixelsPerUnit = camera.image_height * camera.near_distance / (camera.near_plane.w - camera.near_plane.z);
+    int mSize = world.size();
+    level.assign(mSize, 0);
+    for(int i = 0; i<mSize; i++)
+    {
+        const std::vector<LodLevel>& lods = shapeLods[meshShape[i]];
+        int lSize = lods.size();
+        if(lSize > 1)
+        {
+            const Bounds& b = world[i];
+            float dx = b.center.x - camera.position.x;
+            float dy = b.center.y - camera.position.y;
+            float dz = b.center.z - camera.position.z;
+            float distance = fmaxf(sqrtf(dx*dx + dy*dy + dz*dz) - b.radius, camera.near_distance);
+            // transformBounds scales the sphere by the largest axis scale
+            float scale = local[i].radius > 0.0f ? b.radius / local[i].radius : 1.0f;
+            float pixels = scale * pixelsPerUnit / distance;
+            int l = lSize - 1;
+            while(l > 0 && lods[l].error * pixels > maxPixels)
+                l--;
+            level[i] = l;
+        }
+        if(visible && !(*visible)[i])
+            continue;
+        stats.triangles += lods[level[i]].faces.size();
+        stats.reduced += level[i] > 0;
+    }
+    return stats;
+}
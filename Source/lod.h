@@ -0,0 +1,41 @@
+#ifndef __HW3__LOD__
+#define __HW3__LOD__
+
+#include <vector>
+#include "parser.h"
+
+// Level 0 is the mesh as loaded; every further level keeps about half the
+// triangles of the previous one.
+#define LOD_MAX_LEVELS 5
+// Meshes with fewer faces are always drawn at full detail.
+#define LOD_MIN_FACES 256
+
+// A simplified face list. Quadric edge collapses only move a vertex onto one
+// of its neighbours, so the faces still refer to scene.vertex_data and the
+// vertex normals computed for the full mesh.
+struct LodLevel
+{
+    std::vector<parser::Face> faces;
+    float error;    // object space deviation bound of this level
+};
+
+struct LodStats
+{
+    int triangles;  // triangles of the levels that were picked
+    int reduced;    // meshes drawn below full detail
+};
+
+// Load time: simplifies every distinct face list once; instances and meshes
+// sharing a face list share its levels. Needs buildMeshBounds for selection.
+void buildMeshLods(const parser::Scene& scene);
+// 1 until buildMeshLods has run
+int meshLodCount(int mesh);
+const LodLevel& meshLod(int mesh, int level);
+
+// Per frame: level[i] is the coarsest level of mesh i whose error, projected
+// through the camera at the mesh's nearest point, stays within maxPixels.
+// Meshes that visible marks hidden are left out of the stats.
+LodStats selectMeshLods(const parser::Camera& camera, float maxPixels,
+    const std::vector<unsigned char>* visible, std::vector<unsigned char>& level);
+
+#endif
@@ -1,412 +1,1343 @@
-#include <iostream>
-#include <chrono>
-#include <string.h>
-#include "parser.h"
-#include <sstream>
-#include <cstdio>
-#include <iomanip>
-#include <cstdlib>
-#include <cstring>
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
-
-//////-------- Global Variables -------/////////
-GLuint gpuVertexBuffer;
-GLuint gpuNormalBuffer;
-GLuint gpuIndexBuffer;
-char gRendererInfo[512] = { 0 };
-char gWindowTitle[512] = { 0 };
-static bool fulscreen = 0;
-// never free a pointer that GL library returns 
-// they are automatically handled 
-
-// Sample usage for reading an XML scene file
-parser::Scene scene;
-static GLFWwindow* win = NULL;
-int width, height;
-std::vector<parser::Vec3f> normals;
-
-static void errorCallback(int error, const char* description) {
-    fprintf(stderr, "Error: %s\n", description);
-}
-
-static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-    GLFWmonitor * _monitor = glfwGetPrimaryMonitor();
-    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, GLFW_TRUE);
-    
-    // if (key == GLFW_KEY_F && action == GLFW_PRESS)
-    // {
-    //     fulscreen = 1;   
-    //     const GLFWvidmode * mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
-    //     //glfwSetWindowSize(win, mode->width, mode->height);
-    //     glfwMaximizeWindow(win);
-
-    // }
-    // if (key == GLFW_KEY_E && action == GLFW_PRESS)
-    // {
-    //     fulscreen = 0;
-    //     glfwSetWindowSize(win, scene.camera.image_width, scene.camera.image_height);
-    // }
-}
-
-void cameraInit()
-{
-    parser::Camera camera = scene.camera;
-    // camera settings
-    // viewport
-    glViewport(0, 0, camera.image_width, camera.image_height);
-    glMatrixMode(GL_MODELVIEW);
-    /* Set camera position */
-    glLoadIdentity();
-    gluLookAt(camera.position.x, camera.position.y, camera.position.z,
-    (camera.gaze.x * camera.near_distance + camera.position.x),
-    (camera.gaze.y * camera.near_distance + camera.position.y),
-    (camera.gaze.z * camera.near_distance + camera.position.z),
-    camera.up.x, camera.up.y, camera.up.z);
-    /* Set projection frustrum */
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    // gluPerspective((GLdouble) 30, (GLdouble) (camera.near_plane.y - camera.near_plane.x) / (camera.near_plane.w - camera.near_plane.z), (GLdouble) camera.near_distance, (GLdouble) camera.far_distance);
-    glFrustum(camera.near_plane.x, camera.near_plane.y, camera.near_plane.z, camera.near_plane.w, 
-    camera.near_distance, camera.far_distance);
-}
-
-void turnOn()
-{
-    GLfloat ambient[] = {scene.ambient_light.x, scene.ambient_light.y, scene.ambient_light.z, 1.0f};
-    // turnOn lights
-    int lSize = scene.point_lights.size();
-    for(int i = 0; i<lSize; i++)
-    {
-        parser::PointLight pointLight = scene.point_lights[i];
-
-        GLfloat color[] = {pointLight.intensity.x, pointLight.intensity.y, pointLight.intensity.z, 1.0f};
-        GLfloat position[] = {pointLight.position.x, pointLight.position.y, pointLight.position.z, 1.0f};
-        glLightfv(GL_LIGHT0+i, GL_POSITION, position);
-        glLightfv(GL_LIGHT0+i, GL_AMBIENT, ambient);
-        glLightfv(GL_LIGHT0+i, GL_DIFFUSE, color);
-        glLightfv(GL_LIGHT0+i, GL_SPECULAR, color);
-    }
-}
-
-void calculateNormals()
-{
-    int vSize = scene.vertex_data.size();
-    for(int i = 0; i<vSize; i++)
-    {
-        parser::Vec3f temp;
-        temp.x = 0.0f;
-        temp.y = 0.0f;
-        temp.z = 0.0f;
-        normals.push_back(temp);
-    }
-
-    int mSize = scene.meshes.size();
-    for(int i = 0; i<mSize; i++)
-    {
-        parser::Mesh mesh = scene.meshes[i];
-        int fSize = mesh.faces.size();
-        for(int j = 0; j<fSize; j++)
-        {
-            parser::Face face = mesh.faces[j];
-            // vertex0
-            parser::Vec3f vertex0 = scene.vertex_data[face.v0_id-1];
-            // vertex1
-            parser::Vec3f vertex1 = scene.vertex_data[face.v1_id-1];
-            // vertex2
-            parser::Vec3f vertex2 = scene.vertex_data[face.v2_id-1];
-            
-            parser::Vec3f normal0;
-            parser::Vec3f normal1;
-            parser::Vec3f normal2;
-            parser::Vec3f b;
-            parser::Vec3f a;
-            // normal0
-            a.x = vertex1.x - vertex0.x;
-            a.y = vertex1.y - vertex0.y;
-            a.z = vertex1.z - vertex0.z;
-            b.x = vertex2.x - vertex0.x;
-            b.y = vertex2.y - vertex0.y;
-            b.z = vertex2.z - vertex0.z;
-            normal0.x = a.y*b.z - a.z*b.y;
-            normal0.y = a.z*b.x - a.x*b.z;
-            normal0.z = a.x*b.y - a.y*b.x;
-            normals[face.v0_id-1].x += normal0.x;
-            normals[face.v0_id-1].y += normal0.y;
-            normals[face.v0_id-1].z += normal0.z;
-            // normal1
-            a.x = vertex2.x - vertex1.x;
-            a.y = vertex2.y - vertex1.y;
-            a.z = vertex2.z - vertex1.z;
-            b.x = vertex0.x - vertex1.x;
-            b.y = vertex0.y - vertex1.y;
-            b.z = vertex0.z - vertex1.z;
-            normal1.x = a.y*b.z - a.z*b.y;
-            normal1.y = a.z*b.x - a.x*b.z;
-            normal1.z = a.x*b.y - a.y*b.x;
-            normals[face.v1_id-1].x += normal1.x;
-            normals[face.v1_id-1].y += normal1.y;
-            normals[face.v1_id-1].z += normal1.z;
-            // normal2
-            a.x = vertex0.x - vertex2.x;
-            a.y = vertex0.y - vertex2.y;
-            a.z = vertex0.z - vertex2.z;
-            b.x = vertex1.x - vertex2.x;
-            b.y = vertex1.y - vertex2.y;
-            b.z = vertex1.z - vertex2.z;
-            normal2.x = a.y*b.z - a.z*b.y;
-            normal2.y = a.z*b.x - a.x*b.z;
-            normal2.z = a.x*b.y - a.y*b.x;
-            normals[face.v2_id-1].x += normal2.x;
-            normals[face.v2_id-1].y += normal2.y;
-            normals[face.v2_id-1].z += normal2.z;
-        }
-    }
-//     for(int i = 0; i<vSize; i++)
-//     {
-//         float len = sqrtf(normals[i].x*normals[i].x+ normals[i].y*normals[i].y + normals[i].z + normals[i].z);
-//         normals[i].x /= len;
-//         normals[i].y /= len;
-//         normals[i].z /= len;
-//     }
-}
-
-void drawMeshes()
-{
-    static int framesRendered = 0;
-	static std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
-
-    glClearColor(0, 0, 0, 1);
-	glClearDepth(1.0f);
-	glClearStencil(0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
-    glShadeModel(GL_SMOOTH);
-    glMatrixMode(GL_MODELVIEW);
-    glEnable(GL_NORMALIZE);
-    int mSize = scene.meshes.size();
-    for(int i = 0; i<mSize; i++)
-    {
-        parser::Mesh mesh = scene.meshes[i];
-        parser::Material material = scene.materials[mesh.material_id-1];
-
-        GLfloat ambientColor[] = {material.ambient.x, material.ambient.y, material.ambient.z, 1.0f};
-        GLfloat diffuseColor[] = {material.diffuse.x, material.diffuse.y, material.diffuse.z, 1.0f};
-        GLfloat specularColor[] = {material.specular.x, material.specular.y, material.specular.z, 1.0f};
-        GLfloat phongExponent[] = {material.phong_exponent};
-
-        // transformations
-        glPushMatrix();
-        int tSize = mesh.transformations.size();
-        for(int j = tSize - 1; j>=0; j--)
-        {
-            parser::Transformation transformation = mesh.transformations[j];
-            // translation
-            if(transformation.transformation_type == "Translation")
-            {
-                parser::Vec3f translate = scene.translations[transformation.id - 1];
-                glTranslatef(translate.x, translate.y, translate.z);
-            }
-            // rotation
-            if(transformation.transformation_type == "Rotation")
-            {
-                parser::Vec4f rotation = scene.rotations[transformation.id - 1];
-                glRotatef(rotation.x, rotation.y, rotation.z, rotation.w);
-            }
-            //scaling
-            if(transformation.transformation_type == "Scaling")
-            {
-                parser::Vec3f scaling = scene.scalings[transformation.id - 1];
-                glScalef(scaling.x, scaling.y, scaling.z);
-            }
-        }
-        int fSize = mesh.faces.size();
-        for(int j = 0; j<fSize; j++)
-        {
-            // polygon mode
-            if(scene.culling_enabled)
-            {
-                glEnable(GL_CULL_FACE);
-                glFrontFace(GL_CCW);
-                if(scene.culling_face)
-                {
-                    glCullFace(GL_FRONT);
-                    if(mesh.mesh_type == "Solid")
-                    {
-                        glPolygonMode(GL_BACK, GL_FILL);
-                    }
-                    else if(mesh.mesh_type == "Wireframe")
-                    {
-                        glPolygonMode(GL_BACK, GL_LINE);
-                    }
-                }
-                else if(!scene.culling_face)
-                {
-                    glCullFace(GL_BACK);
-                    glFrontFace(GL_CCW);
-                    if(mesh.mesh_type == "Solid")
-                    {
-                        glPolygonMode(GL_FRONT, GL_FILL);
-                    }
-                    else if(mesh.mesh_type == "Wireframe")
-                    {
-                        glPolygonMode(GL_FRONT, GL_LINE);
-                    }
-                }
-            }
-            else if(!scene.culling_enabled)
-            {
-                glDisable(GL_CULL_FACE);
-                glFrontFace(GL_CCW);
-                if(mesh.mesh_type == "Solid")
-                {
-                    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-                }
-                else if(mesh.mesh_type == "Wireframe")
-                {
-                    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-                }
-            }
-
-
-            // material colors
-            glMaterialfv(GL_FRONT, GL_AMBIENT, ambientColor);
-            glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuseColor); 
-            glMaterialfv(GL_FRONT, GL_SPECULAR, specularColor);
-            glMaterialfv(GL_FRONT, GL_SHININESS, phongExponent);
-            
-            // faces and begin gl_triangles
-            glBegin(GL_TRIANGLES);
-
-            parser::Face face = mesh.faces[j];
-            parser::Vec3f vertex0;
-            parser::Vec3f vertex1;
-            parser::Vec3f vertex2;
-            parser::Vec3f normal0;
-            parser::Vec3f normal1;
-            parser::Vec3f normal2;
-            parser::Vec3f b;
-            parser::Vec3f a;
-
-            vertex0 = scene.vertex_data[face.v0_id - 1];
-            vertex1 = scene.vertex_data[face.v1_id - 1];
-            vertex2 = scene.vertex_data[face.v2_id - 1];
-            normal0 = normals[face.v0_id - 1];
-            normal1 = normals[face.v1_id - 1];
-            normal2 = normals[face.v2_id - 1];
-            // vertex0
-            glNormal3f(normal0.x, normal0.y, normal0.z);
-            glVertex3f(vertex0.x, vertex0.y, vertex0.z);
-            
-            // vertex1
-            glNormal3f(normal1.x, normal1.y, normal1.z);
-            glVertex3f(vertex1.x, vertex1.y, vertex1.z);
-            
-            // vertex2
-            glNormal3f(normal2.x, normal2.y, normal2.z);
-            glVertex3f(vertex2.x, vertex2.y, vertex2.z);
-
-            glEnd();
-        }
-        glPopMatrix();
-    }
-    ++framesRendered;
-
-	std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
-
-	std::chrono::duration<double> elapsedTime = end - start;
-	if (elapsedTime.count() >= 1.)
-	{
-		start = std::chrono::system_clock::now();
-
-		std::stringstream stream;
-		stream << std::setprecision(3)<<(framesRendered/elapsedTime.count());
-		framesRendered = 0;
-        
-		strcpy(gWindowTitle, gRendererInfo);
-		strcat(gWindowTitle, "[");
-		strcat(gWindowTitle, stream.str().c_str());
-		strcat(gWindowTitle, " FPS]");
-
-		glfwSetWindowTitle(win, gWindowTitle);
-	}
-}
-
-int main(int argc, char* argv[]) {
-    scene.loadFromXml(argv[1]);
-    float len = sqrtf(scene.camera.gaze.x*scene.camera.gaze.x + scene.camera.gaze.y*scene.camera.gaze.y + scene.camera.gaze.z*scene.camera.gaze.z);
-    if (len == 0.0f)
-        len = 1.0f;
-    scene.camera.gaze.x /= len;
-    scene.camera.gaze.y /= len;
-    scene.camera.gaze.z /= len;
-    glfwSetErrorCallback(errorCallback);
-    if (!glfwInit()) {
-        std::cout << "Failed to initialize GLFW\n" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-
-    win = glfwCreateWindow(scene.camera.image_width, scene.camera.image_height, "CENG477 - HW3", NULL, NULL);
-
-    if (!win) {
-        // if some error occured exit
-        std::cout << "Failed to open GLFW window.\n" << std::endl;
-        glfwTerminate();
-        exit(EXIT_FAILURE);
-    }
-
-    glfwMakeContextCurrent(win);
-
-    GLenum err = glewInit();
-    if (err != GLEW_OK) {
-        fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
-            exit(EXIT_FAILURE);
-    }
-
-    glfwSetKeyCallback(win, keyCallback);
-    glClearColor(scene.background_color.x, scene.background_color.y, scene.background_color.z, 1);
-    strcpy(gRendererInfo, "CENG477 - HW3");
-
-    glfwSetWindowTitle(win, gRendererInfo);
-
-    glEnable(GL_LIGHTING);
-    glShadeModel(GL_SMOOTH);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_DEPTH);
-
-    // initialize camera and scene
-
-    // set camera 
-    // read scene into buffers
-    // do lights
-    // draw
-    calculateNormals();
-    // enable lights
-    int lSize = scene.point_lights.size();
-    for(int i = 0; i<lSize; i++)
-    {
-        glEnable(GL_LIGHT0+i);
-    }
-    // instead of waitEvents use pollEvents
-    turnOn();
-    while(!glfwWindowShouldClose(win)) {
-        cameraInit();
-        drawMeshes();
-        glfwSwapBuffers(win);
-        glfwPollEvents();
-    }
-
-    // destroys the window created at the beginning
-    glfwDestroyWindow(win);
-
-    // library termination 
-    glfwTerminate();
-
-    exit(EXIT_SUCCESS);
-
-    return 0;
-}
+#include <iostream>
+#include <chrono>
+#include <string.h>
+#include "parser.h"
+#include "options.h"
+#include "shaders.h"
+#include "instancing.h"
+#include "indirect.h"
+#include "culling.h"
+#include "lod.h"
+#include "meshopt.h"
+#include "overdraw.h"
+#include "occlusion.h"
+#include "hiz.h"
+#include "threadpool.h"
+#include "resolution.h"
+#include "headless.h"
+#include "image.h"
+#include "software.h"
+#include "vertexkernels.h"
+#include "raytracer.h"
+#include "capture.h"
+#include "distributed.h"
+#include "scenecache.h"
+#include "transform.h"
+#include "batch.h"
+#include <sstream>
+#include <cstdio>
+#include <cfloat>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+//////-------- Global Variables -------/////////
+GLuint gpuVertexBuffer;
+GLuint gpuNormalBuffer;
+GLuint gpuIndexBuffer;
+char gRendererInfo[512] = { 0 };
+char gWindowTitle[512] = { 0 };
+static bool fulscreen = 0;
+// never free a pointer that GL library returns 
+// they are automatically handled 
+
+// Sample usage for reading an XML scene file
+parser::Scene scene;
+static GLFWwindow* win = NULL;
+int width, height;
+std::vector<parser::Vec3f> normals;
+std::vector<unsigned char> meshVisible;
+CullStats cullStats = { 0, 0 };
+std::vector<int> meshImpostors;
+SmallObjectStats smallStats = { 0, 0 };
+std::vector<unsigned char> meshUnoccluded;
+OcclusionStats occlusionStats = { 0, 0 };
+HiZStats hizStats = { 0, 0, 0 };
+std::vector<unsigned char> meshLevels;
+LodStats lodStats = { 0, 0 };
+OverdrawStats overdrawStats = { 0, 0, 0.0f };
+ResolutionStats resolutionStats = { 0, 0, 0.0f };
+bool prepassActive = false;
+// side of the tiles a headless poster is drawn in, 0 when it is drawn whole
+int posterTile = 0;
+int framesDrawn = 0;
+// set by input, resizes and reloads; --on-demand draws only while it is set
+bool frameDirty = true;
+// modification time and size of the scene file as --watch last saw it;
+// the size catches saves within the same second
+struct FileStamp
+{
+    time_t modified;
+    off_t size;
+};
+FileStamp sceneStamp = { 0, 0 };
+
+static void errorCallback(int error, const char* description) {
+    fprintf(stderr, "Error: %s\n", description);
+}
+
+static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    GLFWmonitor * _monitor = glfwGetPrimaryMonitor();
+    frameDirty = true;
+    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+    
+    // if (key == GLFW_KEY_F && action == GLFW_PRESS)
+    // {
+    //     fulscreen = 1;   
+    //     const GLFWvidmode * mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    //     //glfwSetWindowSize(win, mode->width, mode->height);
+    //     glfwMaximizeWindow(win);
+
+    // }
+    // if (key == GLFW_KEY_E && action == GLFW_PRESS)
+    // {
+    //     fulscreen = 0;
+    //     glfwSetWindowSize(win, scene.camera.image_width, scene.camera.image_height);
+    // }
+}
+
+static void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
+    frameDirty = true;
+}
+
+static void refreshCallback(GLFWwindow* window) {
+    frameDirty = true;
+}
+
+void cameraInit()
+{
+    parser::Camera camera = scene.camera;
+    // camera settings
+    // viewport
+    glViewport(0, 0, camera.image_width, camera.image_height);
+    glMatrixMode(GL_MODELVIEW);
+    /* Set camera position */
+    glLoadIdentity();
+    gluLookAt(camera.position.x, camera.position.y, camera.position.z,
+    (camera.gaze.x * camera.near_distance + camera.position.x),
+    (camera.gaze.y * camera.near_distance + camera.position.y),
+    (camera.gaze.z * camera.near_distance + camera.position.z),
+    camera.up.x, camera.up.y, camera.up.z);
+    /* Set projection frustrum */
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    // gluPerspective((GLdouble) 30, (GLdouble) (camera.near_plane.y - camera.near_plane.x) / (camera.near_plane.w - camera.near_plane.z), (GLdouble) camera.near_distance, (GLdouble) camera.far_distance);
+    glFrustum(camera.near_plane.x, camera.near_plane.y, camera.near_plane.z, camera.near_plane.w, 
+    camera.near_distance, camera.far_distance);
+}
+
+void turnOn()
+{
+    GLfloat ambient[] = {scene.ambient_light.x, scene.ambient_light.y, scene.ambient_light.z, 1.0f};
+    // turnOn lights
+    int lSize = scene.point_lights.size();
+    for(int i = 0; i<lSize; i++)
+    {
+        parser::PointLight pointLight = scene.point_lights[i];
+
+        GLfloat color[] = {pointLight.intensity.x, pointLight.intensity.y, pointLight.intensity.z, 1.0f};
+        GLfloat position[] = {pointLight.position.x, pointLight.position.y, pointLight.position.z, 1.0f};
+        glLightfv(GL_LIGHT0+i, GL_POSITION, position);
+        glLightfv(GL_LIGHT0+i, GL_AMBIENT, ambient);
+        glLightfv(GL_LIGHT0+i, GL_DIFFUSE, color);
+        glLightfv(GL_LIGHT0+i, GL_SPECULAR, color);
+    }
+    // shader variants light every light of their bucket, enabled or not, so
+    // the rest of it must not keep the colors of an earlier scene
+    GLfloat black[] = {0.0f, 0.0f, 0.0f, 1.0f};
+    int bucket = lightBucket(lSize);
+    for(int i = lSize; i<bucket; i++)
+    {
+        glLightfv(GL_LIGHT0+i, GL_AMBIENT, black);
+        glLightfv(GL_LIGHT0+i, GL_DIFFUSE, black);
+        glLightfv(GL_LIGHT0+i, GL_SPECULAR, black);
+    }
+}
+
+void calculateNormals()
+{
+    int vSize = scene.vertex_data.size();
+    for(int i = 0; i<vSize; i++)
+    {
+        parser::Vec3f temp;
+        temp.x = 0.0f;
+        temp.y = 0.0f;
+        temp.z = 0.0f;
+        normals.push_back(temp);
+    }
+
+    int mSize = scene.meshes.size();
+    for(int i = 0; i<mSize; i++)
+    {
+        // instances repeat the faces of their base mesh
+        if(scene.meshes[i].base_mesh_id)
+            continue;
+        const parser::Mesh& mesh = scene.meshes[i];
+        int fSize = mesh.faces.size();
+        for(int j = 0; j<fSize; j++)
+        {
+            parser::Face face = mesh.faces[j];
+            // vertex0
+            parser::Vec3f vertex0 = scene.vertex_data[face.v0_id-1];
+            // vertex1
+            parser::Vec3f vertex1 = scene.vertex_data[face.v1_id-1];
+            // vertex2
+            parser::Vec3f vertex2 = scene.vertex_data[face.v2_id-1];
+            
+            parser::Vec3f normal0;
+            parser::Vec3f normal1;
+            parser::Vec3f normal2;
+            parser::Vec3f b;
+            parser::Vec3f a;
+            // normal0
+            a.x = vertex1.x - vertex0.x;
+            a.y = vertex1.y - vertex0.y;
+            a.z = vertex1.z - vertex0.z;
+            b.x = vertex2.x - vertex0.x;
+            b.y = vertex2.y - vertex0.y;
+            b.z = vertex2.z - vertex0.z;
+            normal0.x = a.y*b.z - a.z*b.y;
+            normal0.y = a.z*b.x - a.x*b.z;
+            normal0.z = a.x*b.y - a.y*b.x;
+            normals[face.v0_id-1].x += normal0.x;
+            normals[face.v0_id-1].y += normal0.y;
+            normals[face.v0_id-1].z += normal0.z;
+            // normal1
+            a.x = vertex2.x - vertex1.x;
+            a.y = vertex2.y - vertex1.y;
+            a.z = vertex2.z - vertex1.z;
+            b.x = vertex0.x - vertex1.x;
+            b.y = vertex0.y - vertex1.y;
+            b.z = vertex0.z - vertex1.z;
+            normal1.x = a.y*b.z - a.z*b.y;
+            normal1.y = a.z*b.x - a.x*b.z;
+            normal1.z = a.x*b.y - a.y*b.x;
+            normals[face.v1_id-1].x += normal1.x;
+            normals[face.v1_id-1].y += normal1.y;
+            normals[face.v1_id-1].z += normal1.z;
+            // normal2
+            a.x = vertex0.x - vertex2.x;
+            a.y = vertex0.y - vertex2.y;
+            a.z = vertex0.z - vertex2.z;
+            b.x = vertex1.x - vertex2.x;
+            b.y = vertex1.y - vertex2.y;
+            b.z = vertex1.z - vertex2.z;
+            normal2.x = a.y*b.z - a.z*b.y;
+            normal2.y = a.z*b.x - a.x*b.z;
+            normal2.z = a.x*b.y - a.y*b.x;
+            normals[face.v2_id-1].x += normal2.x;
+            normals[face.v2_id-1].y += normal2.y;
+            normals[face.v2_id-1].z += normal2.z;
+        }
+    }
+//     for(int i = 0; i<vSize; i++)
+//     {
+//         float len = sqrtf(normals[i].x*normals[i].x+ normals[i].y*normals[i].y + normals[i].z + normals[i].z);
+//         normals[i].x /= len;
+//         normals[i].y /= len;
+//         normals[i].z /= len;
+//     }
+}
+
+void emitTriangle(const parser::Face& face)
+{
+    parser::Vec3f vertex0;
+    parser::Vec3f vertex1;
+    parser::Vec3f vertex2;
+    parser::Vec3f normal0;
+    parser::Vec3f normal1;
+    parser::Vec3f normal2;
+
+    vertex0 = scene.vertex_data[face.v0_id - 1];
+    vertex1 = scene.vertex_data[face.v1_id - 1];
+    vertex2 = scene.vertex_data[face.v2_id - 1];
+    normal0 = normals[face.v0_id - 1];
+    normal1 = normals[face.v1_id - 1];
+    normal2 = normals[face.v2_id - 1];
+    // vertex0
+    glNormal3f(normal0.x, normal0.y, normal0.z);
+    glVertex3f(vertex0.x, vertex0.y, vertex0.z);
+    
+    // vertex1
+    glNormal3f(normal1.x, normal1.y, normal1.z);
+    glVertex3f(vertex1.x, vertex1.y, vertex1.z);
+    
+    // vertex2
+    glNormal3f(normal2.x, normal2.y, normal2.z);
+    glVertex3f(vertex2.x, vertex2.y, vertex2.z);
+}
+
+void uploadGeometry()
+{
+    glGenBuffers(1, &gpuVertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, gpuVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, scene.vertex_data.size() * sizeof(parser::Vec3f), &scene.vertex_data[0], GL_STATIC_DRAW);
+    glGenBuffers(1, &gpuNormalBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, gpuNormalBuffer);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(parser::Vec3f), &normals[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawMesh(const parser::Mesh& mesh, const std::vector<parser::Face>& faces)
+{
+    parser::Material material = scene.materials[mesh.material_id-1];
+
+    GLfloat ambientColor[] = {material.ambient.x, material.ambient.y, material.ambient.z, 1.0f};
+    GLfloat diffuseColor[] = {material.diffuse.x, material.diffuse.y, material.diffuse.z, 1.0f};
+    GLfloat specularColor[] = {material.specular.x, material.specular.y, material.specular.z, 1.0f};
+    GLfloat phongExponent[] = {material.phong_exponent};
+
+    // transformations
+    glPushMatrix();
+    int tSize = mesh.transformations.size();
+    for(int j = tSize - 1; j>=0; j--)
+    {
+        parser::Transformation transformation = mesh.transformations[j];
+        // translation
+        if(transformation.transformation_type == "Translation")
+        {
+            parser::Vec3f translate = scene.translations[transformation.id - 1];
+            glTranslatef(translate.x, translate.y, translate.z);
+        }
+        // rotation
+        if(transformation.transformation_type == "Rotation")
+        {
+            parser::Vec4f rotation = scene.rotations[transformation.id - 1];
+            glRotatef(rotation.x, rotation.y, rotation.z, rotation.w);
+        }
+        //scaling
+        if(transformation.transformation_type == "Scaling")
+        {
+            parser::Vec3f scaling = scene.scalings[transformation.id - 1];
+            glScalef(scaling.x, scaling.y, scaling.z);
+        }
+    }
+    GLuint program = 0;
+    if(options.shader_variants)
+    {
+        program = shaderVariant(variantKeyFor(scene));
+    }
+    int fSize = faces.size();
+    if(program)
+    {
+        // a variant is specialized for this mesh's state, so state and
+        // material are set once and the whole mesh goes in one batch
+        glUseProgram(program);
+        applyRasterState(cullModeOf(scene), meshKindOf(mesh));
+        glMaterialfv(GL_FRONT, GL_AMBIENT, ambientColor);
+        glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuseColor);
+        glMaterialfv(GL_FRONT, GL_SPECULAR, specularColor);
+        glMaterialfv(GL_FRONT, GL_SHININESS, phongExponent);
+        glBegin(GL_TRIANGLES);
+        for(int j = 0; j<fSize; j++)
+        {
+            emitTriangle(faces[j]);
+        }
+        glEnd();
+        glUseProgram(0);
+    }
+    else
+    {
+        for(int j = 0; j<fSize; j++)
+        {
+            // polygon mode
+            applyRasterState(cullModeOf(scene), meshKindOf(mesh));
+
+            // material colors
+            glMaterialfv(GL_FRONT, GL_AMBIENT, ambientColor);
+            glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuseColor); 
+            glMaterialfv(GL_FRONT, GL_SPECULAR, specularColor);
+            glMaterialfv(GL_FRONT, GL_SHININESS, phongExponent);
+            
+            // faces and begin gl_triangles
+            glBegin(GL_TRIANGLES);
+            emitTriangle(faces[j]);
+            glEnd();
+        }
+    }
+    glPopMatrix();
+}
+
+// One point per mesh at its bounds center, colored by its material as if
+// lit head on by the ambient light and a unit light.
+void drawImpostors(const std::vector<int>& impostors)
+{
+    const std::vector<Bounds>& world = meshWorldBounds();
+    glDisable(GL_LIGHTING);
+    glPointSize(1.0f);
+    glBegin(GL_POINTS);
+    int iSize = impostors.size();
+    for(int i = 0; i<iSize; i++)
+    {
+        const parser::Mesh& mesh = scene.meshes[impostors[i]];
+        const parser::Material& material = scene.materials[mesh.material_id-1];
+        glColor3f(scene.ambient_light.x*material.ambient.x + material.diffuse.x,
+                  scene.ambient_light.y*material.ambient.y + material.diffuse.y,
+                  scene.ambient_light.z*material.ambient.z + material.diffuse.z);
+        const parser::Vec3f& center = world[impostors[i]].center;
+        glVertex3f(center.x, center.y, center.z);
+    }
+    glEnd();
+    glEnable(GL_LIGHTING);
+}
+
+void drawScene(const std::vector<unsigned char>* visible, const std::vector<unsigned char>* levels)
+{
+    if(options.indirect)
+    {
+        drawIndirectScene(scene, visible, levels);
+    }
+    else if(options.instancing)
+    {
+        drawInstanceGroups(scene, visible, levels);
+    }
+    else
+    {
+        int mSize = scene.meshes.size();
+        for(int i = 0; i<mSize; i++)
+        {
+            if(visible && !(*visible)[i])
+                continue;
+            if(levels && (*levels)[i])
+                drawMesh(scene.meshes[i], meshLod(i, (*levels)[i]).faces);
+            else
+                drawMesh(scene.meshes[i], scene.meshFaces(scene.meshes[i]));
+        }
+    }
+}
+
+void drawMeshes()
+{
+    static int framesRendered = 0;
+	static std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+
+    glClearColor(0, 0, 0, 1);
+	glClearDepth(1.0f);
+	glClearStencil(0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glEnable(GL_DEPTH_TEST);
+    glShadeModel(GL_SMOOTH);
+    glMatrixMode(GL_MODELVIEW);
+    glEnable(GL_NORMALIZE);
+    const std::vector<unsigned char>* visible = NULL;
+    if(options.frustum_culling)
+    {
+        Frustum frustum;
+        cameraFrustum(scene.camera, frustum);
+        cullStats = frustumCull(frustum, meshVisible);
+        visible = &meshVisible;
+    }
+    if(!visible && (options.min_pixels > 0.0f || options.hiz_culling || options.occlusion_culling))
+    {
+        meshVisible.assign(scene.meshes.size(), 1);
+        visible = &meshVisible;
+    }
+    if(options.min_pixels > 0.0f)
+        smallStats = smallObjectCull(scene.camera, options.min_pixels, meshVisible, options.impostors ? &meshImpostors : NULL);
+    if(options.hiz_culling)
+        hizStats = hizCull(scene, options.occluders, meshVisible);
+    if(options.occlusion_culling)
+    {
+        // meshVisible stays the query candidates, meshUnoccluded is drawn
+        meshUnoccluded = meshVisible;
+        occlusionStats = applyOcclusionResults(meshUnoccluded);
+        visible = &meshUnoccluded;
+    }
+    const std::vector<unsigned char>* levels = NULL;
+    if(options.gpu_culling)
+        gpuCull(scene.camera, options.lod ? options.lod_error : 0.0f, visible);
+    else if(options.lod)
+    {
+        lodStats = selectMeshLods(scene.camera, options.lod_error, visible, meshLevels);
+        levels = &meshLevels;
+    }
+    // auto mode renders a plain frame every PREPASS_PROBE_FRAMES frames to
+    // measure the overdraw the pre-pass would save
+    bool probe = options.depth_prepass == PREPASS_AUTO && framesDrawn % PREPASS_PROBE_FRAMES == 0;
+    bool prepass = options.depth_prepass == PREPASS_ON || (options.depth_prepass == PREPASS_AUTO && prepassActive && !probe);
+    if(prepass)
+    {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDisable(GL_LIGHTING);
+        setDepthOnlyPass(true);
+        drawScene(visible, levels);
+        setDepthOnlyPass(false);
+        glEnable(GL_LIGHTING);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+    }
+    if(options.measure_overdraw || probe)
+        beginOverdrawMeasure();
+    drawScene(visible, levels);
+    if(options.measure_overdraw || probe)
+    {
+        // a scaled frame only covers a corner of its framebuffer
+        if(options.target_ms > 0.0f)
+            overdrawStats = endOverdrawMeasure(resolutionStats.width, resolutionStats.height);
+        else
+            overdrawStats = endOverdrawMeasure(scene.camera.image_width, scene.camera.image_height);
+    }
+    if(options.impostors && !meshImpostors.empty())
+        drawImpostors(meshImpostors);
+    if(prepass)
+    {
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+    if(probe)
+        prepassActive = overdrawStats.ratio > options.prepass_overdraw;
+    if(options.occlusion_culling)
+        occlusionStats.queries = issueOcclusionQueries(scene.camera, meshVisible, options.occlusion_recheck);
+    ++framesDrawn;
+    ++framesRendered;
+
+	std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
+
+	std::chrono::duration<double> elapsedTime = end - start;
+	if (elapsedTime.count() >= 1.)
+	{
+		start = std::chrono::system_clock::now();
+
+		std::stringstream stream;
+		stream << std::setprecision(3)<<(framesRendered/elapsedTime.count());
+		framesRendered = 0;
+        
+		strcpy(gWindowTitle, gRendererInfo);
+		strcat(gWindowTitle, "[");
+		strcat(gWindowTitle, stream.str().c_str());
+		strcat(gWindowTitle, " FPS]");
+		if(options.frustum_culling)
+		{
+			char culled[64];
+			snprintf(culled, sizeof(culled), " [%d drawn, %d culled]", cullStats.drawn, cullStats.culled);
+			strcat(gWindowTitle, culled);
+		}
+		if(options.gpu_culling)
+		{
+			char gpu[64];
+			snprintf(gpu, sizeof(gpu), " [%d drawn, culled on the GPU]", gpuCulledDraws());
+			strcat(gWindowTitle, gpu);
+		}
+		if(options.min_pixels > 0.0f)
+		{
+			char small[64];
+			snprintf(small, sizeof(small), " [%d too small, %d impostors]", smallStats.culled, smallStats.impostors);
+			strcat(gWindowTitle, small);
+		}
+		if(options.hiz_culling)
+		{
+			char hiz[96];
+			snprintf(hiz, sizeof(hiz), " [%d hidden by %d occluders, %d tris]", hizStats.occluded, hizStats.occluders, hizStats.triangles);
+			strcat(gWindowTitle, hiz);
+		}
+		if(options.occlusion_culling)
+		{
+			char occlusion[64];
+			snprintf(occlusion, sizeof(occlusion), " [%d occluded, %d queries]", occlusionStats.occluded, occlusionStats.queries);
+			strcat(gWindowTitle, occlusion);
+		}
+		if(options.lod && !options.gpu_culling)
+		{
+			char detail[64];
+			snprintf(detail, sizeof(detail), " [%d tris, %d meshes reduced]", lodStats.triangles, lodStats.reduced);
+			strcat(gWindowTitle, detail);
+		}
+		if(options.depth_prepass == PREPASS_AUTO)
+			strcat(gWindowTitle, prepassActive ? " [prepass on]" : " [prepass off]");
+		if(options.target_ms > 0.0f)
+		{
+			char resolution[64];
+			snprintf(resolution, sizeof(resolution), " [%dx%d, %.1f ms]", resolutionStats.width, resolutionStats.height, resolutionStats.frame_ms);
+			strcat(gWindowTitle, resolution);
+		}
+		if(options.measure_overdraw)
+		{
+			char overdraw[64];
+			snprintf(overdraw, sizeof(overdraw), " [overdraw %.2f]", overdrawStats.ratio);
+			strcat(gWindowTitle, overdraw);
+		}
+
+		if(win)
+			glfwSetWindowTitle(win, gWindowTitle);
+		else
+			printf("%s\n", gWindowTitle);
+	}
+}
+
+void normalizeGaze(parser::Camera& camera)
+{
+    float len = sqrtf(camera.gaze.x*camera.gaze.x + camera.gaze.y*camera.gaze.y + camera.gaze.z*camera.gaze.z);
+    if (len == 0.0f)
+        len = 1.0f;
+    camera.gaze.x /= len;
+    camera.gaze.y /= len;
+    camera.gaze.z /= len;
+}
+
+// The passes that read the world bounds of meshes
+bool meshBoundsNeeded()
+{
+    return options.frustum_culling || options.gpu_culling || options.min_pixels > 0.0f || options.lod || options.occlusion_culling || options.hiz_culling;
+}
+
+// Everything derived from the scene file, in dependency order
+void buildScene()
+{
+    calculateNormals();
+    // levels of detail keep the order of the faces they are simplified from
+    if (options.vertex_cache)
+        optimizeSceneVertexCache(scene);
+    if (options.overdraw_order)
+        optimizeSceneOverdraw(scene);
+    if (meshBoundsNeeded())
+        buildMeshBounds(scene);
+    if (options.occlusion_culling)
+        initOcclusionQueries(scene.meshes.size());
+    if (options.lod)
+        buildMeshLods(scene);
+    if (options.instancing || options.indirect)
+        uploadGeometry();
+    if (options.indirect)
+        buildIndirectScene(scene, gpuVertexBuffer, gpuNormalBuffer);
+    else if (options.instancing)
+        buildInstanceGroups(scene, gpuVertexBuffer, gpuNormalBuffer);
+    if (options.gpu_culling && !initGpuCulling()) {
+        fprintf(stderr, "Warning: the culling compute shader failed, culling on the CPU\n");
+        options.gpu_culling = false;
+        options.frustum_culling = true;
+    }
+    // enable lights
+    int lSize = scene.point_lights.size();
+    for(int i = 0; i<lSize; i++)
+    {
+        glEnable(GL_LIGHT0+i);
+    }
+    // light positions are taken through the modelview matrix, which still
+    // holds the camera when a reload happens
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    turnOn();
+}
+
+void releaseScene()
+{
+    int lSize = scene.point_lights.size();
+    for(int i = 0; i<lSize; i++)
+    {
+        glDisable(GL_LIGHT0+i);
+    }
+    releaseOcclusionQueries();
+    releaseIndirectScene();
+    releaseInstanceGroups();
+    if (gpuVertexBuffer)
+        glDeleteBuffers(1, &gpuVertexBuffer);
+    if (gpuNormalBuffer)
+        glDeleteBuffers(1, &gpuNormalBuffer);
+    gpuVertexBuffer = gpuNormalBuffer = 0;
+    normals.clear();
+}
+
+FileStamp sceneFileStamp(const char* path)
+{
+    FileStamp stamp = { 0, 0 };
+    struct stat info;
+    if (stat(path, &info) == 0)
+    {
+        stamp.modified = info.st_mtime;
+        stamp.size = info.st_size;
+    }
+    return stamp;
+}
+
+// Puts a freshly parsed scene in place of the current one and rebuilds
+// everything derived from it
+void replaceScene(const parser::Scene& loaded)
+{
+    releaseScene();
+    scene = loaded;
+    // fresh programs pick up the new light state even on drivers that lose
+    // it across the culling dispatch; they come from the binary cache
+    if (options.shader_variants)
+        initShaderVariants(options.shader_cache_dir);
+    buildScene();
+    if (options.target_ms > 0.0f)
+        initResolutionScaling(scene.camera.image_width, scene.camera.image_height, options.target_ms, options.min_scale);
+    framesDrawn = 0;
+    frameDirty = true;
+}
+
+// Whether two scenes have the same vertices, faces and light count, so that
+// what buildScene made from one holds for the other
+bool sameGeometry(const parser::Scene& a, const parser::Scene& b)
+{
+    if (a.vertex_data.size() != b.vertex_data.size() || a.meshes.size() != b.meshes.size() ||
+        a.point_lights.size() != b.point_lights.size())
+        return false;
+    if (!a.vertex_data.empty() && memcmp(&a.vertex_data[0], &b.vertex_data[0], a.vertex_data.size() * sizeof(parser::Vec3f)) != 0)
+        return false;
+    int mSize = a.meshes.size();
+    for(int i = 0; i<mSize; i++)
+    {
+        const std::vector<parser::Face>& fa = a.meshes[i].faces;
+        const std::vector<parser::Face>& fb = b.meshes[i].faces;
+        if (a.meshes[i].base_mesh_id != b.meshes[i].base_mesh_id || fa.size() != fb.size())
+            return false;
+        if (!fa.empty() && memcmp(&fa[0], &fb[0], fa.size() * sizeof(parser::Face)) != 0)
+            return false;
+    }
+    return true;
+}
+
+// A reload that leaves the geometry alone keeps the buffers, normals and
+// levels of detail built from it. Only the meshes whose model matrix
+// changed get new world bounds, and the BVH is refit above them instead of
+// rebuilt. Instanced and indirect drawing bake the matrices into their
+// buffers, and faces reordered at load no longer match the file, so those
+// always rebuild.
+bool moveScene(const parser::Scene& loaded)
+{
+    if (options.instancing || options.indirect || options.vertex_cache || options.overdraw_order ||
+        !sameGeometry(scene, loaded))
+        return false;
+    std::vector<int> moved;
+    int mSize = scene.meshes.size();
+    for(int i = 0; i<mSize; i++)
+    {
+        mat4x4 before, after;
+        meshModelMatrix(scene, scene.meshes[i], before);
+        meshModelMatrix(loaded, loaded.meshes[i], after);
+        if (memcmp(before, after, sizeof(mat4x4)) != 0)
+            moved.push_back(i);
+    }
+    for(int i = 0; i<mSize; i++)
+    {
+        parser::Mesh& mesh = scene.meshes[i];
+        mesh.material_id = loaded.meshes[i].material_id;
+        mesh.mesh_type = loaded.meshes[i].mesh_type;
+        mesh.transformations = loaded.meshes[i].transformations;
+    }
+    scene.background_color = loaded.background_color;
+    scene.culling_enabled = loaded.culling_enabled;
+    scene.culling_face = loaded.culling_face;
+    scene.camera = loaded.camera;
+    scene.ambient_light = loaded.ambient_light;
+    scene.point_lights = loaded.point_lights;
+    scene.materials = loaded.materials;
+    scene.translations = loaded.translations;
+    scene.scalings = loaded.scalings;
+    scene.rotations = loaded.rotations;
+    if (meshBoundsNeeded() && !moved.empty())
+        updateMeshBounds(scene, moved);
+    // query results of moved meshes no longer hold
+    if (options.occlusion_culling)
+        initOcclusionQueries(mSize);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    turnOn();
+    if (options.target_ms > 0.0f)
+        initResolutionScaling(scene.camera.image_width, scene.camera.image_height, options.target_ms, options.min_scale);
+    framesDrawn = 0;
+    frameDirty = true;
+    return true;
+}
+
+// --watch: the file is parsed into a scratch scene first, so a broken or
+// half written file leaves the current scene on screen.
+void reloadScene(const char* path)
+{
+    parser::Scene loaded;
+    try {
+        loaded.loadFromXml(path);
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "Warning: %s is not reloaded: %s\n", path, e.what());
+        return;
+    }
+    normalizeGaze(loaded.camera);
+    if (!moveScene(loaded))
+        replaceScene(loaded);
+    printf("Reloaded %s\n", path);
+}
+
+// glViewport and renderbuffers stop at driver limits; images larger than
+// them become posters, as do all images with --poster
+int posterTileFor(int width, int height)
+{
+    GLint viewport[2] = { 0, 0 };
+    GLint renderbuffer = 0;
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, viewport);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &renderbuffer);
+    int largest = std::min((int)renderbuffer, (int)std::min(viewport[0], viewport[1]));
+    if (options.poster > 0)
+        return std::min(options.poster, largest);
+    if (width > largest || height > largest)
+        return std::min(POSTER_TILE_SIZE, largest);
+    return 0;
+}
+
+// One frame into target, a framebuffer of width x height: the window's (0)
+// or the headless one
+void renderFrame(GLuint target, int width, int height)
+{
+    cameraInit();
+    if (options.target_ms > 0.0f)
+        resolutionStats = beginScaledFrame();
+    drawMeshes();
+    if (options.target_ms > 0.0f)
+        resolutionStats = endScaledFrame(target, width, height);
+}
+
+// Before the first frame of a new camera: occlusion query results and the
+// pre-pass probe belong to the last one
+void resetCameraState()
+{
+    if (options.occlusion_culling)
+        initOcclusionQueries(scene.meshes.size());
+    framesDrawn = 0;
+}
+
+// --poster: bands of tiles across the image, each tile drawn through the
+// part of the frustum it covers and read back into the band, which goes to
+// the file before the next band is drawn. Only one band is ever in memory.
+bool renderPoster()
+{
+    parser::Camera camera = scene.camera;
+    ImageWriter writer;
+    if (!beginImage(writer, options.output, camera.image_width, camera.image_height))
+        return false;
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    size_t rowSize = (size_t)camera.image_width * 3;
+    std::vector<unsigned char> band;
+    std::vector<unsigned char> rgb;
+    int tiles = 0;
+    bool ok = true;
+    for(int y = 0; y<camera.image_height && ok; y += posterTile)
+    {
+        int bandHeight = std::min(posterTile, camera.image_height - y);
+        band.resize(rowSize * bandHeight);
+        for(int x = 0; x<camera.image_width; x += posterTile)
+        {
+            int tileWidth = std::min(posterTile, camera.image_width - x);
+            scene.camera = tileCamera(camera, x, y, tileWidth, bandHeight);
+            resetCameraState();
+            renderFrame(headlessFramebuffer(), tileWidth, bandHeight);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, headlessFramebuffer());
+            readFramebuffer(tileWidth, bandHeight, rgb);
+            for(int row = 0; row<bandHeight; row++)
+                memcpy(&band[row * rowSize + x * 3], &rgb[row * tileWidth * 3], tileWidth * 3);
+            tiles++;
+        }
+        ok = writeImageRows(writer, &band[0], bandHeight);
+    }
+    scene.camera = camera;
+    if (!endImage(writer) || !ok)
+        return false;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Poster: %dx%d in %d tiles of %d px, %.3f s\n", camera.image_width, camera.image_height, tiles, posterTile, seconds);
+    printf("Wrote %s\n", options.output.c_str());
+    return true;
+}
+
+// Center of the box around every mesh as drawn, the --turntable pivot
+parser::Vec3f sceneCenter()
+{
+    parser::Vec3f low = { FLT_MAX, FLT_MAX, FLT_MAX };
+    parser::Vec3f high = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    int mSize = scene.meshes.size();
+    for(int i = 0; i<mSize; i++)
+    {
+        mat4x4 model;
+        meshModelMatrix(scene, scene.meshes[i], model);
+        Bounds world = transformBounds(localMeshBounds(scene, scene.meshes[i]), model);
+        low.x = std::min(low.x, world.min.x);
+        low.y = std::min(low.y, world.min.y);
+        low.z = std::min(low.z, world.min.z);
+        high.x = std::max(high.x, world.max.x);
+        high.y = std::max(high.y, world.max.y);
+        high.z = std::max(high.z, world.max.z);
+    }
+    parser::Vec3f center = { 0.0f, 0.0f, 0.0f };
+    if (mSize > 0) {
+        center.x = (low.x + high.x) * 0.5f;
+        center.y = (low.y + high.y) * 0.5f;
+        center.z = (low.z + high.z) * 0.5f;
+    }
+    return center;
+}
+
+// --headless: a fixed number of frames, then the last one goes to a file,
+// or with --capture every one of them
+bool renderHeadless()
+{
+    // a poster is one image, written in bands as it is drawn
+    if (posterTile > 0) {
+        if (!options.capture.empty()) {
+            fprintf(stderr, "Error: --capture needs frames that fit the framebuffer, %dx%d is drawn as a poster\n",
+                scene.camera.image_width, scene.camera.image_height);
+            return false;
+        }
+        if (options.turntable != 0.0f || options.frames != 1)
+            fprintf(stderr, "Warning: posters are drawn once, ignoring --turntable and --frames\n");
+        return renderPoster();
+    }
+    int width = scene.camera.image_width;
+    int height = scene.camera.image_height;
+    bool capturing = !options.capture.empty();
+    if (capturing && !initCapture(options.capture, width, height))
+        return false;
+    parser::Camera camera = scene.camera;
+    parser::Vec3f center = { 0.0f, 0.0f, 0.0f };
+    if (options.turntable != 0.0f)
+        center = sceneCenter();
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    for(int f = 0; f<options.frames; f++) {
+        if (options.turntable != 0.0f)
+            scene.camera = orbitCamera(camera, center, options.turntable * f);
+        renderFrame(headlessFramebuffer(), width, height);
+        if (capturing)
+            captureFrame(headlessFramebuffer());
+    }
+    CaptureStats captureStats = { 0, 0.0f, false };
+    if (capturing)
+        captureStats = finishCapture();
+    glFinish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Headless: %d frames in %.3f s, %.2f FPS\n", options.frames, seconds, seconds > 0.0 ? options.frames / seconds : 0.0);
+    if (options.measure_overdraw)
+        printf("Overdraw: %.2f fragments per covered pixel\n", overdrawStats.ratio);
+
+    bool ok = true;
+    if (capturing) {
+        printf("Capture: %d frames written through %s, %.1f ms waiting for the writer\n", captureStats.frames,
+            captureStats.pixel_buffers ? "pixel buffers" : "glReadPixels", captureStats.wait_ms);
+        ok = captureStats.frames == options.frames;
+        if (!ok)
+            fprintf(stderr, "Error: %d of %d frames were not written to %s\n", options.frames - captureStats.frames,
+                options.frames, options.capture.c_str());
+    }
+    else {
+        std::vector<unsigned char> rgb;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, headlessFramebuffer());
+        readFramebuffer(width, height, rgb);
+        ok = writeImage(options.output, width, height, rgb);
+        if (ok)
+            printf("Wrote %s\n", options.output.c_str());
+    }
+    scene.camera = camera;
+    return ok;
+}
+
+// --batch: the frames of --headless for every job, in the context main set
+// up, which starts out without a scene. Jobs come grouped by scene, so a
+// scene's geometry, normals and buffers are built once for all its jobs and
+// only the camera changes between them. Each scene is parsed into a scratch
+// scene, and both keep their storage from one scene to the next. A scene
+// with the geometry of the one before keeps what was built from it, as a
+// --watch reload does. The jobs
+// of a scene that fails to load are skipped, whichever scene it is.
+bool renderBatch(const std::vector<BatchJob>& jobs)
+{
+    std::string output = options.output;
+    std::string current;
+    parser::Scene loaded;
+    parser::Camera camera = scene.camera;
+    int scaledWidth = 0;
+    int scaledHeight = 0;
+    bool sceneReady = false;
+    int scenes = 0;
+    int failed = 0;
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    int jSize = jobs.size();
+    for(int i = 0; i<jSize; i++)
+    {
+        const BatchJob& job = jobs[i];
+        if (i == 0 || job.scene != current) {
+            current = job.scene;
+            scenes++;
+            clearScene(loaded);
+            try {
+                loaded.loadFromXml(current);
+                sceneReady = true;
+            }
+            catch (const std::exception& e) {
+                fprintf(stderr, "%s: %s\n", current.c_str(), e.what());
+                sceneReady = false;
+            }
+            if (sceneReady) {
+                normalizeGaze(loaded.camera);
+                if (!moveScene(loaded))
+                    replaceScene(loaded);
+                camera = scene.camera;
+                scaledWidth = camera.image_width;
+                scaledHeight = camera.image_height;
+            }
+        }
+        if (!sceneReady) {
+            fprintf(stderr, "Error: job on line %d is skipped\n", job.line);
+            failed++;
+            continue;
+        }
+        scene.camera = batchCamera(camera, job);
+        normalizeGaze(scene.camera);
+        int width = scene.camera.image_width;
+        int height = scene.camera.image_height;
+        posterTile = posterTileFor(width, height);
+        if (options.target_ms > 0.0f && posterTile > 0) {
+            fprintf(stderr, "Warning: posters are drawn at full resolution, ignoring --target-ms\n");
+            options.target_ms = 0.0f;
+            releaseResolutionScaling();
+        }
+        if (posterTile > 0) {
+            width = std::min(width, posterTile);
+            height = std::min(height, posterTile);
+        }
+        if (!reserveHeadlessFramebuffer(width, height)) {
+            failed++;
+            continue;
+        }
+        if (options.target_ms > 0.0f && (scene.camera.image_width != scaledWidth || scene.camera.image_height != scaledHeight)) {
+            scaledWidth = scene.camera.image_width;
+            scaledHeight = scene.camera.image_height;
+            initResolutionScaling(scaledWidth, scaledHeight, options.target_ms, options.min_scale);
+        }
+        resetCameraState();
+        options.output = job.output;
+        printf("Batch: job %d of %d, %s to %s\n", i + 1, jSize, job.scene.c_str(), job.output.c_str());
+        if (!renderHeadless())
+            failed++;
+    }
+    scene.camera = camera;
+    options.output = output;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Batch: %d jobs of %d scenes in %.3f s, %.1f ms a job, %d failed\n", jSize, scenes, seconds,
+        seconds * 1e3 / jSize, failed);
+    return failed == 0;
+}
+
+// --worker: the tiles --distribute sends instead of frames, each drawn
+// with the tile's camera into the corner of the headless framebuffer
+bool renderHeadlessTiles()
+{
+    parser::Camera camera = scene.camera;
+    bool ok = runWorker(options.worker, camera, [](const parser::Camera& tile, std::vector<unsigned char>& rgb) {
+        scene.camera = tile;
+        resetCameraState();
+        renderFrame(headlessFramebuffer(), tile.image_width, tile.image_height);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, headlessFramebuffer());
+        readFramebuffer(tile.image_width, tile.image_height, rgb);
+    });
+    scene.camera = camera;
+    return ok;
+}
+
+// --software: the frames of --headless, rasterized on the CPU without any
+// GL context
+bool renderSoftwareFrames()
+{
+    bool ok = true;
+    calculateNormals();
+    initThreadPool(options.threads);
+    initSoftware(scene, normals);
+    if (!options.worker.empty()) {
+        parser::Camera camera = scene.camera;
+        ok = runWorker(options.worker, camera, [](const parser::Camera& tile, std::vector<unsigned char>& rgb) {
+            scene.camera = tile;
+            if (options.sort_last > 0)
+                renderSoftwareSortLast(scene, options.sort_last, rgb);
+            else
+                renderSoftware(scene, rgb);
+        });
+        scene.camera = camera;
+    }
+    else if (options.raster_benchmark) {
+        benchmarkSoftwareKernels(scene, options.frames);
+    }
+    else {
+        std::vector<unsigned char> rgb;
+        SoftwareStats stats = { 0, 0, 0, 0.0f, 0.0f, 0.0f };
+        std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+        for(int f = 0; f<options.frames; f++)
+            stats = options.sort_last > 0 ? renderSoftwareSortLast(scene, options.sort_last, rgb) : renderSoftware(scene, rgb);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("Software: %d frames in %.3f s, %.2f FPS on %d threads, %s vertex kernel\n", options.frames, seconds,
+            seconds > 0.0 ? options.frames / seconds : 0.0, threadCount(), softwareVertexKernel());
+        printf("Software: %d primitives binned %d times to %d tiles, setup %.1f ms, raster %.1f ms\n",
+            stats.triangles, stats.binned, stats.tiles, stats.setup_ms, stats.raster_ms);
+        if (options.sort_last > 0)
+            printf("Software: %d sort-last workers, composited in %.1f ms\n", std::min(options.sort_last, (int)scene.meshes.size()), stats.composite_ms);
+        ok = writeImage(options.output, scene.camera.image_width, scene.camera.image_height, rgb);
+        if (ok)
+            printf("Wrote %s\n", options.output.c_str());
+    }
+    releaseSoftware();
+    releaseThreadPool();
+    normals.clear();
+    return ok;
+}
+
+// --raytrace: the frames of --headless, traced on the CPU
+bool renderRayTracedFrames()
+{
+    calculateNormals();
+    initThreadPool(options.threads);
+    RayBuildStats build = initRayTracer(scene, normals);
+    printf("Ray tracer: %d triangles, BVH of %d nodes and %d leaves in %.1f ms, %d subtrees on %d threads\n",
+        build.triangles, build.nodes, build.leaves, build.build_ms, build.subtrees, threadCount());
+    std::vector<unsigned char> rgb;
+    RayStats stats = { 0, 0, 0.0f };
+    double seconds = 0.0;
+    for(int f = 0; f<options.frames; f++) {
+        stats = renderRayTraced(scene, rgb);
+        seconds += stats.trace_ms * 1e-3;
+    }
+    long long rays = stats.primary + stats.shadow;
+    printf("Ray tracer: %d frames in %.3f s, %lld primary and %lld shadow rays a frame, %.2f M rays/s\n", options.frames, seconds,
+        stats.primary, stats.shadow, seconds > 0.0 ? rays * options.frames / seconds * 1e-6 : 0.0);
+    bool ok = writeImage(options.output, scene.camera.image_width, scene.camera.image_height, rgb);
+    if (ok)
+        printf("Wrote %s\n", options.output.c_str());
+    releaseRayTracer();
+    releaseThreadPool();
+    normals.clear();
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    parseOptions(argc, argv);
+    // a batch loads the scenes of its jobs as it goes
+    std::vector<BatchJob> batchJobs;
+    if (options.batch) {
+        if (!readBatchJobs(argv[1], batchJobs))
+            exit(EXIT_FAILURE);
+        if (batchJobs.empty()) {
+            fprintf(stderr, "Error: %s lists no jobs\n", argv[1]);
+            exit(EXIT_FAILURE);
+        }
+        if (options.software || options.raytrace || options.distribute > 0 || options.vertex_benchmark ||
+            !options.worker.empty() || !options.scene_cache.empty() || !options.capture.empty()) {
+            fprintf(stderr, "Error: --batch draws its jobs with GL headless, one image each\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    // a cache holds the scene the coordinator loaded, gaze normalized
+    else if (!options.scene_cache.empty()) {
+        if (!loadSceneCache(options.scene_cache, scene))
+            exit(EXIT_FAILURE);
+    }
+    else {
+        scene.loadFromXml(argv[1]);
+        normalizeGaze(scene.camera);
+    }
+    if (options.distribute > 0) {
+        bool ok = runCoordinator(scene, options.distribute, options.tile_size, options.output, argc, argv);
+        exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (options.vertex_benchmark) {
+        calculateNormals();
+        benchmarkVertexKernels(scene, normals);
+        exit(EXIT_SUCCESS);
+    }
+    if (options.raytrace) {
+        bool ok = renderRayTracedFrames();
+        exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (options.software) {
+        bool ok = renderSoftwareFrames();
+        exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    // workers of --distribute without --software render with GL offscreen
+    if (!options.worker.empty())
+        options.headless = true;
+    if (options.headless) {
+        if (!createHeadlessContext())
+            exit(EXIT_FAILURE);
+    }
+    else {
+        glfwSetErrorCallback(errorCallback);
+        if (!glfwInit()) {
+            std::cout << "Failed to initialize GLFW\n" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+
+        win = glfwCreateWindow(scene.camera.image_width, scene.camera.image_height, "CENG477 - HW3", NULL, NULL);
+
+        if (!win) {
+            // if some error occured exit
+            std::cout << "Failed to open GLFW window.\n" << std::endl;
+            glfwTerminate();
+            exit(EXIT_FAILURE);
+        }
+
+        glfwMakeContextCurrent(win);
+    }
+
+    GLenum err = glewInit();
+    // a GLEW built for GLX loads the GL entry points, then fails to find an X
+    // display; under EGL that is expected
+    if (err != GLEW_OK && !(options.headless && err == GLEW_ERROR_NO_GLX_DISPLAY)) {
+        fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
+            exit(EXIT_FAILURE);
+    }
+
+    glClearColor(scene.background_color.x, scene.background_color.y, scene.background_color.z, 1);
+    strcpy(gRendererInfo, "CENG477 - HW3");
+    if (options.headless) {
+        // a worker's framebuffer holds its largest tile; a batch's grows
+        // to its largest job as the jobs are drawn
+        int framebufferWidth = scene.camera.image_width;
+        int framebufferHeight = scene.camera.image_height;
+        if (!options.worker.empty()) {
+            framebufferWidth = std::min(framebufferWidth, options.tile_size);
+            framebufferHeight = std::min(framebufferHeight, options.tile_size);
+        }
+        else {
+            posterTile = posterTileFor(framebufferWidth, framebufferHeight);
+            if (posterTile > 0) {
+                framebufferWidth = std::min(framebufferWidth, posterTile);
+                framebufferHeight = std::min(framebufferHeight, posterTile);
+            }
+        }
+        if (!(GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object) ||
+            (!options.batch && !initHeadlessFramebuffer(framebufferWidth, framebufferHeight))) {
+            fprintf(stderr, "Error: headless rendering needs framebuffer objects\n");
+            destroyHeadlessContext();
+            exit(EXIT_FAILURE);
+        }
+    }
+    else {
+        glfwSetKeyCallback(win, keyCallback);
+        glfwSetFramebufferSizeCallback(win, framebufferSizeCallback);
+        glfwSetWindowRefreshCallback(win, refreshCallback);
+        glfwSetWindowTitle(win, gRendererInfo);
+    }
+
+    glEnable(GL_LIGHTING);
+    glShadeModel(GL_SMOOTH);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_DEPTH);
+
+    if (options.shader_variants && !GLEW_VERSION_2_1) {
+        fprintf(stderr, "Warning: GLSL 1.20 is not available, using fixed function\n");
+        options.shader_variants = false;
+    }
+    if (options.instancing && !(options.shader_variants && instancingSupported())) {
+        fprintf(stderr, "Warning: instanced drawing needs GL 3.3 and --shaders, drawing meshes one by one\n");
+        options.instancing = false;
+    }
+    if (options.indirect && !(options.shader_variants && indirectSupported())) {
+        fprintf(stderr, "Warning: multi-draw indirect needs GL 4.3 and --shaders, drawing meshes one by one\n");
+        options.indirect = false;
+    }
+    if (options.gpu_culling && !(options.indirect && gpuCullingSupported())) {
+        fprintf(stderr, "Warning: GPU culling needs GL 4.3 and --indirect, culling on the CPU\n");
+        options.gpu_culling = false;
+        options.frustum_culling = true;
+    }
+    // the compute shader does the frustum test in place of the CPU
+    if (options.gpu_culling)
+        options.frustum_culling = false;
+    if (options.shader_variants)
+        initShaderVariants(options.shader_cache_dir);
+    if (options.target_ms > 0.0f && posterTile > 0) {
+        fprintf(stderr, "Warning: posters are drawn at full resolution, ignoring --target-ms\n");
+        options.target_ms = 0.0f;
+    }
+    if (options.target_ms > 0.0f && !resolutionScalingSupported()) {
+        fprintf(stderr, "Warning: dynamic resolution needs framebuffer objects, drawing at full resolution\n");
+        options.target_ms = 0.0f;
+    }
+
+    // initialize camera and scene
+
+    // set camera 
+    // read scene into buffers
+    // do lights
+    // draw
+    if (options.hiz_culling)
+        initThreadPool(options.threads);
+    if (!options.batch)
+        buildScene();
+    if (options.target_ms > 0.0f && !options.batch)
+        initResolutionScaling(scene.camera.image_width, scene.camera.image_height, options.target_ms, options.min_scale);
+    sceneStamp = sceneFileStamp(argv[1]);
+    int status = EXIT_SUCCESS;
+    if (!options.worker.empty())
+        status = renderHeadlessTiles() ? EXIT_SUCCESS : EXIT_FAILURE;
+    else if (options.batch)
+        status = renderBatch(batchJobs) ? EXIT_SUCCESS : EXIT_FAILURE;
+    else if (options.headless)
+        status = renderHeadless() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // --on-demand blocks in glfwWaitEvents until something marks the frame
+    // dirty; otherwise frames are drawn back to back, up to --max-fps
+    std::chrono::time_point<std::chrono::steady_clock> lastFrame = std::chrono::steady_clock::now();
+    std::chrono::time_point<std::chrono::steady_clock> lastWatch = lastFrame;
+    while(!options.headless && !glfwWindowShouldClose(win)) {
+        std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
+        if (options.watch && std::chrono::duration<double>(now - lastWatch).count() >= WATCH_INTERVAL) {
+            lastWatch = now;
+            FileStamp stamp = sceneFileStamp(argv[1]);
+            if (stamp.modified != sceneStamp.modified || stamp.size != sceneStamp.size) {
+                sceneStamp = stamp;
+                reloadScene(argv[1]);
+            }
+        }
+        if (options.on_demand && !frameDirty) {
+            if (options.watch)
+                glfwWaitEventsTimeout(WATCH_INTERVAL);
+            else
+                glfwWaitEvents();
+            continue;
+        }
+        if (options.max_fps > 0.0f) {
+            double wait = 1.0 / options.max_fps - std::chrono::duration<double>(now - lastFrame).count();
+            if (wait > 0.0) {
+                glfwWaitEventsTimeout(wait);
+                continue;
+            }
+        }
+        lastFrame = now;
+        frameDirty = false;
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(win, &framebufferWidth, &framebufferHeight);
+        renderFrame(0, framebufferWidth, framebufferHeight);
+        glfwSwapBuffers(win);
+        glfwPollEvents();
+    }
+
+    releaseScene();
+    releaseResolutionScaling();
+    releaseHiZ();
+    releaseThreadPool();
+    releaseOverdrawMeasure();
+    releaseShaderVariants();
+
+    if (options.headless) {
+        destroyHeadlessContext();
+    }
+    else {
+        // destroys the window created at the beginning
+        glfwDestroyWindow(win);
+
+        // library termination 
+        glfwTerminate();
+    }
+
+    exit(status);
+
+    return 0;
+}
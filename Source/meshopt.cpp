@@ -0,0 +1,370 @@
+#include "meshopt.h"
+#include "instancing.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+// Forsyth's scoring constants
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+struct Cluster
+{
+    int first;
+    int count;
+    float key;
+};
+
+static bool clusterBefore(const Cluster& a, const Cluster& b)
+{
+    return a.key > b.key;
+}
+
+struct CacheVertex
+{
+    int cache_position;     // -1 when not in the cache
+    int remaining;          // triangles not yet emitted that use the vertex
+    int first_triangle;     // range in the vertex -> triangle list
+    float score;
+};
+
+static float vertexScore(const CacheVertex& v)
+{
+    if(v.remaining == 0)
+        return -1.0f;
+    float score = 0.0f;
+    if(v.cache_position >= 0)
+    {
+        if(v.cache_position < 3)
+        {
+            // the last triangle's vertices are penalized so the order does
+            // not just strip along one edge
+            score = LAST_TRIANGLE_SCORE;
+        }
+        else
+        {
+            float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+            score = powf(1.0f - (v.cache_position - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+    // vertices with few triangles left are finished off first
+    score += VALENCE_BOOST_SCALE * powf((float)v.remaining, -VALENCE_BOOST_POWER);
+    return score;
+}
+
+float vertexCacheACMR(const std::vector<parser::Face>& faces, int cacheSize)
+{
+    if(faces.empty())
+        return 0.0f;
+    std::vector<int> fifo(cacheSize, 0);
+    int head = 0;
+    int misses = 0;
+    int fSize = faces.size();
+    for(int j = 0; j<fSize; j++)
+    {
+        const int ids[3] = { faces[j].v0_id, faces[j].v1_id, faces[j].v2_id };
+        for(int k = 0; k<3; k++)
+        {
+            bool hit = false;
+            for(int c = 0; c<cacheSize && !hit; c++)
+                hit = fifo[c] == ids[k];
+            if(!hit)
+            {
+                fifo[head] = ids[k];
+                head = (head + 1) % cacheSize;
+                misses++;
+            }
+        }
+    }
+    return (float)misses / fSize;
+}
+
+void optimizeVertexCache(std::vector<parser::Face>& faces)
+{
+    int fSize = faces.size();
+    if(fSize < 2)
+        return;
+
+    // local vertex numbering and vertex -> triangle adjacency
+    std::map<int, int> localOf;
+    std::vector<int> tris(3 * fSize);
+    for(int j = 0; j<fSize; j++)
+    {
+        const int ids[3] = { faces[j].v0_id, faces[j].v1_id, faces[j].v2_id };
+        for(int k = 0; k<3; k++)
+            tris[3 * j + k] = localOf.insert(std::make_pair(ids[k], (int)localOf.size())).first->second;
+    }
+    int vSize = localOf.size();
+    std::vector<CacheVertex> vertices(vSize);
+    for(int v = 0; v<vSize; v++)
+    {
+        vertices[v].cache_position = -1;
+        vertices[v].remaining = 0;
+    }
+    for(int t = 0; t<3 * fSize; t++)
+        vertices[tris[t]].remaining++;
+    std::vector<int> vertexTriangles(3 * fSize);
+    int offset = 0;
+    for(int v = 0; v<vSize; v++)
+    {
+        vertices[v].first_triangle = offset;
+        offset += vertices[v].remaining;
+        vertices[v].remaining = 0;
+    }
+    for(int j = 0; j<fSize; j++)
+    {
+        for(int k = 0; k<3; k++)
+        {
+            CacheVertex& v = vertices[tris[3 * j + k]];
+            vertexTriangles[v.first_triangle + v.remaining++] = j;
+        }
+    }
+    for(int v = 0; v<vSize; v++)
+        vertices[v].score = vertexScore(vertices[v]);
+
+    std::vector<float> triangleScore(fSize);
+    std::vector<unsigned char> emitted(fSize, 0);
+    for(int j = 0; j<fSize; j++)
+        triangleScore[j] = vertices[tris[3 * j]].score + vertices[tris[3 * j + 1]].score + vertices[tris[3 * j + 2]].score;
+
+    std::vector<parser::Face> ordered;
+    ordered.reserve(fSize);
+    // most recent first; holds up to three evicted vertices until rescored
+    std::vector<int> cache;
+    std::vector<int> next;
+    int scan = 0;
+    int best = -1;
+    while((int)ordered.size() < fSize)
+    {
+        if(best < 0)
+        {
+            // no cached vertex has triangles left: start over from the best
+            // scoring triangle that has not been emitted
+            float bestScore = -1.0f;
+            for(int j = scan; j<fSize; j++)
+            {
+                if(!emitted[j] && triangleScore[j] > bestScore)
+                {
+                    bestScore = triangleScore[j];
+                    best = j;
+                }
+            }
+            while(scan < fSize && emitted[scan])
+                scan++;
+        }
+
+        emitted[best] = 1;
+        ordered.push_back(faces[best]);
+
+        // the triangle's vertices move to the front of the LRU cache
+        next.clear();
+        for(int k = 0; k<3; k++)
+        {
+            int v = tris[3 * best + k];
+            next.push_back(v);
+            // drop the triangle from the vertex's list of remaining ones
+            CacheVertex& vertex = vertices[v];
+            int* list = &vertexTriangles[vertex.first_triangle];
+            for(int i = 0; i<vertex.remaining; i++)
+            {
+                if(list[i] == best)
+                {
+                    list[i] = list[vertex.remaining - 1];
+                    break;
+                }
+            }
+            vertex.remaining--;
+        }
+        int cSize = cache.size();
+        for(int c = 0; c<cSize; c++)
+        {
+            int v = cache[c];
+            if(v != next[0] && v != next[1] && v != next[2])
+                next.push_back(v);
+        }
+        cache.swap(next);
+        cSize = cache.size();
+        for(int c = 0; c<cSize; c++)
+        {
+            CacheVertex& vertex = vertices[cache[c]];
+            vertex.cache_position = c < VERTEX_CACHE_SIZE ? c : -1;
+            vertex.score = vertexScore(vertex);
+        }
+
+        // rescore the triangles around the cache, including those of the
+        // vertices that just fell out, and pick the best one still cached
+        best = -1;
+        float bestScore = -1.0f;
+        for(int c = 0; c<cSize; c++)
+        {
+            const CacheVertex& vertex = vertices[cache[c]];
+            const int* list = &vertexTriangles[vertex.first_triangle];
+            for(int i = 0; i<vertex.remaining; i++)
+            {
+                int j = list[i];
+                float score = vertices[tris[3 * j]].score + vertices[tris[3 * j + 1]].score + vertices[tris[3 * j + 2]].score;
+                triangleScore[j] = score;
+                if(c < VERTEX_CACHE_SIZE && score > bestScore)
+                {
+                    bestScore = score;
+                    best = j;
+                }
+            }
+        }
+        if(cSize > VERTEX_CACHE_SIZE)
+            cache.resize(VERTEX_CACHE_SIZE);
+    }
+    faces.swap(ordered);
+}
+
+// Meshes that share a face list with an optimized one take its order.
+// Instances have none of their own and read their base mesh's.
+static void shareShapeFaces(parser::Scene& scene, const std::vector<int>& shapes, const std::vector<int>& shapeOwner)
+{
+    int mSize = scene.meshes.size();
+    for(int i = 0; i<mSize; i++)
+    {
+        if(!scene.meshes[i].base_mesh_id && shapeOwner[shapes[i]] != i)
+            scene.meshes[i].faces = scene.meshes[shapeOwner[shapes[i]]].faces;
+    }
+}
+
+int optimizeOverdraw(const parser::Scene& scene, std::vector<parser::Face>& faces)
+{
+    int fSize = faces.size();
+    if(fSize < 2 * OVERDRAW_MIN_CLUSTER)
+        return 1;
+
+    // cut clusters where the local ACMR has recovered from the cache reset
+    float target = vertexCacheACMR(faces, ACMR_CACHE_SIZE) * OVERDRAW_ACMR_SLACK;
+    std::vector<Cluster> clusters;
+    std::vector<int> fifo(ACMR_CACHE_SIZE, 0);
+    int head = 0;
+    int misses = 0;
+    Cluster cluster = { 0, 0, 0.0f };
+    for(int j = 0; j<fSize; j++)
+    {
+        const int ids[3] = { faces[j].v0_id, faces[j].v1_id, faces[j].v2_id };
+        for(int k = 0; k<3; k++)
+        {
+            bool hit = false;
+            for(int c = 0; c<ACMR_CACHE_SIZE && !hit; c++)
+                hit = fifo[c] == ids[k];
+            if(!hit)
+            {
+                fifo[head] = ids[k];
+                head = (head + 1) % ACMR_CACHE_SIZE;
+                misses++;
+            }
+        }
+        cluster.count++;
+        if(cluster.count >= OVERDRAW_MIN_CLUSTER && misses <= target * cluster.count)
+        {
+            clusters.push_back(cluster);
+            cluster.first = j + 1;
+            cluster.count = 0;
+            misses = 0;
+            fifo.assign(ACMR_CACHE_SIZE, 0);
+        }
+    }
+    if(cluster.count)
+        clusters.push_back(cluster);
+
+    // area weighted centroid of the mesh and of every cluster
+    parser::Vec3f center = { 0.0f, 0.0f, 0.0f };
+    float area = 0.0f;
+    std::vector<parser::Vec3f> centroids(clusters.size());
+    std::vector<parser::Vec3f> normals(clusters.size());
+    int cSize = clusters.size();
+    for(int c = 0; c<cSize; c++)
+    {
+        parser::Vec3f centroid = { 0.0f, 0.0f, 0.0f };
+        parser::Vec3f normal = { 0.0f, 0.0f, 0.0f };
+        float clusterArea = 0.0f;
+        for(int j = clusters[c].first; j<clusters[c].first + clusters[c].count; j++)
+        {
+            const parser::Vec3f& p0 = scene.vertex_data[faces[j].v0_id - 1];
+            const parser::Vec3f& p1 = scene.vertex_data[faces[j].v1_id - 1];
+            const parser::Vec3f& p2 = scene.vertex_data[faces[j].v2_id - 1];
+            parser::Vec3f a = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+            parser::Vec3f b = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+            parser::Vec3f n = { a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x };
+            float w = sqrtf(n.x*n.x + n.y*n.y + n.z*n.z);
+            centroid.x += w * (p0.x + p1.x + p2.x) / 3.0f;
+            centroid.y += w * (p0.y + p1.y + p2.y) / 3.0f;
+            centroid.z += w * (p0.z + p1.z + p2.z) / 3.0f;
+            normal.x += n.x;
+            normal.y += n.y;
+            normal.z += n.z;
+            clusterArea += w;
+        }
+        center.x += centroid.x;
+        center.y += centroid.y;
+        center.z += centroid.z;
+        area += clusterArea;
+        if(clusterArea > 0.0f)
+        {
+            centroid.x /= clusterArea;
+            centroid.y /= clusterArea;
+            centroid.z /= clusterArea;
+        }
+        centroids[c] = centroid;
+        normals[c] = normal;
+    }
+    if(area > 0.0f)
+    {
+        center.x /= area;
+        center.y /= area;
+        center.z /= area;
+    }
+
+    // clusters on the outside facing outward go first
+    for(int c = 0; c<cSize; c++)
+    {
+        const parser::Vec3f& n = normals[c];
+        float len = sqrtf(n.x*n.x + n.y*n.y + n.z*n.z);
+        clusters[c].key = len > 0.0f ? ((centroids[c].x - center.x) * n.x + (centroids[c].y - center.y) * n.y + (centroids[c].z - center.z) * n.z) / len : 0.0f;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), clusterBefore);
+
+    std::vector<parser::Face> ordered;
+    ordered.reserve(fSize);
+    for(int c = 0; c<cSize; c++)
+        ordered.insert(ordered.end(), faces.begin() + clusters[c].first, faces.begin() + clusters[c].first + clusters[c].count);
+    faces.swap(ordered);
+    return cSize;
+}
+
+void optimizeSceneVertexCache(parser::Scene& scene)
+{
+    std::vector<int> shapeOwner;
+    std::vector<int> shapes = meshShapes(scene, shapeOwner);
+    int sSize = shapeOwner.size();
+    for(int s = 0; s<sSize; s++)
+    {
+        std::vector<parser::Face>& faces = scene.meshes[shapeOwner[s]].faces;
+        float before = vertexCacheACMR(faces, ACMR_CACHE_SIZE);
+        optimizeVertexCache(faces);
+        float after = vertexCacheACMR(faces, ACMR_CACHE_SIZE);
+        std::printf("Vertex cache: mesh %d, %d tris, ACMR %.3f -> %.3f\n", shapeOwner[s] + 1, (int)faces.size(), before, after);
+    }
+    shareShapeFaces(scene, shapes, shapeOwner);
+}
+
+void optimizeSceneOverdraw(parser::Scene& scene)
+{
+    std::vector<int> shapeOwner;
+    std::vector<int> shapes = meshShapes(scene, shapeOwner);
+    int sSize = shapeOwner.size();
+    for(int s = 0; s<sSize; s++)
+    {
+        std::vector<parser::Face>& faces = scene.meshes[shapeOwner[s]].faces;
+        float before = vertexCacheACMR(faces, ACMR_CACHE_SIZE);
+        int clusters = optimizeOverdraw(scene, faces);
+        float after = vertexCacheACMR(faces, ACMR_CACHE_SIZE);
+        std::printf("Overdraw order: mesh %d, %d clusters, ACMR %.3f -> %.3f\n", shapeOwner[s] + 1, clusters, before, after);
+    }
+    shareShapeFaces(scene, shapes, shapeOwner);
+}
@@ -0,0 +1,38 @@
+#ifndef __HW3__MESHOPT__
+#define __HW3__MESHOPT__
+
+#include <vector>
+#include "parser.h"
+
+// LRU cache that Forsyth's vertex scores model while reordering
+#define VERTEX_CACHE_SIZE 32
+// FIFO cache used to report ACMR, close to the post-transform caches of
+// common GPUs
+#define ACMR_CACHE_SIZE 16
+
+// Average cache miss ratio: vertices transformed per triangle with a FIFO
+// cache of cacheSize entries. 3 means no reuse; about 0.5 to 0.7 is the best
+// a closed triangle mesh allows.
+float vertexCacheACMR(const std::vector<parser::Face>& faces, int cacheSize);
+
+// Reorders the faces for post-transform cache reuse (Forsyth, "Linear-Speed
+// Vertex Cache Optimisation"). Faces keep their winding.
+void optimizeVertexCache(std::vector<parser::Face>& faces);
+
+// Overdraw ordering (Sander, Nehab and Barczak): the cache ordered faces
+// are cut into clusters wherever a cluster's own ACMR, with a cold cache,
+// is back within OVERDRAW_ACMR_SLACK of the whole list's. The clusters are
+// then sorted so the ones on the outside of the mesh, facing away from its
+// center, come first and hide the rest from most viewpoints.
+#define OVERDRAW_ACMR_SLACK 1.05f
+#define OVERDRAW_MIN_CLUSTER 16
+
+// Returns the number of clusters.
+int optimizeOverdraw(const parser::Scene& scene, std::vector<parser::Face>& faces);
+
+// Optimizes every distinct face list of the scene once and hands the result
+// to the meshes that share it, printing ACMR before and after.
+void optimizeSceneVertexCache(parser::Scene& scene);
+void optimizeSceneOverdraw(parser::Scene& scene);
+
+#endif
@@ -0,0 +1,136 @@
+#include "occlusion.h"
+#include "culling.h"
+
+static std::vector<GLuint> queries;
+static std::vector<unsigned char> pending;
+static std::vector<unsigned char> occluded;
+static GLenum queryTarget = GL_SAMPLES_PASSED;
+static int frame = 0;
+
+void initOcclusionQueries(int meshCount)
+{
+    releaseOcclusionQueries();
+    queries.resize(meshCount);
+    if(meshCount)
+        glGenQueries(meshCount, &queries[0]);
+    pending.assign(meshCount, 0);
+    occluded.assign(meshCount, 0);
+    queryTarget = (GLEW_VERSION_3_3 || GLEW_ARB_occlusion_query2) ? GL_ANY_SAMPLES_PASSED : GL_SAMPLES_PASSED;
+    frame = 0;
+}
+
+OcclusionStats applyOcclusionResults(std::vector<unsigned char>& visible)
+{
+    OcclusionStats stats = { 0, 0 };
+    int mSize = queries.size();
+    for(int i = 0; i<mSize; i++)
+    {
+        if(pending[i])
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(available)
+            {
+                GLuint samples = 0;
+                glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &samples);
+                occluded[i] = samples == 0;
+                pending[i] = 0;
+            }
+        }
+        if(!visible[i])
+        {
+            occluded[i] = 0;
+            continue;
+        }
+        if(occluded[i])
+        {
+            visible[i] = 0;
+            stats.occluded++;
+        }
+    }
+    return stats;
+}
+
+static void drawBox(const Bounds& b)
+{
+    glBegin(GL_QUADS);
+    // -x, +x
+    glVertex3f(b.min.x, b.min.y, b.min.z); glVertex3f(b.min.x, b.min.y, b.max.z);
+    glVertex3f(b.min.x, b.max.y, b.max.z); glVertex3f(b.min.x, b.max.y, b.min.z);
+    glVertex3f(b.max.x, b.min.y, b.min.z); glVertex3f(b.max.x, b.max.y, b.min.z);
+    glVertex3f(b.max.x, b.max.y, b.max.z); glVertex3f(b.max.x, b.min.y, b.max.z);
+    // -y, +y
+    glVertex3f(b.min.x, b.min.y, b.min.z); glVertex3f(b.max.x, b.min.y, b.min.z);
+    glVertex3f(b.max.x, b.min.y, b.max.z); glVertex3f(b.min.x, b.min.y, b.max.z);
+    glVertex3f(b.min.x, b.max.y, b.min.z); glVertex3f(b.min.x, b.max.y, b.max.z);
+    glVertex3f(b.max.x, b.max.y, b.max.z); glVertex3f(b.max.x, b.max.y, b.min.z);
+    // -z, +z
+    glVertex3f(b.min.x, b.min.y, b.min.z); glVertex3f(b.min.x, b.max.y, b.min.z);
+    glVertex3f(b.max.x, b.max.y, b.min.z); glVertex3f(b.max.x, b.min.y, b.min.z);
+    glVertex3f(b.min.x, b.min.y, b.max.z); glVertex3f(b.max.x, b.min.y, b.max.z);
+    glVertex3f(b.max.x, b.max.y, b.max.z); glVertex3f(b.min.x, b.max.y, b.max.z);
+    glEnd();
+}
+
+int issueOcclusionQueries(const parser::Camera& camera, const std::vector<unsigned char>& candidates, int recheckFrames)
+{
+    const std::vector<Bounds>& bounds = meshWorldBounds();
+    // a box the near plane cuts into loses its front faces, so boxes closer
+    // to the eye than the farthest near plane corner count as visible
+    float halfWidth = fmaxf(fabsf(camera.near_plane.x), fabsf(camera.near_plane.y));
+    float halfHeight = fmaxf(fabsf(camera.near_plane.z), fabsf(camera.near_plane.w));
+    float margin = sqrtf(camera.near_distance*camera.near_distance + halfWidth*halfWidth + halfHeight*halfHeight);
+    const parser::Vec3f& eye = camera.position;
+    if(recheckFrames < 1)
+        recheckFrames = 1;
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_CULL_FACE);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    // a flat mesh lies in a face of its own box, at the depth it just
+    // wrote: pass equal depths and pull the box slightly towards the eye,
+    // or the mesh hides itself
+    glDepthFunc(GL_LEQUAL);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(-1.0f, -1.0f);
+    int issued = 0;
+    int mSize = queries.size();
+    for(int i = 0; i<mSize; i++)
+    {
+        if(!candidates[i] || pending[i])
+            continue;
+        if(!occluded[i] && (frame + i) % recheckFrames != 0)
+            continue;
+        const Bounds& b = bounds[i];
+        if(eye.x > b.min.x - margin && eye.x < b.max.x + margin &&
+           eye.y > b.min.y - margin && eye.y < b.max.y + margin &&
+           eye.z > b.min.z - margin && eye.z < b.max.z + margin)
+        {
+            occluded[i] = 0;
+            continue;
+        }
+        glBeginQuery(queryTarget, queries[i]);
+        drawBox(b);
+        glEndQuery(queryTarget);
+        pending[i] = 1;
+        issued++;
+    }
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_LIGHTING);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    frame++;
+    return issued;
+}
+
+void releaseOcclusionQueries()
+{
+    if(!queries.empty())
+        glDeleteQueries(queries.size(), &queries[0]);
+    queries.clear();
+    pending.clear();
+    occluded.clear();
+}
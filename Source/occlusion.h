@@ -0,0 +1,32 @@
+#ifndef __HW3__OCCLUSION__
+#define __HW3__OCCLUSION__
+
+#include <vector>
+#include <GL/glew.h>
+#include "parser.h"
+
+struct OcclusionStats
+{
+    int occluded;   // meshes skipped because their last query saw nothing
+    int queries;    // box queries issued this frame
+};
+
+// One query object per mesh. Uses GL_ANY_SAMPLES_PASSED where available
+// (GL 3.3 or ARB_occlusion_query2) and GL_SAMPLES_PASSED otherwise.
+void initOcclusionQueries(int meshCount);
+
+// Start of frame: folds in every query result that is already available,
+// without waiting for the others, then clears visible[i] for meshes whose
+// latest result found them hidden. Meshes that visible already marks as
+// outside the frustum forget their result.
+OcclusionStats applyOcclusionResults(std::vector<unsigned char>& visible);
+
+// End of frame, with the scene's depth in place: draws the world bounding
+// box of meshes in candidates under a query. Hidden meshes are queried every
+// frame so they come back one frame after they show; visible ones only
+// every recheckFrames frames, staggered across meshes.
+int issueOcclusionQueries(const parser::Camera& camera, const std::vector<unsigned char>& candidates, int recheckFrames);
+
+void releaseOcclusionQueries();
+
+#endif
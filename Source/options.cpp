@@ -0,0 +1,251 @@
+#include "options.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+Options options;
+
+void printUsage(const char* program)
+{
+    fprintf(stderr, "Usage: %s <scene.xml> [options]\n", program);
+    fprintf(stderr, "       %s <jobs.txt> --batch [options]\n", program);
+    fprintf(stderr, "  --headless            render offscreen without a window and write an image\n");
+    fprintf(stderr, "  --software            render headless on the CPU with a tiled rasterizer, no GL needed\n");
+    fprintf(stderr, "  --vertex-benchmark    time the SIMD vertex kernels on the scene and exit\n");
+    fprintf(stderr, "  --sort-last <n>       software render over n mesh groups, binary swap composited\n");
+    fprintf(stderr, "  --raster-benchmark    compare specialized and branching software raster kernels\n");
+    fprintf(stderr, "  --raytrace            render headless with the BVH ray tracer and report rays/s\n");
+    fprintf(stderr, "  --distribute <n>      render tiles in n worker processes and assemble the image\n");
+    fprintf(stderr, "  --tile-size <px>      side of the --distribute tiles (default 256)\n");
+    fprintf(stderr, "  --poster <px>         headless image in tiles of px, streamed to the file\n");
+    fprintf(stderr, "  --capture <pattern>   write every headless frame to pattern (frames/%%04d.png) or - for raw video\n");
+    fprintf(stderr, "  --turntable <deg>     orbit the camera around the scene by deg every headless frame\n");
+    fprintf(stderr, "  --batch               render every job of the list: <scene.xml> <output> [--position x y z]\n");
+    fprintf(stderr, "                        [--gaze x y z] [--up x y z] [--size w h], headless in one process\n");
+    fprintf(stderr, "  --frames <n>          frames drawn in headless or software mode (default 1)\n");
+    fprintf(stderr, "  --output <file>       headless image, .png or .ppm (default output.ppm)\n");
+    fprintf(stderr, "  --on-demand           redraw only after input, resizes and reloads\n");
+    fprintf(stderr, "  --max-fps <n>         draw at most n frames per second\n");
+    fprintf(stderr, "  --watch               reload the scene when the file changes\n");
+    fprintf(stderr, "  --target-ms <ms>      lower the resolution to hold this frame time\n");
+    fprintf(stderr, "  --min-scale <s>       lowest resolution scale for --target-ms (default 0.5)\n");
+    fprintf(stderr, "  --shaders             draw with specialized shader variants\n");
+    fprintf(stderr, "  --shader-cache <dir>  directory for cached program binaries (default .hw3_cache)\n");
+    fprintf(stderr, "  --instancing          draw repeated meshes with instanced draw calls\n");
+    fprintf(stderr, "  --indirect            draw the whole scene with multi-draw indirect (GL 4.3)\n");
+    fprintf(stderr, "  --gpu-cull            cull and pick levels of detail in a compute shader (GL 4.3)\n");
+    fprintf(stderr, "  --frustum-cull        skip meshes outside the view frustum\n");
+    fprintf(stderr, "  --min-pixels <n>      skip meshes covering fewer than n pixels on screen\n");
+    fprintf(stderr, "  --impostors           draw meshes skipped by --min-pixels as points\n");
+    fprintf(stderr, "  --occlusion-cull      skip meshes hidden behind others, by hardware queries\n");
+    fprintf(stderr, "  --occlusion-recheck <n> frames between queries of visible meshes (default 8)\n");
+    fprintf(stderr, "  --hiz-cull            skip meshes hidden behind large occluders, tested on the CPU\n");
+    fprintf(stderr, "  --occluders <n>       occluder meshes rasterized per frame (default 8)\n");
+    fprintf(stderr, "  --threads <n>         threads for CPU side passes (default one per hardware thread)\n");
+    fprintf(stderr, "  --vertex-cache        reorder faces for vertex cache reuse at load\n");
+    fprintf(stderr, "  --overdraw-order      sort face clusters of every mesh outside-in at load\n");
+    fprintf(stderr, "  --measure-overdraw    show shaded fragments per covered pixel\n");
+    fprintf(stderr, "  --depth-prepass <m>   off, on or auto: draw depth first, then shade visible pixels once\n");
+    fprintf(stderr, "  --prepass-overdraw <r> overdraw above which auto uses the pre-pass (default 1.5)\n");
+    fprintf(stderr, "  --lod                 draw distant meshes with simplified levels of detail\n");
+    fprintf(stderr, "  --lod-error <pixels>  screen space error a level of detail may show (default 1)\n");
+}
+
+void parseOptions(int argc, char* argv[])
+{
+    for(int i = 2; i<argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(strcmp(arg, "--headless") == 0)
+        {
+            options.headless = true;
+        }
+        else if(strcmp(arg, "--software") == 0)
+        {
+            options.software = true;
+        }
+        else if(strcmp(arg, "--vertex-benchmark") == 0)
+        {
+            options.vertex_benchmark = true;
+        }
+        else if(strcmp(arg, "--sort-last") == 0 && hasValue)
+        {
+            options.sort_last = atoi(argv[++i]);
+            options.software = true;
+        }
+        else if(strcmp(arg, "--raster-benchmark") == 0)
+        {
+            options.raster_benchmark = true;
+            options.software = true;
+        }
+        else if(strcmp(arg, "--raytrace") == 0)
+        {
+            options.raytrace = true;
+        }
+        else if(strcmp(arg, "--distribute") == 0 && hasValue)
+        {
+            options.distribute = atoi(argv[++i]);
+        }
+        else if(strcmp(arg, "--tile-size") == 0 && hasValue)
+        {
+            options.tile_size = atoi(argv[++i]);
+        }
+        else if(strcmp(arg, "--worker") == 0 && hasValue)
+        {
+            options.worker = argv[++i];
+        }
+        else if(strcmp(arg, "--scene-cache") == 0 && hasValue)
+        {
+            options.scene_cache = argv[++i];
+        }
+        else if(strcmp(arg, "--poster") == 0 && hasValue)
+        {
+            options.poster = atoi(argv[++i]);
+            options.headless = true;
+        }
+        else if(strcmp(arg, "--capture") == 0 && hasValue)
+        {
+            options.capture = argv[++i];
+            options.headless = true;
+        }
+        else if(strcmp(arg, "--turntable") == 0 && hasValue)
+        {
+            options.turntable = atof(argv[++i]);
+        }
+        else if(strcmp(arg, "--batch") == 0)
+        {
+            options.batch = true;
+            options.headless = true;
+        }
+        else if(strcmp(arg, "--frames") == 0 && hasValue)
+        {
+            options.frames = atoi(argv[++i]);
+        }
+        else if(strcmp(arg, "--output") == 0 && hasValue)
+        {
+            options.output = argv[++i];
+        }
+        else if(strcmp(arg, "--shaders") == 0)
+        {
+            options.shader_variants = true;
+        }
+        else if(strcmp(arg, "--instancing") == 0)
+        {
+            options.instancing = true;
+            options.shader_variants = true;
+        }
+        else if(strcmp(arg, "--indirect") == 0)
+        {
+            options.indirect = true;
+            options.shader_variants = true;
+        }
+        else if(strcmp(arg, "--on-demand") == 0)
+        {
+            options.on_demand = true;
+        }
+        else if(strcmp(arg, "--max-fps") == 0 && hasValue)
+        {
+            options.max_fps = atof(argv[++i]);
+        }
+        else if(strcmp(arg, "--watch") == 0)
+        {
+            options.watch = true;
+        }
+        else if(strcmp(arg, "--target-ms") == 0 && hasValue)
+        {
+            options.target_ms = atof(argv[++i]);
+        }
+        else if(strcmp(arg, "--min-scale") == 0 && hasValue)
+        {
+            options.min_scale = atof(argv[++i]);
+        }
+        else if(strcmp(arg, "--gpu-cull") == 0)
+        {
+            options.gpu_culling = true;
+            options.indirect = true;
+            options.shader_variants = true;
+        }
+        else if(strcmp(arg, "--frustum-cull") == 0)
+        {
+            options.frustum_culling = true;
+        }
+        else if(strcmp(arg, "--min-pixels") == 0 && hasValue)
+        {
+            options.min_pixels = atof(argv[++i]);
+        }
+        else if(strcmp(arg, "--impostors") == 0)
+        {
+            options.impostors = true;
+        }
+        else if(strcmp(arg, "--occlusion-cull") == 0)
+        {
+            options.occlusion_culling = true;
+        }
+        else if(strcmp(arg, "--occlusion-recheck") == 0 && hasValue)
+        {
+            options.occlusion_recheck = atoi(argv[++i]);
+        }
+        else if(strcmp(arg, "--hiz-cull") == 0)
+        {
+            options.hiz_culling = true;
+        }
+        else if(strcmp(arg, "--occluders") == 0 && hasValue)
+        {
+            options.occluders = atoi(argv[++i]);
+        }
+        else if(strcmp(arg, "--threads") == 0 && hasValue)
+        {
+            options.threads = atoi(argv[++i]);
+        }
+        else if(strcmp(arg, "--vertex-cache") == 0)
+        {
+            options.vertex_cache = true;
+        }
+        else if(strcmp(arg, "--overdraw-order") == 0)
+        {
+            options.overdraw_order = true;
+        }
+        else if(strcmp(arg, "--measure-overdraw") == 0)
+        {
+            options.measure_overdraw = true;
+        }
+        else if(strcmp(arg, "--depth-prepass") == 0 && hasValue)
+        {
+            const char* mode = argv[++i];
+            if(strcmp(mode, "off") == 0)
+                options.depth_prepass = PREPASS_OFF;
+            else if(strcmp(mode, "on") == 0)
+                options.depth_prepass = PREPASS_ON;
+            else if(strcmp(mode, "auto") == 0)
+                options.depth_prepass = PREPASS_AUTO;
+            else
+            {
+                fprintf(stderr, "Error: --depth-prepass takes off, on or auto, not %s\n", mode);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(arg, "--prepass-overdraw") == 0 && hasValue)
+        {
+            options.prepass_overdraw = (float)atof(argv[++i]);
+        }
+        else if(strcmp(arg, "--lod") == 0)
+        {
+            options.lod = true;
+        }
+        else if(strcmp(arg, "--lod-error") == 0 && hasValue)
+        {
+            options.lod_error = (float)atof(argv[++i]);
+        }
+        else if(strcmp(arg, "--shader-cache") == 0 && hasValue)
+        {
+            options.shader_cache_dir = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Error: unknown option %s\n", arg);
+            printUsage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef __HW3__OPTIONS__
+#define __HW3__OPTIONS__
+
+#include <string>
+
+enum PrepassMode
+{
+    PREPASS_OFF = 0,
+    PREPASS_ON = 1,
+    PREPASS_AUTO = 2    // on while the measured overdraw is above prepass_overdraw
+};
+
+// Auto mode measures the overdraw of a frame drawn without the pre-pass
+// once every this many frames.
+#define PREPASS_PROBE_FRAMES 120
+
+// Tiles of a poster larger than the driver's framebuffers, without --poster.
+#define POSTER_TILE_SIZE 2048
+
+// --watch checks the scene file's modification time this often, in seconds.
+#define WATCH_INTERVAL 0.5
+
+// Command line switches that follow the scene file:
+//     hw3 <scene.xml> [options]
+//     hw3 <jobs.txt> --batch [options]
+struct Options
+{
+    // --headless : render offscreen through EGL, without a window, and write
+    // the last frame to --output
+    bool headless = false;
+    // --software : rasterize on the CPU, without a GL context, and write the
+    // last frame to --output like --headless
+    bool software = false;
+    // --vertex-benchmark : time the vertex transform and lighting kernels
+    // on the scene's vertices and exit
+    bool vertex_benchmark = false;
+    // --sort-last <n> : split the meshes over n software workers that render
+    // into their own buffers, then depth composite them (implies --software)
+    int sort_last = 0;
+    // --raster-benchmark : time --frames software frames with the specialized
+    // raster kernels against runtime-branching ones (implies --software)
+    bool raster_benchmark = false;
+    // --raytrace : trace the scene on the CPU through a BVH, with hard
+    // shadows, and write the last frame to --output like --headless
+    bool raytrace = false;
+    // --distribute <n> : split the image into tiles rendered by n worker
+    // processes, headless or --software, and assemble them into --output
+    int distribute = 0;
+    // --tile-size <px> : side of the tiles --distribute hands out
+    int tile_size = 256;
+    // --worker <socket> : render the tiles the coordinator at socket sends;
+    // passed by --distribute to the processes it starts
+    std::string worker;
+    // --scene-cache <file> : load the scene from a cache --distribute wrote
+    // instead of the XML file
+    std::string scene_cache;
+    // --poster <px> : draw the headless image in tiles of px pixels streamed
+    // to --output a band at a time; 0 for only when it exceeds what the
+    // driver can draw at once
+    int poster = 0;
+    // --capture <pattern> : write every headless frame, read back
+    // asynchronously, to pattern with one %d, like frames/%04d.png, or as
+    // raw RGB24 video to stdout for "-" (implies --headless)
+    std::string capture;
+    // --turntable <degrees> : turn the camera this much around the scene's
+    // center every headless frame
+    float turntable = 0.0f;
+    // --batch : the file in place of the scene lists jobs, one per line, of
+    // a scene, an output file and camera overrides, all drawn headless in
+    // one context (implies --headless)
+    bool batch = false;
+    // --frames <n> : frames drawn in headless mode
+    int frames = 1;
+    // --output <file> : image written by headless mode, PNG for .png, PPM otherwise
+    std::string output = "output.ppm";
+    // --on-demand : redraw only after input, a resize or a reload instead of
+    // continuously, and sleep in glfwWaitEvents in between
+    bool on_demand = false;
+    // --max-fps <n> : cap on frames drawn per second, 0 for none
+    float max_fps = 0.0f;
+    // --watch : reload the scene when its file changes
+    bool watch = false;
+    // --target-ms <ms> : draw into an offscreen framebuffer whose resolution
+    // follows the frame time, upscaled to the window; 0 for off
+    float target_ms = 0.0f;
+    // --min-scale <s> : lowest fraction of the camera resolution it may use
+    float min_scale = 0.5f;
+    // --shaders : draw with specialized GLSL programs instead of fixed function
+    bool shader_variants = false;
+    // --shader-cache <dir> : where compiled program binaries are kept between runs
+    std::string shader_cache_dir = ".hw3_cache";
+    // --instancing : draw meshes sharing a face list with one instanced call (implies --shaders)
+    bool instancing = false;
+    // --indirect : pack the scene into shared buffers and draw it with
+    // glMultiDrawElementsIndirect, one call per state bucket (implies --shaders)
+    bool indirect = false;
+    // --gpu-cull : frustum and level of detail selection in a compute shader
+    // that writes the indirect commands (implies --indirect)
+    bool gpu_culling = false;
+    // --frustum-cull : skip meshes whose bounds are outside the camera frustum
+    bool frustum_culling = false;
+    // --min-pixels <n> : skip meshes whose bounding sphere covers fewer pixels
+    float min_pixels = 0.0f;
+    // --impostors : draw meshes skipped by --min-pixels as single points
+    bool impostors = false;
+    // --occlusion-cull : skip meshes whose bounding box query found them hidden
+    bool occlusion_culling = false;
+    // --occlusion-recheck <frames> : how often a visible mesh is queried again
+    int occlusion_recheck = 8;
+    // --hiz-cull : rasterize the largest meshes on the CPU and skip meshes
+    // hidden behind them before anything is submitted
+    bool hiz_culling = false;
+    // --occluders <n> : meshes rasterized as occluders per frame
+    int occluders = 8;
+    // --threads <n> : threads for CPU side passes, 0 for one per hardware thread
+    int threads = 0;
+    // --vertex-cache : reorder faces for post-transform vertex cache reuse at load
+    bool vertex_cache = false;
+    // --overdraw-order : sort face clusters so outer ones draw first
+    bool overdraw_order = false;
+    // --measure-overdraw : count shaded fragments per covered pixel every frame
+    bool measure_overdraw = false;
+    // --depth-prepass <off|on|auto> : lay down depth with color writes off first,
+    // then shade with GL_LEQUAL so every visible pixel is lit once
+    PrepassMode depth_prepass = PREPASS_OFF;
+    // --prepass-overdraw <ratio> : overdraw above which auto turns the pre-pass on
+    float prepass_overdraw = 1.5f;
+    // --lod : draw distant meshes from simplified levels of detail
+    bool lod = false;
+    // --lod-error <pixels> : largest projected simplification error a level may show
+    float lod_error = 1.0f;
+};
+
+extern Options options;
+
+void printUsage(const char* program);
+void parseOptions(int argc, char* argv[]);
+
+#endif
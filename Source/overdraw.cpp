@@ -0,0 +1,39 @@
+#include "overdraw.h"
+#include <vector>
+
+static GLuint query = 0;
+static std::vector<GLfloat> depths;
+
+void beginOverdrawMeasure()
+{
+    if(!query)
+        glGenQueries(1, &query);
+    glBeginQuery(GL_SAMPLES_PASSED, query);
+}
+
+OverdrawStats endOverdrawMeasure(int width, int height)
+{
+    OverdrawStats stats = { 0, 0, 0.0f };
+    glEndQuery(GL_SAMPLES_PASSED);
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &stats.fragments);
+
+    // covered pixels are the ones whose depth moved off the clear value
+    depths.resize((size_t)width * height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, &depths[0]);
+    int dSize = depths.size();
+    for(int i = 0; i<dSize; i++)
+    {
+        if(depths[i] < 1.0f)
+            stats.pixels++;
+    }
+    stats.ratio = stats.pixels ? (float)stats.fragments / stats.pixels : 0.0f;
+    return stats;
+}
+
+void releaseOverdrawMeasure()
+{
+    if(query)
+        glDeleteQueries(1, &query);
+    query = 0;
+}
@@ -0,0 +1,22 @@
+#ifndef __HW3__OVERDRAW__
+#define __HW3__OVERDRAW__
+
+#include <GL/glew.h>
+
+// Fragments that passed the depth test per pixel the scene covers. 1 means
+// every covered pixel was shaded once; anything above is wasted shading.
+struct OverdrawStats
+{
+    GLuint fragments;
+    int pixels;
+    float ratio;
+};
+
+// Brackets the scene's draw calls with a GL_SAMPLES_PASSED query. The end
+// waits for the query and reads the depth buffer back, so it is meant for
+// measuring, not for every frame of normal rendering.
+void beginOverdrawMeasure();
+OverdrawStats endOverdrawMeasure(int width, int height);
+void releaseOverdrawMeasure();
+
+#endif
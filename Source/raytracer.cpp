@@ -0,0 +1,804 @@
+#include "raytracer.h"
+#include "shaders.h"
+#include "threadpool.h"
+#include "transform.h"
+#include "vertexkernels.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#if defined(__SSE2__)
+#define RAY_TRAVERSAL_SSE 1
+#include <emmintrin.h>
+#endif
+
+// Surface area heuristic cost of visiting a node, in triangle tests.
+#define RAY_SAH_TRAVERSAL 1.0f
+// Below this depth splits follow the heuristic; deeper nodes are halved at
+// the object median, so no scene can grow the tree past the ray stack.
+#define RAY_BVH_MAX_DEPTH 48
+#define RAY_STACK_SIZE 256
+// Scenes smaller than this are built on one thread.
+#define RAY_PARALLEL_MIN 4096
+// Subtrees handed to the pool per thread after the top levels.
+#define RAY_SUBTREES_PER_THREAD 8
+
+// A triangle in eye space as the intersection test takes it, in leaf order.
+struct RayTriangle
+{
+    float v0[3], e1[3], e2[3];
+    int mesh;
+};
+
+// Kept apart from RayTriangle so traversal touches less memory.
+struct RayTriangleNormals
+{
+    float n[3][3];
+};
+
+// Four children tested together. A child is an inner node when its count
+// is 0 and its index is set, a leaf of count triangles from index on, or an
+// empty slot with index -1 and a box no ray reaches.
+struct RayBVHNode
+{
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+    int child[4];
+    int count[4];
+};
+
+struct Box
+{
+    float min[3], max[3];
+};
+
+// Build input of one triangle. The build partitions these themselves, so
+// its passes read them in order.
+struct PrimitiveBox
+{
+    Box box;
+    float center[3];
+    int triangle;
+};
+
+struct Bin
+{
+    Box box;
+    int count;
+};
+
+// A binary node over the triangles [first, first + count) of buildBoxes.
+struct BuildNode
+{
+    Box box;
+    int left, right;    // -1 for leaves
+    int first, count;
+};
+
+// A node whose subtree is built on the pool after the top levels.
+struct DeferredSubtree
+{
+    int node;
+    int depth;
+};
+
+struct RayHit
+{
+    int triangle;
+    float u, v;
+};
+
+static std::vector<RayTriangle> triangles;
+static std::vector<RayTriangleNormals> triangleNormals;
+static std::vector<RayBVHNode> nodes;
+static std::vector<MeshKind> meshKinds;
+static std::vector<MaterialSetup> meshMaterials;
+static std::vector<PrimitiveBox> buildBoxes;
+
+static inline void emptyBox(Box& box)
+{
+    for(int a = 0; a<3; a++)
+    {
+        box.min[a] = FLT_MAX;
+        box.max[a] = -FLT_MAX;
+    }
+}
+
+static inline void growBox(Box& box, const Box& other)
+{
+    for(int a = 0; a<3; a++)
+    {
+        box.min[a] = std::min(box.min[a], other.min[a]);
+        box.max[a] = std::max(box.max[a], other.max[a]);
+    }
+}
+
+static inline void growBox(Box& box, const float point[3])
+{
+    for(int a = 0; a<3; a++)
+    {
+        box.min[a] = std::min(box.min[a], point[a]);
+        box.max[a] = std::max(box.max[a], point[a]);
+    }
+}
+
+static inline float boxArea(const Box& box)
+{
+    float x = box.max[0] - box.min[0];
+    float y = box.max[1] - box.min[1];
+    float z = box.max[2] - box.min[2];
+    if(x < 0.0f || y < 0.0f || z < 0.0f)
+        return 0.0f;
+    return x * y + y * z + z * x;
+}
+
+static inline int binOf(float center, float low, float scale, int bins)
+{
+    int bin = (int)((center - low) * scale);
+    return std::min(std::max(bin, 0), bins - 1);
+}
+
+static void boundsOf(int begin, int end, Box& bounds, Box& centers)
+{
+    emptyBox(bounds);
+    emptyBox(centers);
+    for(int i = begin; i<end; i++)
+    {
+        const PrimitiveBox& primitive = buildBoxes[i];
+        growBox(bounds, primitive.box);
+        growBox(centers, primitive.center);
+    }
+}
+
+// bins holds 3 x RAY_BVH_BINS entries, one row per axis, of which the
+// first binCount are used.
+static void binsOf(int begin, int end, const float low[3], const float scale[3], int binCount, Bin* bins)
+{
+    for(int b = 0; b<3 * RAY_BVH_BINS; b++)
+    {
+        emptyBox(bins[b].box);
+        bins[b].count = 0;
+    }
+    for(int i = begin; i<end; i++)
+    {
+        const PrimitiveBox& primitive = buildBoxes[i];
+        for(int a = 0; a<3; a++)
+        {
+            Bin& bin = bins[a * RAY_BVH_BINS + binOf(primitive.center[a], low[a], scale[a], binCount)];
+            growBox(bin.box, primitive.box);
+            bin.count++;
+        }
+    }
+}
+
+// The top levels: the range is cut into chunks binned on the pool, and the
+// chunks' results merged.
+static int chunkCount(int count)
+{
+    return std::max(1, std::min(count, threadCount() * 4));
+}
+
+static void rangeBounds(int first, int count, bool parallel, Box& bounds, Box& centers)
+{
+    if(!parallel)
+    {
+        boundsOf(first, first + count, bounds, centers);
+        return;
+    }
+    int chunks = chunkCount(count);
+    std::vector<Box> chunkBounds(chunks), chunkCenters(chunks);
+    parallelFor(chunks, [&](int k)
+    {
+        boundsOf(first + (int)((long long)count * k / chunks), first + (int)((long long)count * (k + 1) / chunks), chunkBounds[k], chunkCenters[k]);
+    });
+    emptyBox(bounds);
+    emptyBox(centers);
+    for(int k = 0; k<chunks; k++)
+    {
+        growBox(bounds, chunkBounds[k]);
+        growBox(centers, chunkCenters[k]);
+    }
+}
+
+static void binRange(int first, int count, bool parallel, const float low[3], const float scale[3], int binCount, Bin bins[3][RAY_BVH_BINS])
+{
+    if(!parallel)
+    {
+        binsOf(first, first + count, low, scale, binCount, bins[0]);
+        return;
+    }
+    int chunks = chunkCount(count);
+    std::vector<Bin> chunkBins(chunks * 3 * RAY_BVH_BINS);
+    parallelFor(chunks, [&](int k)
+    {
+        binsOf(first + (int)((long long)count * k / chunks), first + (int)((long long)count * (k + 1) / chunks), low, scale, binCount, &chunkBins[k * 3 * RAY_BVH_BINS]);
+    });
+    binsOf(0, 0, low, scale, binCount, bins[0]);
+    for(int k = 0; k<chunks; k++)
+    {
+        for(int b = 0; b<3 * RAY_BVH_BINS; b++)
+        {
+            growBox(bins[0][b].box, chunkBins[k * 3 * RAY_BVH_BINS + b].box);
+            bins[0][b].count += chunkBins[k * 3 * RAY_BVH_BINS + b].count;
+        }
+    }
+}
+
+// Builds the subtree of nodes[index], whose first and count are set. With
+// deferred, children of at most subtreeSize triangles are left for the pool.
+static void buildNode(std::vector<BuildNode>& tree, int index, int depth, bool parallel,
+    std::vector<DeferredSubtree>* deferred, int subtreeSize)
+{
+    BuildNode node = tree[index];
+    Box centers;
+    rangeBounds(node.first, node.count, parallel, node.box, centers);
+    node.left = node.right = -1;
+    tree[index] = node;
+    if(node.count <= RAY_BVH_MIN_LEAF)
+        return;
+
+    // small nodes have few places worth splitting at
+    int binCount = std::min(RAY_BVH_BINS, std::max(4, node.count));
+    float low[3], scale[3];
+    for(int a = 0; a<3; a++)
+    {
+        float extent = centers.max[a] - centers.min[a];
+        low[a] = centers.min[a];
+        scale[a] = extent > 0.0f ? binCount / extent : 0.0f;
+    }
+    int axis = -1;
+    int split = 0;
+    float bestCost = FLT_MAX;
+    float area = boxArea(node.box);
+    if(depth < RAY_BVH_MAX_DEPTH && area > 0.0f)
+    {
+        Bin bins[3][RAY_BVH_BINS];
+        binRange(node.first, node.count, parallel, low, scale, binCount, bins);
+        for(int a = 0; a<3; a++)
+        {
+            if(scale[a] == 0.0f)
+                continue;
+            // areas and counts left of every boundary, then right of it
+            float leftArea[RAY_BVH_BINS], leftCount[RAY_BVH_BINS];
+            Box box;
+            emptyBox(box);
+            int count = 0;
+            for(int b = 0; b<binCount - 1; b++)
+            {
+                growBox(box, bins[a][b].box);
+                count += bins[a][b].count;
+                leftArea[b] = boxArea(box);
+                leftCount[b] = count;
+            }
+            emptyBox(box);
+            count = 0;
+            for(int b = binCount - 1; b>0; b--)
+            {
+                growBox(box, bins[a][b].box);
+                count += bins[a][b].count;
+                if(leftCount[b - 1] == 0 || count == 0)
+                    continue;
+                float cost = RAY_SAH_TRAVERSAL + (leftArea[b - 1] * leftCount[b - 1] + boxArea(box) * count) / area;
+                if(cost < bestCost)
+                {
+                    bestCost = cost;
+                    axis = a;
+                    split = b;
+                }
+            }
+        }
+    }
+
+    PrimitiveBox* boxes = &buildBoxes[0];
+    int middle;
+    if(axis >= 0 && (bestCost < node.count || node.count > RAY_BVH_MAX_LEAF))
+    {
+        float splitLow = low[axis], splitScale = scale[axis];
+        middle = std::partition(boxes + node.first, boxes + node.first + node.count, [&](const PrimitiveBox& primitive)
+        {
+            return binOf(primitive.center[axis], splitLow, splitScale, binCount) < split;
+        }) - boxes;
+    }
+    else if(node.count > RAY_BVH_MAX_LEAF)
+    {
+        // centroids that no bin boundary separates, or a tree this deep:
+        // halves at the median of the widest centroid axis
+        int widest = 0;
+        for(int a = 1; a<3; a++)
+            if(centers.max[a] - centers.min[a] > centers.max[widest] - centers.min[widest])
+                widest = a;
+        middle = node.first + node.count / 2;
+        std::nth_element(boxes + node.first, boxes + middle, boxes + node.first + node.count, [&](const PrimitiveBox& a, const PrimitiveBox& b)
+        {
+            return a.center[widest] < b.center[widest];
+        });
+    }
+    else
+    {
+        return;
+    }
+
+    BuildNode left = { node.box, -1, -1, node.first, middle - node.first };
+    BuildNode right = { node.box, -1, -1, middle, node.first + node.count - middle };
+    int leftIndex = tree.size();
+    tree.push_back(left);
+    tree.push_back(right);
+    tree[index].left = leftIndex;
+    tree[index].right = leftIndex + 1;
+    for(int c = 0; c<2; c++)
+    {
+        int child = leftIndex + c;
+        if(deferred && tree[child].count <= subtreeSize)
+        {
+            DeferredSubtree subtree = { child, depth + 1 };
+            deferred->push_back(subtree);
+        }
+        else
+        {
+            buildNode(tree, child, depth + 1, parallel, deferred, subtreeSize);
+        }
+    }
+}
+
+// Turns a binary subtree into 4-wide nodes: the inner child with the
+// largest surface is replaced by its children until there are four.
+static int collapseNode(const std::vector<BuildNode>& tree, int index, int& leaves)
+{
+    int slot = nodes.size();
+    nodes.push_back(RayBVHNode());
+    int children[4];
+    int count = 0;
+    if(tree[index].left < 0)
+    {
+        children[count++] = index;
+    }
+    else
+    {
+        children[count++] = tree[index].left;
+        children[count++] = tree[index].right;
+    }
+    while(count < 4)
+    {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for(int i = 0; i<count; i++)
+        {
+            if(tree[children[i]].left >= 0 && boxArea(tree[children[i]].box) > largestArea)
+            {
+                largest = i;
+                largestArea = boxArea(tree[children[i]].box);
+            }
+        }
+        if(largest < 0)
+            break;
+        int opened = children[largest];
+        children[largest] = tree[opened].left;
+        children[count++] = tree[opened].right;
+    }
+
+    RayBVHNode node;
+    for(int i = 0; i<4; i++)
+    {
+        // a point far out on every axis: each slab test puts both of its
+        // distances there, out of any ray's range
+        Box box = { { FLT_MAX, FLT_MAX, FLT_MAX }, { FLT_MAX, FLT_MAX, FLT_MAX } };
+        node.child[i] = -1;
+        node.count[i] = 0;
+        if(i < count)
+        {
+            const BuildNode& child = tree[children[i]];
+            box = child.box;
+            if(child.left < 0)
+            {
+                node.child[i] = child.first;
+                node.count[i] = child.count;
+                leaves++;
+            }
+            else
+            {
+                node.child[i] = collapseNode(tree, children[i], leaves);
+            }
+        }
+        node.min_x[i] = box.min[0];
+        node.min_y[i] = box.min[1];
+        node.min_z[i] = box.min[2];
+        node.max_x[i] = box.max[0];
+        node.max_y[i] = box.max[1];
+        node.max_z[i] = box.max[2];
+    }
+    nodes[slot] = node;
+    return slot;
+}
+
+static void buildTriangles(const parser::Scene& scene, const std::vector<parser::Vec3f>& normals)
+{
+    mat4x4 view, projection;
+    cameraViewMatrix(scene.camera, view);
+    cameraProjectionMatrix(scene.camera, projection);
+    int meshes = scene.meshes.size();
+    std::vector<int> offsets(meshes + 1, 0);
+    meshKinds.resize(meshes);
+    meshMaterials.resize(meshes);
+    for(int m = 0; m<meshes; m++)
+    {
+        offsets[m + 1] = offsets[m] + scene.meshFaces(scene.meshes[m]).size();
+        meshKinds[m] = meshKindOf(scene.meshes[m]);
+        materialSetupFor(scene, scene.meshes[m], meshMaterials[m]);
+    }
+    triangles.resize(offsets[meshes]);
+    triangleNormals.resize(offsets[meshes]);
+    buildBoxes.resize(offsets[meshes]);
+
+    parallelFor(meshes, [&](int m)
+    {
+        const parser::Mesh& mesh = scene.meshes[m];
+        VertexTransform transform;
+        vertexTransformFor(scene, mesh, view, projection, transform);
+        const std::vector<parser::Face>& faces = scene.meshFaces(mesh);
+        int fSize = faces.size();
+        for(int f = 0; f<fSize; f++)
+        {
+            int ids[3] = { faces[f].v0_id - 1, faces[f].v1_id - 1, faces[f].v2_id - 1 };
+            float P[3][3];
+            RayTriangleNormals& triangleNormal = triangleNormals[offsets[m] + f];
+            for(int k = 0; k<3; k++)
+            {
+                const parser::Vec3f& v = scene.vertex_data[ids[k]];
+                const parser::Vec3f& n = normals[ids[k]];
+                float* N = triangleNormal.n[k];
+                for(int r = 0; r<3; r++)
+                {
+                    P[k][r] = transform.model_view[0][r] * v.x + transform.model_view[1][r] * v.y + transform.model_view[2][r] * v.z + transform.model_view[3][r];
+                    N[r] = transform.normal_matrix[0][r] * n.x + transform.normal_matrix[1][r] * n.y + transform.normal_matrix[2][r] * n.z;
+                }
+                float length = sqrtf(N[0] * N[0] + N[1] * N[1] + N[2] * N[2]);
+                if(length > 0.0f)
+                    for(int r = 0; r<3; r++)
+                        N[r] /= length;
+            }
+            RayTriangle& triangle = triangles[offsets[m] + f];
+            PrimitiveBox& primitive = buildBoxes[offsets[m] + f];
+            emptyBox(primitive.box);
+            for(int r = 0; r<3; r++)
+            {
+                triangle.v0[r] = P[0][r];
+                triangle.e1[r] = P[1][r] - P[0][r];
+                triangle.e2[r] = P[2][r] - P[0][r];
+                primitive.center[r] = (P[0][r] + P[1][r] + P[2][r]) / 3.0f;
+            }
+            for(int k = 0; k<3; k++)
+                growBox(primitive.box, P[k]);
+            triangle.mesh = m;
+            primitive.triangle = offsets[m] + f;
+        }
+    });
+}
+
+RayBuildStats initRayTracer(const parser::Scene& scene, const std::vector<parser::Vec3f>& normals)
+{
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    buildTriangles(scene, normals);
+    int count = triangles.size();
+    RayBuildStats stats = { count, 0, 0, 0, 0.0f };
+    nodes.clear();
+    if(count == 0)
+        return stats;
+
+    std::vector<BuildNode> tree;
+    BuildNode root = { { { 0, 0, 0 }, { 0, 0, 0 } }, -1, -1, 0, count };
+    tree.push_back(root);
+    if(count < RAY_PARALLEL_MIN)
+    {
+        buildNode(tree, 0, 0, false, NULL, 0);
+    }
+    else
+    {
+        // the top levels split with parallel binning, and hand the subtrees
+        // below them to the pool, each built into its own node list
+        std::vector<DeferredSubtree> deferred;
+        int subtreeSize = std::max(RAY_BVH_MAX_LEAF, count / (threadCount() * RAY_SUBTREES_PER_THREAD));
+        buildNode(tree, 0, 0, true, &deferred, subtreeSize);
+        int subtrees = deferred.size();
+        std::vector<std::vector<BuildNode> > local(subtrees);
+        parallelFor(subtrees, [&](int s)
+        {
+            local[s].push_back(tree[deferred[s].node]);
+            buildNode(local[s], 0, deferred[s].depth, false, NULL, 0);
+        });
+        for(int s = 0; s<subtrees; s++)
+        {
+            // local node k > 0 lands at base + k - 1; the root replaces its placeholder
+            int base = tree.size() - 1;
+            int lSize = local[s].size();
+            for(int k = 0; k<lSize; k++)
+            {
+                BuildNode node = local[s][k];
+                if(node.left >= 0)
+                {
+                    node.left += base;
+                    node.right += base;
+                }
+                if(k == 0)
+                    tree[deferred[s].node] = node;
+                else
+                    tree.push_back(node);
+            }
+        }
+        stats.subtrees = subtrees;
+    }
+    collapseNode(tree, 0, stats.leaves);
+    stats.nodes = nodes.size();
+
+    // triangles in leaf order, so a leaf reads one contiguous run
+    std::vector<RayTriangle> ordered(count);
+    std::vector<RayTriangleNormals> orderedNormals(count);
+    for(int i = 0; i<count; i++)
+    {
+        ordered[i] = triangles[buildBoxes[i].triangle];
+        orderedNormals[i] = triangleNormals[buildBoxes[i].triangle];
+    }
+    triangles.swap(ordered);
+    triangleNormals.swap(orderedNormals);
+    std::vector<PrimitiveBox>().swap(buildBoxes);
+    stats.build_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+// Moller-Trumbore. det is positive for triangles counter-clockwise as the
+// ray sees them, which glFrontFace(GL_CCW) calls front facing.
+static inline bool intersectTriangle(const RayTriangle& triangle, const float o[3], const float d[3], CullMode cull,
+    float tMin, float tMax, float& t, float& u, float& v)
+{
+    const float* e1 = triangle.e1;
+    const float* e2 = triangle.e2;
+    float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+    float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if(det == 0.0f || (cull == CULL_BACK && det < 0.0f) || (cull == CULL_FRONT && det > 0.0f))
+        return false;
+    float inverse = 1.0f / det;
+    float s[3] = { o[0] - triangle.v0[0], o[1] - triangle.v0[1], o[2] - triangle.v0[2] };
+    u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+    if(u < 0.0f || u > 1.0f)
+        return false;
+    float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+    v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inverse;
+    if(v < 0.0f || u + v > 1.0f)
+        return false;
+    t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse;
+    return t > tMin && t < tMax;
+}
+
+static float edgeDistance(const float P[3], const float from[3], const float edge[3])
+{
+    float w[3] = { P[0] - from[0], P[1] - from[1], P[2] - from[2] };
+    float c[3] = { w[1] * edge[2] - w[2] * edge[1], w[2] * edge[0] - w[0] * edge[2], w[0] * edge[1] - w[1] * edge[0] };
+    float length = edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2];
+    return length > 0.0f ? sqrtf((c[0] * c[0] + c[1] * c[1] + c[2] * c[2]) / length) : 0.0f;
+}
+
+// GL_LINE polygons: the hit counts when it is within lineWidth of an edge.
+static bool onEdge(const RayTriangle& triangle, const float P[3], float lineWidth)
+{
+    float v1[3] = { triangle.v0[0] + triangle.e1[0], triangle.v0[1] + triangle.e1[1], triangle.v0[2] + triangle.e1[2] };
+    float e12[3] = { triangle.e2[0] - triangle.e1[0], triangle.e2[1] - triangle.e1[1], triangle.e2[2] - triangle.e1[2] };
+    return edgeDistance(P, triangle.v0, triangle.e1) < lineWidth || edgeDistance(P, triangle.v0, triangle.e2) < lineWidth ||
+        edgeDistance(P, v1, e12) < lineWidth;
+}
+
+struct StackEntry
+{
+    int child, count;
+    float near;
+};
+
+// Closest hit in (tMin, tMax), or with anyHit the first one found. The ray
+// is origin + t dir. Wireframe triangles hit within lineScale * t of an
+// edge, and never when lineScale is negative.
+static bool traceRay(const float o[3], const float d[3], float tMin, float& tMax, bool anyHit, CullMode cull, float lineScale, RayHit* hit)
+{
+    if(nodes.empty())
+        return false;
+    float inverse[3];
+    for(int a = 0; a<3; a++)
+        inverse[a] = 1.0f / (fabsf(d[a]) > 1e-20f ? d[a] : (d[a] < 0.0f ? -1e-20f : 1e-20f));
+#if RAY_TRAVERSAL_SSE
+    __m128 ox = _mm_set1_ps(o[0]), oy = _mm_set1_ps(o[1]), oz = _mm_set1_ps(o[2]);
+    __m128 ix = _mm_set1_ps(inverse[0]), iy = _mm_set1_ps(inverse[1]), iz = _mm_set1_ps(inverse[2]);
+#endif
+    StackEntry stack[RAY_STACK_SIZE];
+    int top = 0;
+    StackEntry root = { 0, 0, tMin };
+    stack[top++] = root;
+    bool found = false;
+    while(top > 0)
+    {
+        StackEntry entry = stack[--top];
+        if(entry.near > tMax)
+            continue;
+        if(entry.count > 0)
+        {
+            for(int i = entry.child; i<entry.child + entry.count; i++)
+            {
+                const RayTriangle& triangle = triangles[i];
+                float t, u, v;
+                if(!intersectTriangle(triangle, o, d, cull, tMin, tMax, t, u, v))
+                    continue;
+                if(meshKinds[triangle.mesh] == MESH_WIREFRAME)
+                {
+                    float P[3] = { o[0] + d[0] * t, o[1] + d[1] * t, o[2] + d[2] * t };
+                    if(lineScale < 0.0f || !onEdge(triangle, P, lineScale * t))
+                        continue;
+                }
+                tMax = t;
+                found = true;
+                if(anyHit)
+                    return true;
+                hit->triangle = i;
+                hit->u = u;
+                hit->v = v;
+            }
+            continue;
+        }
+
+        const RayBVHNode& node = nodes[entry.child];
+        float nears[4];
+        int mask = 0;
+#if RAY_TRAVERSAL_SSE
+        __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min_x), ox), ix);
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max_x), ox), ix);
+        __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min_y), oy), iy);
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max_y), oy), iy);
+        __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min_z), oz), iz);
+        __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max_z), oz), iz);
+        __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_set1_ps(tMin)));
+        __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(tMax)));
+        mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+        _mm_storeu_ps(nears, tNear);
+#else
+        for(int i = 0; i<4; i++)
+        {
+            float tx0 = (node.min_x[i] - o[0]) * inverse[0], tx1 = (node.max_x[i] - o[0]) * inverse[0];
+            float ty0 = (node.min_y[i] - o[1]) * inverse[1], ty1 = (node.max_y[i] - o[1]) * inverse[1];
+            float tz0 = (node.min_z[i] - o[2]) * inverse[2], tz1 = (node.max_z[i] - o[2]) * inverse[2];
+            float tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), tMin));
+            float tFar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tMax));
+            nears[i] = tNear;
+            if(tNear <= tFar)
+                mask |= 1 << i;
+        }
+#endif
+        // nearest child on top of the stack
+        StackEntry children[4];
+        int count = 0;
+        for(int i = 0; i<4; i++)
+        {
+            if(!(mask >> i & 1) || node.child[i] < 0)
+                continue;
+            StackEntry child = { node.child[i], node.count[i], nears[i] };
+            int at = count++;
+            while(at > 0 && children[at - 1].near < child.near)
+            {
+                children[at] = children[at - 1];
+                at--;
+            }
+            children[at] = child;
+        }
+        for(int i = 0; i<count && top < RAY_STACK_SIZE; i++)
+            stack[top++] = children[i];
+    }
+    return found;
+}
+
+RayStats renderRayTraced(const parser::Scene& scene, std::vector<unsigned char>& rgb)
+{
+    const parser::Camera& camera = scene.camera;
+    int width = camera.image_width;
+    int height = camera.image_height;
+    rgb.resize((size_t)width * height * 3);
+    int tilesX = (width + RAY_TILE_SIZE - 1) / RAY_TILE_SIZE;
+    int tilesY = (height + RAY_TILE_SIZE - 1) / RAY_TILE_SIZE;
+    std::vector<long long> primary(tilesX * tilesY, 0), shadow(tilesX * tilesY, 0);
+
+    LightingSetup lighting;
+    lightingSetupFor(scene, lighting);
+    CullMode cull = cullModeOf(scene);
+    // the primary ray of a pixel reaches the near plane at t = 1 and the far
+    // plane at far / near; a pixel there is spanX x spanY
+    float spanX = (camera.near_plane.y - camera.near_plane.x) / width;
+    float spanY = (camera.near_plane.w - camera.near_plane.z) / height;
+    float lineScale = 0.5f * std::max(fabsf(spanX), fabsf(spanY));
+    float tFar = camera.far_distance / camera.near_distance;
+    unsigned char background[3];
+    int backgroundColor[3] = { scene.background_color.x, scene.background_color.y, scene.background_color.z };
+    for(int c = 0; c<3; c++)
+        background[c] = std::min(std::max(backgroundColor[c], 0), 1) * 255;
+
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    parallelFor(tilesX * tilesY, [&](int tile)
+    {
+        int x0 = tile % tilesX * RAY_TILE_SIZE;
+        int y0 = tile / tilesX * RAY_TILE_SIZE;
+        int x1 = std::min(x0 + RAY_TILE_SIZE, width);
+        int y1 = std::min(y0 + RAY_TILE_SIZE, height);
+        const float eye[3] = { 0.0f, 0.0f, 0.0f };
+        for(int y = y0; y<y1; y++)
+        {
+            for(int x = x0; x<x1; x++)
+            {
+                unsigned char* pixel = &rgb[((size_t)y * width + x) * 3];
+                float d[3] = { camera.near_plane.x + spanX * (x + 0.5f), camera.near_plane.z + spanY * (height - 1 - y + 0.5f), -camera.near_distance };
+                float t = tFar;
+                RayHit hit;
+                primary[tile]++;
+                if(!traceRay(eye, d, 1.0f, t, false, cull, lineScale, &hit))
+                {
+                    pixel[0] = background[0];
+                    pixel[1] = background[1];
+                    pixel[2] = background[2];
+                    continue;
+                }
+
+                const RayTriangle& triangle = triangles[hit.triangle];
+                const RayTriangleNormals& vertexNormals = triangleNormals[hit.triangle];
+                float w = 1.0f - hit.u - hit.v;
+                float P[3], N[3];
+                for(int r = 0; r<3; r++)
+                {
+                    P[r] = d[r] * t;
+                    N[r] = vertexNormals.n[0][r] * w + vertexNormals.n[1][r] * hit.u + vertexNormals.n[2][r] * hit.v;
+                }
+                float length = sqrtf(N[0] * N[0] + N[1] * N[1] + N[2] * N[2]);
+                if(length > 0.0f)
+                    for(int r = 0; r<3; r++)
+                        N[r] /= length;
+                // shadow rays leave from the side of the surface the light is on
+                float face[3] = { triangle.e1[1] * triangle.e2[2] - triangle.e1[2] * triangle.e2[1],
+                    triangle.e1[2] * triangle.e2[0] - triangle.e1[0] * triangle.e2[2],
+                    triangle.e1[0] * triangle.e2[1] - triangle.e1[1] * triangle.e2[0] };
+                float faceLength = sqrtf(face[0] * face[0] + face[1] * face[1] + face[2] * face[2]);
+                float offset = 1e-4f * std::max(1.0f, std::max(fabsf(P[0]), std::max(fabsf(P[1]), fabsf(P[2]))));
+                unsigned int litMask = 0;
+                for(int i = 0; i<lighting.lights; i++)
+                {
+                    float L[3] = { lighting.position[i][0] - P[0], lighting.position[i][1] - P[1], lighting.position[i][2] - P[2] };
+                    if(N[0] * L[0] + N[1] * L[1] + N[2] * L[2] <= 0.0f)
+                        continue;
+                    float side = face[0] * L[0] + face[1] * L[1] + face[2] * L[2] < 0.0f ? -1.0f : 1.0f;
+                    float o[3], toLight[3];
+                    for(int r = 0; r<3; r++)
+                    {
+                        o[r] = P[r] + (faceLength > 0.0f ? side * offset * face[r] / faceLength : 0.0f);
+                        toLight[r] = lighting.position[i][r] - o[r];
+                    }
+                    float shadowFar = 1.0f;
+                    shadow[tile]++;
+                    if(!traceRay(o, toLight, 0.0f, shadowFar, true, CULL_NONE, -1.0f, NULL))
+                        litMask |= 1u << i;
+                }
+                float color[3];
+                shadePoint(lighting, meshMaterials[triangle.mesh], P, N, litMask, color);
+                for(int c = 0; c<3; c++)
+                    pixel[c] = (unsigned char)(color[c] * 255.0f + 0.5f);
+            }
+        }
+    });
+
+    RayStats stats = { 0, 0, 0.0f };
+    stats.trace_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for(size_t t = 0; t<primary.size(); t++)
+    {
+        stats.primary += primary[t];
+        stats.shadow += shadow[t];
+    }
+    return stats;
+}
+
+void releaseRayTracer()
+{
+    std::vector<RayTriangle>().swap(triangles);
+    std::vector<RayTriangleNormals>().swap(triangleNormals);
+    std::vector<RayBVHNode>().swap(nodes);
+    meshKinds.clear();
+    meshMaterials.clear();
+}
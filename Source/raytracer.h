@@ -0,0 +1,50 @@
+#ifndef __HW3__RAYTRACER__
+#define __HW3__RAYTRACER__
+
+#include <vector>
+#include "parser.h"
+
+// Centroid bins tried per axis when a BVH node is split.
+#define RAY_BVH_BINS 16
+// Nodes of at most this many triangles become leaves; larger ones are split
+// unless the surface area heuristic prefers a leaf of up to RAY_BVH_MAX_LEAF.
+#define RAY_BVH_MIN_LEAF 2
+#define RAY_BVH_MAX_LEAF 16
+// Side of the square pixel tiles rays are traced in, one tile per pool item.
+#define RAY_TILE_SIZE 16
+
+struct RayBuildStats
+{
+    int triangles;
+    int nodes;      // 4-wide nodes
+    int leaves;
+    int subtrees;   // built in parallel after the top levels
+    float build_ms;
+};
+
+struct RayStats
+{
+    long long primary;
+    long long shadow;
+    float trace_ms;
+};
+
+// Transforms every mesh into the camera's eye space, where turnOn leaves
+// the point lights, and builds a BVH over the triangles. The top levels are
+// split one after another with their centroids binned in parallel, then the
+// subtrees below them are built on the thread pool. Splits are chosen by
+// the surface area heuristic over RAY_BVH_BINS bins, and the binary tree is
+// collapsed into one with 4 children per node, whose boxes a ray tests
+// together.
+RayBuildStats initRayTracer(const parser::Scene& scene, const std::vector<parser::Vec3f>& normals);
+
+// One ray through the center of every pixel. Hits are lit as drawMeshes
+// lights vertices, but per pixel, and lights hidden from the hit point by
+// any triangle add only their ambient term. Primary rays obey the scene's
+// face culling; Wireframe meshes are hit only within half a pixel of their
+// edges and cast no shadows. rgb receives 8 bit pixels of the camera's
+// resolution, top row first.
+RayStats renderRayTraced(const parser::Scene& scene, std::vector<unsigned char>& rgb);
+void releaseRayTracer();
+
+#endif
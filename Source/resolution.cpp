@@ -0,0 +1,137 @@
+#include "resolution.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+static GLuint framebuffer = 0;
+static GLuint colorBuffer = 0;
+static GLuint depthBuffer = 0;
+static GLuint queries[RESOLUTION_QUERIES] = { 0 };
+static bool timerQueries = false;
+static int frame = 0;
+static int fullWidth = 0;
+static int fullHeight = 0;
+static float target = 0.0f;
+static float lowest = 0.0f;
+static float scale = 1.0f;
+static ResolutionStats stats = { 0, 0, 0.0f };
+static std::chrono::time_point<std::chrono::steady_clock> lastEnd;
+
+bool resolutionScalingSupported()
+{
+    return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+}
+
+void initResolutionScaling(int width, int height, float targetMs, float minScale)
+{
+    releaseResolutionScaling();
+    fullWidth = width;
+    fullHeight = height;
+    target = targetMs;
+    lowest = fminf(fmaxf(minScale, 0.05f), 1.0f);
+    scale = 1.0f;
+    frame = 0;
+
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    // the same depth precision as the window, so distant surfaces resolve
+    // the same way they do without scaling
+    GLint depthBits = 24;
+    glGetIntegerv(GL_DEPTH_BITS, &depthBits);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, depthBits > 24 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "Error: the dynamic resolution framebuffer is incomplete\n");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    timerQueries = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if(timerQueries)
+        glGenQueries(RESOLUTION_QUERIES, queries);
+    lastEnd = std::chrono::steady_clock::now();
+}
+
+ResolutionStats beginScaledFrame()
+{
+    stats.width = (int)(fullWidth * scale + 0.5f);
+    stats.height = (int)(fullHeight * scale + 0.5f);
+    if(stats.width < 1)
+        stats.width = 1;
+    if(stats.height < 1)
+        stats.height = 1;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, stats.width, stats.height);
+    if(timerQueries)
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame % RESOLUTION_QUERIES]);
+    return stats;
+}
+
+ResolutionStats endScaledFrame(GLuint target, int targetWidth, int targetHeight)
+{
+    if(timerQueries)
+        glEndQuery(GL_TIME_ELAPSED);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, stats.width, stats.height, 0, 0, targetWidth, targetHeight,
+        GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+    float measured = -1.0f;
+    if(timerQueries)
+    {
+        // the oldest query in the ring, if the GPU is done with it
+        frame++;
+        if(frame >= RESOLUTION_QUERIES)
+        {
+            GLuint oldest = queries[frame % RESOLUTION_QUERIES];
+            GLint available = 0;
+            glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+            if(available)
+            {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &elapsed);
+                measured = elapsed * 1e-6f;
+            }
+        }
+    }
+    else
+    {
+        std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
+        measured = std::chrono::duration<float, std::milli>(now - lastEnd).count();
+        lastEnd = now;
+    }
+
+    if(measured > 0.0f)
+    {
+        // shading cost follows the pixel count, the square of the scale
+        stats.frame_ms = measured;
+        // a stray reading moves the scale by at most a factor of two
+        float estimate = scale * sqrtf(fminf(fmaxf(target / measured, 0.25f), 4.0f));
+        float next = scale + RESOLUTION_GAIN * (estimate - scale);
+        next = fminf(fmaxf(next, lowest), 1.0f);
+        if(fabsf(next - scale) >= RESOLUTION_DEADBAND || next == 1.0f || next == lowest)
+            scale = next;
+    }
+    return stats;
+}
+
+void releaseResolutionScaling()
+{
+    if(framebuffer)
+        glDeleteFramebuffers(1, &framebuffer);
+    if(colorBuffer)
+        glDeleteRenderbuffers(1, &colorBuffer);
+    if(depthBuffer)
+        glDeleteRenderbuffers(1, &depthBuffer);
+    if(timerQueries && queries[0])
+        glDeleteQueries(RESOLUTION_QUERIES, queries);
+    framebuffer = colorBuffer = depthBuffer = 0;
+    for(int i = 0; i<RESOLUTION_QUERIES; i++)
+        queries[i] = 0;
+}
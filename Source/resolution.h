@@ -0,0 +1,37 @@
+#ifndef __HW3__RESOLUTION__
+#define __HW3__RESOLUTION__
+
+#include <GL/glew.h>
+
+// Frame times in flight before the controller reads one back; the timer
+// queries are never waited on.
+#define RESOLUTION_QUERIES 4
+// Fraction of the way to the estimated scale taken each frame, so one slow
+// frame does not halve the resolution
+#define RESOLUTION_GAIN 0.25f
+// Scale changes smaller than this are ignored to keep the image steady
+#define RESOLUTION_DEADBAND 0.02f
+
+struct ResolutionStats
+{
+    int width;          // resolution the last frame was drawn at
+    int height;
+    float frame_ms;     // latest measured frame time
+};
+
+bool resolutionScalingSupported();
+// width and height are the full resolution and the upper bound; the
+// framebuffer is allocated once at that size and frames use a corner of it.
+void initResolutionScaling(int width, int height, float targetMs, float minScale);
+// Before drawing, after cameraInit: binds the offscreen framebuffer and sets
+// the viewport to the resolution the controller picked, which it returns.
+ResolutionStats beginScaledFrame();
+// After drawing: upscales the frame into target, the window's framebuffer
+// (0) or the headless one, and feeds
+// the frame time to the controller. Frame times come from GL_TIME_ELAPSED
+// queries where available (GL 3.3 or ARB_timer_query) and from the time
+// between frames otherwise.
+ResolutionStats endScaledFrame(GLuint target, int targetWidth, int targetHeight);
+void releaseResolutionScaling();
+
+#endif
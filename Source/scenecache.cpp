@@ -0,0 +1,196 @@
+#include "scenecache.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char cacheMagic[8] = { 'H', 'W', '3', 'S', 'C', 'N', '1', '\0' };
+
+template<typename T>
+static void writeValue(FILE* file, const T& value)
+{
+    fwrite(&value, sizeof(T), 1, file);
+}
+
+template<typename T>
+static void writeArray(FILE* file, const std::vector<T>& values)
+{
+    unsigned count = values.size();
+    writeValue(file, count);
+    if(count)
+        fwrite(&values[0], sizeof(T), count, file);
+}
+
+static void writeString(FILE* file, const std::string& text)
+{
+    unsigned length = text.size();
+    writeValue(file, length);
+    fwrite(text.data(), 1, length, file);
+}
+
+bool writeSceneCache(const parser::Scene& scene, const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", path.c_str());
+        return false;
+    }
+    fwrite(cacheMagic, 1, sizeof(cacheMagic), file);
+    writeValue(file, scene.background_color);
+    writeValue(file, scene.culling_enabled);
+    writeValue(file, scene.culling_face);
+    writeValue(file, scene.camera);
+    writeValue(file, scene.ambient_light);
+    writeArray(file, scene.point_lights);
+    writeArray(file, scene.materials);
+    writeArray(file, scene.vertex_data);
+    writeArray(file, scene.translations);
+    writeArray(file, scene.scalings);
+    writeArray(file, scene.rotations);
+    unsigned meshes = scene.meshes.size();
+    writeValue(file, meshes);
+    for(unsigned i = 0; i<meshes; i++)
+    {
+        const parser::Mesh& mesh = scene.meshes[i];
+        writeValue(file, mesh.material_id);
+        writeValue(file, mesh.base_mesh_id);
+        writeString(file, mesh.mesh_type);
+        writeArray(file, mesh.faces);
+        unsigned transformations = mesh.transformations.size();
+        writeValue(file, transformations);
+        for(unsigned j = 0; j<transformations; j++)
+        {
+            writeString(file, mesh.transformations[j].transformation_type);
+            writeValue(file, mesh.transformations[j].id);
+        }
+    }
+    bool written = !ferror(file);
+    if(fclose(file) != 0 || !written)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Reads through the mapped file, failing on anything past its end.
+struct CacheReader
+{
+    const unsigned char* data;
+    size_t size;
+    size_t offset;
+    bool failed;
+
+    const void* take(size_t bytes)
+    {
+        if(failed || bytes > size - offset)
+        {
+            failed = true;
+            return NULL;
+        }
+        const void* at = data + offset;
+        offset += bytes;
+        return at;
+    }
+
+    template<typename T>
+    void read(T& value)
+    {
+        const void* at = take(sizeof(T));
+        if(at)
+            memcpy(&value, at, sizeof(T));
+    }
+
+    template<typename T>
+    void readArray(std::vector<T>& values)
+    {
+        unsigned count = 0;
+        read(count);
+        const void* at = take((size_t)count * sizeof(T));
+        if(!at)
+            return;
+        values.resize(count);
+        if(count)
+            memcpy(&values[0], at, (size_t)count * sizeof(T));
+    }
+
+    void readString(std::string& text)
+    {
+        unsigned length = 0;
+        read(length);
+        const void* at = take(length);
+        if(at)
+            text.assign((const char*)at, length);
+    }
+};
+
+bool loadSceneCache(const std::string& path, parser::Scene& scene)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0)
+    {
+        fprintf(stderr, "Error: cannot open %s\n", path.c_str());
+        if(fd >= 0)
+            close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    void* mapped = size ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(mapped == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: cannot map %s\n", path.c_str());
+        return false;
+    }
+
+    CacheReader reader = { (const unsigned char*)mapped, size, 0, false };
+    const void* magic = reader.take(sizeof(cacheMagic));
+    if(!magic || memcmp(magic, cacheMagic, sizeof(cacheMagic)) != 0)
+        reader.failed = true;
+    reader.read(scene.background_color);
+    reader.read(scene.culling_enabled);
+    reader.read(scene.culling_face);
+    reader.read(scene.camera);
+    reader.read(scene.ambient_light);
+    reader.readArray(scene.point_lights);
+    reader.readArray(scene.materials);
+    reader.readArray(scene.vertex_data);
+    reader.readArray(scene.translations);
+    reader.readArray(scene.scalings);
+    reader.readArray(scene.rotations);
+    unsigned meshes = 0;
+    reader.read(meshes);
+    // every mesh takes at least its fixed fields, which bounds a bogus count
+    if(!reader.failed && meshes > (size - reader.offset) / 16)
+        reader.failed = true;
+    if(!reader.failed)
+        scene.meshes.resize(meshes);
+    for(unsigned i = 0; i<meshes && !reader.failed; i++)
+    {
+        parser::Mesh& mesh = scene.meshes[i];
+        reader.read(mesh.material_id);
+        reader.read(mesh.base_mesh_id);
+        reader.readString(mesh.mesh_type);
+        reader.readArray(mesh.faces);
+        unsigned transformations = 0;
+        reader.read(transformations);
+        for(unsigned j = 0; j<transformations && !reader.failed; j++)
+        {
+            parser::Transformation transformation;
+            reader.readString(transformation.transformation_type);
+            reader.read(transformation.id);
+            mesh.transformations.push_back(transformation);
+        }
+    }
+    munmap(mapped, size);
+    if(reader.failed)
+    {
+        fprintf(stderr, "Error: %s is not a scene cache\n", path.c_str());
+        return false;
+    }
+    return true;
+}
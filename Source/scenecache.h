@@ -0,0 +1,15 @@
+#ifndef __HW3__SCENECACHE__
+#define __HW3__SCENECACHE__
+
+#include <string>
+#include "parser.h"
+
+// A parsed scene in a flat binary file, so processes that render the same
+// scene skip the XML. Structures are stored in the host's own layout: the
+// file is only meant for processes of the same binary on the same machine.
+// Readers map the file, so concurrent readers share its pages.
+// Both return false and print an error on failure.
+bool writeSceneCache(const parser::Scene& scene, const std::string& path);
+bool loadSceneCache(const std::string& path, parser::Scene& scene);
+
+#endif
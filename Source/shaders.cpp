@@ -0,0 +1,416 @@
+#include "shaders.h"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <sstream>
+#include <errno.h>
+#include <sys/stat.h>
+
+static std::map<int, GLuint> programs;
+static std::string cacheDirectory;
+static bool binaryCacheEnabled = false;
+static bool depthOnlyPass = false;
+
+// lighting follows the fixed function equation used by drawMeshes:
+// global ambient + per light ambient, diffuse and infinite viewer specular
+static const char* lightingSource =
+    "vec3 shade(vec3 P, vec3 N, vec3 ka, vec3 kd, vec3 ks, float shininess)\n"
+    "{\n"
+    "    vec3 color = ka * gl_LightModel.ambient.rgb;\n"
+    "#if NUM_LIGHTS > 0\n"
+    "    for (int i = 0; i < NUM_LIGHTS; ++i)\n"
+    "    {\n"
+    "        vec4 lp = gl_LightSource[i].position;\n"
+    "        vec3 L = normalize(lp.xyz - P * lp.w);\n"
+    "        float NdotL = dot(N, L);\n"
+    "        color += ka * gl_LightSource[i].ambient.rgb;\n"
+    "        if (NdotL > 0.0)\n"
+    "        {\n"
+    "            vec3 H = normalize(L + vec3(0.0, 0.0, 1.0));\n"
+    "            float NdotH = max(dot(N, H), 0.0);\n"
+    "            color += kd * gl_LightSource[i].diffuse.rgb * NdotL;\n"
+    "            color += ks * gl_LightSource[i].specular.rgb * pow(NdotH, shininess);\n"
+    "        }\n"
+    "    }\n"
+    "#endif\n"
+    "    return clamp(color, 0.0, 1.0);\n"
+    "}\n";
+
+// Meshes are lit per vertex and the colors interpolated, like the fixed
+// function path, so every variant draws the same image as drawMeshes.
+// Instanced variants take the model matrix and material index per instance,
+// indirect variants read them from storage buffers at the draw id; the
+// modelview matrix then only holds the camera. The normal matrix of the
+// model is its cofactor matrix, which GLSL 1.20 can build without inverse().
+// The draw id is a per-instance attribute fetched at the command's
+// baseInstance, so it survives reordering or compacting the commands.
+// gl_Position is invariant so depth only and shading variants produce the
+// same depths and the pre-pass can be followed by GL_LEQUAL tests.
+static const char* vertexSource =
+    "invariant gl_Position;\n"
+    "varying vec3 vColor;\n"
+    "#if INDIRECT\n"
+    "struct DrawRecord { mat4 model; ivec4 material; };\n"
+    "struct MaterialRecord { vec4 ambient; vec4 diffuse; vec4 specular; };\n"
+    "layout(std430, binding = SSBO_DRAWS) readonly buffer Draws { DrawRecord draws[]; };\n"
+    "layout(std430, binding = SSBO_MATERIALS) readonly buffer Materials { MaterialRecord materials[]; };\n"
+    "attribute float drawId;\n"
+    "#elif INSTANCED\n"
+    "attribute vec4 instanceModel0;\n"
+    "attribute vec4 instanceModel1;\n"
+    "attribute vec4 instanceModel2;\n"
+    "attribute vec4 instanceModel3;\n"
+    "attribute float instanceMaterial;\n"
+    "uniform vec4 materials[3 * MAX_MATERIALS];\n"
+    "#endif\n"
+    "void main()\n"
+    "{\n"
+    "#if INDIRECT\n"
+    "    DrawRecord record = draws[int(drawId + 0.5)];\n"
+    "    mat4 model = record.model;\n"
+    "    MaterialRecord material = materials[record.material.x];\n"
+    "#elif INSTANCED\n"
+    "    mat4 model = mat4(instanceModel0, instanceModel1, instanceModel2, instanceModel3);\n"
+    "    int index = int(instanceMaterial + 0.5);\n"
+    "#endif\n"
+    "#if INSTANCED || INDIRECT\n"
+    "    vec3 m0 = model[0].xyz;\n"
+    "    vec3 m1 = model[1].xyz;\n"
+    "    vec3 m2 = model[2].xyz;\n"
+    "    mat3 cofactor = mat3(cross(m1, m2), cross(m2, m0), cross(m0, m1));\n"
+    "    float handedness = sign(dot(m0, cross(m1, m2)));\n"
+    "    vec4 eye = gl_ModelViewMatrix * (model * gl_Vertex);\n"
+    "    vec3 normal = normalize(gl_NormalMatrix * (cofactor * gl_Normal) * handedness);\n"
+    "#if INDIRECT\n"
+    "    vec3 ambient = material.ambient.rgb;\n"
+    "    vec3 diffuse = material.diffuse.rgb;\n"
+    "    vec4 specular = material.specular;\n"
+    "#else\n"
+    "    vec3 ambient = materials[3 * index].rgb;\n"
+    "    vec3 diffuse = materials[3 * index + 1].rgb;\n"
+    "    vec4 specular = materials[3 * index + 2];\n"
+    "#endif\n"
+    "    gl_Position = gl_ProjectionMatrix * eye;\n"
+    "#else\n"
+    "    vec4 eye = gl_ModelViewMatrix * gl_Vertex;\n"
+    "    vec3 normal = normalize(gl_NormalMatrix * gl_Normal);\n"
+    "    vec3 ambient = gl_FrontMaterial.ambient.rgb;\n"
+    "    vec3 diffuse = gl_FrontMaterial.diffuse.rgb;\n"
+    "    vec4 specular = vec4(gl_FrontMaterial.specular.rgb, gl_FrontMaterial.shininess);\n"
+    "    gl_Position = ftransform();\n"
+    "#endif\n"
+    "#if !DEPTH_ONLY\n"
+    "    vColor = shade(eye.xyz, normal, ambient, diffuse, specular.rgb, specular.a);\n"
+    "#endif\n"
+    "}\n";
+
+static const char* fragmentSource =
+    "varying vec3 vColor;\n"
+    "void main()\n"
+    "{\n"
+    "#if DEPTH_ONLY\n"
+    "    gl_FragColor = vec4(0.0);\n"
+    "#else\n"
+    "    gl_FragColor = vec4(vColor, 1.0);\n"
+    "#endif\n"
+    "}\n";
+
+MeshKind meshKindOf(const parser::Mesh& mesh)
+{
+    return mesh.mesh_type == "Wireframe" ? MESH_WIREFRAME : MESH_SOLID;
+}
+
+CullMode cullModeOf(const parser::Scene& scene)
+{
+    if(!scene.culling_enabled)
+        return CULL_NONE;
+    return scene.culling_face ? CULL_FRONT : CULL_BACK;
+}
+
+int lightBucket(int lightCount)
+{
+    int bucket = 0;
+    while(bucket < lightCount && bucket < 8)
+        bucket = bucket ? bucket * 2 : 1;
+    return bucket;
+}
+
+ShaderVariantKey variantKeyFor(const parser::Scene& scene)
+{
+    ShaderVariantKey key;
+    key.light_bucket = lightBucket(scene.point_lights.size());
+    key.draw_path = DRAW_IMMEDIATE;
+    key.depth_only = false;
+    return key;
+}
+
+void applyRasterState(CullMode cullMode, MeshKind meshKind)
+{
+    GLenum polygonMode = meshKind == MESH_WIREFRAME ? GL_LINE : GL_FILL;
+    glFrontFace(GL_CCW);
+    if(cullMode == CULL_FRONT)
+    {
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glPolygonMode(GL_BACK, polygonMode);
+    }
+    else if(cullMode == CULL_BACK)
+    {
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        glPolygonMode(GL_FRONT, polygonMode);
+    }
+    else
+    {
+        glDisable(GL_CULL_FACE);
+        glPolygonMode(GL_FRONT_AND_BACK, polygonMode);
+    }
+}
+
+static int packKey(const ShaderVariantKey& key)
+{
+    return (key.depth_only << 8) | (key.draw_path << 4) | key.light_bucket;
+}
+
+static std::string variantHeader(const ShaderVariantKey& key)
+{
+    std::stringstream stream;
+    // storage buffers need GLSL 4.30; the compatibility profile keeps the
+    // built-in light state readable
+    if(key.draw_path == DRAW_INDIRECT)
+        stream << "#version 430 compatibility\n";
+    else
+        stream << "#version 120\n";
+    stream << "#define NUM_LIGHTS " << key.light_bucket << "\n";
+    stream << "#define INSTANCED " << (key.draw_path == DRAW_INSTANCED ? 1 : 0) << "\n";
+    stream << "#define INDIRECT " << (key.draw_path == DRAW_INDIRECT ? 1 : 0) << "\n";
+    stream << "#define DEPTH_ONLY " << (key.depth_only ? 1 : 0) << "\n";
+    stream << "#define MAX_MATERIALS " << MAX_INSTANCED_MATERIALS << "\n";
+    stream << "#define SSBO_DRAWS " << SSBO_DRAWS << "\n";
+    stream << "#define SSBO_MATERIALS " << SSBO_MATERIALS << "\n";
+    return stream.str();
+}
+
+static std::string variantName(const ShaderVariantKey& key)
+{
+    static const char* pathNames[] = { "", "/Instanced", "/Indirect" };
+    std::stringstream stream;
+    stream << "L" << key.light_bucket << pathNames[key.draw_path] << (key.depth_only ? "/DepthOnly" : "");
+    return stream.str();
+}
+
+// 64-bit FNV-1a, enough to tell sources and drivers apart in the cache
+static unsigned long long hashString(const std::string& text, unsigned long long hash = 14695981039346656037ULL)
+{
+    for(size_t i = 0; i<text.size(); i++)
+    {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static std::string cachePath(const std::string& vs, const std::string& fs)
+{
+    // binaries are only valid for the driver that produced them
+    std::string driver = std::string((const char*)glGetString(GL_RENDERER)) + (const char*)glGetString(GL_VERSION);
+    unsigned long long hash = hashString(fs, hashString(vs, hashString(driver)));
+    char name[64];
+    snprintf(name, sizeof(name), "/variant_%016llx.bin", hash);
+    return cacheDirectory + name;
+}
+
+static GLuint loadCachedProgram(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if(!file)
+        return 0;
+    GLenum format = 0;
+    std::vector<char> binary;
+    if(fread(&format, sizeof(format), 1, file) == 1)
+    {
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file) - (long)sizeof(format);
+        fseek(file, sizeof(format), SEEK_SET);
+        if(size > 0)
+        {
+            binary.resize(size);
+            if(fread(&binary[0], 1, size, file) != (size_t)size)
+                binary.clear();
+        }
+    }
+    fclose(file);
+    if(binary.empty())
+        return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, &binary[0], binary.size());
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(!linked)
+    {
+        // stale binary, e.g. after a driver update; rebuild from source
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static void storeCachedProgram(GLuint program, const std::string& path)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, NULL, &format, &binary[0]);
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file)
+        return;
+    fwrite(&format, sizeof(format), 1, file);
+    fwrite(&binary[0], 1, length, file);
+    fclose(file);
+}
+
+static GLuint compileShader(GLenum type, const std::string& source, const std::string& name)
+{
+    GLuint shader = glCreateShader(type);
+    const char* text = source.c_str();
+    glShaderSource(shader, 1, &text, NULL);
+    glCompileShader(shader);
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if(!compiled)
+    {
+        char log[2048] = { 0 };
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "Error: shader %s failed to compile:\n%s\n", name.c_str(), log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint buildProgram(const std::string& vs, const std::string& fs, const std::string& name)
+{
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vs, name);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fs, name);
+    if(!vertexShader || !fragmentShader)
+    {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindAttribLocation(program, ATTRIB_INSTANCE_MODEL, "instanceModel0");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_MODEL + 1, "instanceModel1");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_MODEL + 2, "instanceModel2");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_MODEL + 3, "instanceModel3");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_MATERIAL, "instanceMaterial");
+    glBindAttribLocation(program, ATTRIB_DRAW_ID, "drawId");
+    if(binaryCacheEnabled)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(!linked)
+    {
+        char log[2048] = { 0 };
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "Error: shader variant %s failed to link:\n%s\n", name.c_str(), log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void initShaderVariants(const std::string& cacheDir)
+{
+    releaseShaderVariants();
+    cacheDirectory = cacheDir;
+    binaryCacheEnabled = (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) && !cacheDirectory.empty();
+    if(binaryCacheEnabled && mkdir(cacheDirectory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Warning: cannot create shader cache %s, variants will not be cached\n", cacheDirectory.c_str());
+        binaryCacheEnabled = false;
+    }
+}
+
+void setDepthOnlyPass(bool depthOnly)
+{
+    depthOnlyPass = depthOnly;
+}
+
+GLuint shaderVariant(const ShaderVariantKey& variantKey)
+{
+    ShaderVariantKey key = variantKey;
+    key.depth_only = key.depth_only || depthOnlyPass;
+    int packed = packKey(key);
+    std::map<int, GLuint>::iterator found = programs.find(packed);
+    if(found != programs.end())
+        return found->second;
+
+    std::string header = variantHeader(key);
+    std::string vs = header + lightingSource + vertexSource;
+    std::string fs = header + lightingSource + fragmentSource;
+    std::string name = variantName(key);
+
+    GLuint program = 0;
+    std::string path;
+    if(binaryCacheEnabled)
+    {
+        path = cachePath(vs, fs);
+        program = loadCachedProgram(path);
+    }
+    if(!program)
+    {
+        program = buildProgram(vs, fs, name);
+        if(program && binaryCacheEnabled)
+            storeCachedProgram(program, path);
+    }
+    // failures are remembered too so a broken variant is not rebuilt every frame
+    programs[packed] = program;
+    return program;
+}
+
+void releaseShaderVariants()
+{
+    for(std::map<int, GLuint>::iterator it = programs.begin(); it != programs.end(); ++it)
+    {
+        if(it->second)
+            glDeleteProgram(it->second);
+    }
+    programs.clear();
+}
+
+GLuint buildComputeProgram(const std::string& source, const std::string& name)
+{
+    GLuint shader = compileShader(GL_COMPUTE_SHADER, source, name);
+    if(!shader)
+        return 0;
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(!linked)
+    {
+        char log[2048] = { 0 };
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "Error: compute program %s failed to link:\n%s\n", name.c_str(), log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
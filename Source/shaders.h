@@ -0,0 +1,77 @@
+#ifndef __HW3__SHADERS__
+#define __HW3__SHADERS__
+
+#include <string>
+#include <GL/glew.h>
+#include "parser.h"
+
+// Mesh types, filled or drawn as lines, and the culling modes
+// applyRasterState sets up around a variant.
+enum MeshKind
+{
+    MESH_SOLID = 0,
+    MESH_WIREFRAME = 1
+};
+
+enum CullMode
+{
+    CULL_NONE = 0,
+    CULL_BACK = 1,
+    CULL_FRONT = 2
+};
+
+// Where a variant takes the model matrix and material from.
+enum DrawPath
+{
+    DRAW_IMMEDIATE = 0,     // modelview matrix and glMaterial state
+    DRAW_INSTANCED = 1,     // per-instance vertex attributes
+    DRAW_INDIRECT = 2       // storage buffers indexed by draw id
+};
+
+// Every field of the key is baked into the program source as a constant,
+// so the light loop is unrolled and the path checks fold away at compile
+// time. Wireframe and culling are raster state, set by applyRasterState,
+// and not part of the key.
+struct ShaderVariantKey
+{
+    int light_bucket;
+    DrawPath draw_path;
+    bool depth_only;    // no lighting; for the depth pre-pass
+};
+
+// Attribute slots used by instanced and indirect variants; the model matrix
+// takes four. Slots 0-3 are left to the built-in vertex, normal and color arrays.
+#define ATTRIB_INSTANCE_MODEL 4
+#define ATTRIB_INSTANCE_MATERIAL 8
+#define ATTRIB_DRAW_ID 9
+// Storage buffer bindings of indirect variants
+#define SSBO_DRAWS 0
+#define SSBO_MATERIALS 1
+// Instanced variants read materials from a uniform array of
+// 3 * MAX_INSTANCED_MATERIALS vec4: ambient, diffuse, specular + shininess.
+#define MAX_INSTANCED_MATERIALS 64
+
+MeshKind meshKindOf(const parser::Mesh& mesh);
+CullMode cullModeOf(const parser::Scene& scene);
+// 0, 1, 2, 4 or 8: the smallest bucket that holds lightCount lights. The
+// lights past lightCount in the bucket are read too, so turnOn zeroes them.
+int lightBucket(int lightCount);
+ShaderVariantKey variantKeyFor(const parser::Scene& scene);
+// Culling and polygon mode state that belongs to a variant.
+void applyRasterState(CullMode cullMode, MeshKind meshKind);
+
+// Program binaries are stored in cacheDir and reused by later runs when the
+// driver supports GL_ARB_get_program_binary.
+void initShaderVariants(const std::string& cacheDir);
+// While set, shaderVariant hands out the depth only form of every key, so
+// the draw paths can run a depth pre-pass without knowing about it.
+void setDepthOnlyPass(bool depthOnly);
+// Returns the program for key, compiling or loading it on first use.
+// Returns 0 if the variant cannot be built; callers fall back to fixed function.
+GLuint shaderVariant(const ShaderVariantKey& key);
+void releaseShaderVariants();
+// Compiles and links a compute program; returns 0 and logs on failure.
+// Compute programs are few and owned by their callers, so they are not cached.
+GLuint buildComputeProgram(const std::string& source, const std::string& name);
+
+#endif
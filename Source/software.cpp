@@ -0,0 +1,668 @@
+#include "software.h"
+#include "shaders.h"
+#include "threadpool.h"
+#include "transform.h"
+#include "vertexkernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+// Corners of a triangle clipped to the near and far planes
+#define SOFTWARE_MAX_CLIPPED 5
+// Mode arguments of the setup and raster kernels. Every combination is
+// instantiated with its modes as constants, so the per triangle and per
+// pixel loops carry no mode tests and a mesh pays for one dispatch.
+// MODE_RUNTIME instantiations read the modes from their arguments instead,
+// as one generic kernel would; --raster-benchmark measures against them.
+#define MODE_RUNTIME -1
+
+struct ClipVertex
+{
+    float clip[4];
+    float color[3];
+    bool onPlane;   // created by clipping; edges between two of these are not drawn
+};
+
+// A counter-clockwise triangle, or a line when only the first two vertices
+// count, in window space with y up as glViewport maps it. Colors are divided
+// by w so they interpolate perspective correctly. line is only read by the
+// runtime-branching kernels; the others know it from their bin run.
+struct ScreenPrimitive
+{
+    float x[3], y[3], z[3], invW[3];
+    float color[3][3];
+    bool line;
+};
+
+// Consecutive entries of a tile's bin that come from meshes of one kind,
+// up to (not including) end.
+struct BinRun
+{
+    MeshKind kind;
+    int end;
+};
+
+// The output of one vertex job: its primitives in submission order and,
+// per tile, the indices of those touching it split into runs by kind.
+struct VertexJob
+{
+    int meshBegin, meshEnd;
+    std::vector<ScreenPrimitive> primitives;
+    std::vector<std::vector<int> > bins;
+    std::vector<std::vector<BinRun> > runs;
+    ShadedStreams shaded;   // the current mesh's vertex range
+};
+
+static int width = 0;
+static int height = 0;
+static int tilesX = 0;
+static int tilesY = 0;
+static std::vector<VertexJob> jobs;
+static VertexStreams streams;
+static VertexKernel kernel = VERTEX_KERNEL_SCALAR;
+static bool specializedKernels = true;
+
+// A sort-last worker: one vertex job over its share of the meshes and a
+// private frame, colors and depths both top row first.
+struct SortLastWorker
+{
+    VertexJob job;
+    std::vector<unsigned char> rgb;
+    std::vector<float> depth;
+    int regionBegin, regionEnd;     // pixels it holds composited
+    float setup_ms, raster_ms;
+};
+
+static std::vector<SortLastWorker> sortLastWorkers;
+
+// Sutherland-Hodgman against one plane, distance = dot(plane, clip) >= 0 inside.
+static int clipPolygon(const ClipVertex* in, int count, const float plane[4], ClipVertex* out)
+{
+    int outCount = 0;
+    for(int k = 0; k<count; k++)
+    {
+        const ClipVertex& a = in[k];
+        const ClipVertex& b = in[(k + 1) % count];
+        float da = plane[0] * a.clip[0] + plane[1] * a.clip[1] + plane[2] * a.clip[2] + plane[3] * a.clip[3];
+        float db = plane[0] * b.clip[0] + plane[1] * b.clip[1] + plane[2] * b.clip[2] + plane[3] * b.clip[3];
+        if(da >= 0.0f)
+            out[outCount++] = a;
+        if((da >= 0.0f) != (db >= 0.0f))
+        {
+            float t = da / (da - db);
+            ClipVertex& v = out[outCount++];
+            for(int c = 0; c<4; c++)
+                v.clip[c] = a.clip[c] + t * (b.clip[c] - a.clip[c]);
+            for(int c = 0; c<3; c++)
+                v.color[c] = a.color[c] + t * (b.color[c] - a.color[c]);
+            v.onPlane = true;
+        }
+    }
+    return outCount;
+}
+
+static void toWindow(const ClipVertex& v, ScreenPrimitive& p, int k)
+{
+    float invW = 1.0f / v.clip[3];
+    p.x[k] = (v.clip[0] * invW * 0.5f + 0.5f) * width;
+    p.y[k] = (v.clip[1] * invW * 0.5f + 0.5f) * height;
+    p.z[k] = v.clip[2] * invW * 0.5f + 0.5f;
+    p.invW[k] = invW;
+    for(int c = 0; c<3; c++)
+        p.color[k][c] = v.color[c] * invW;
+}
+
+static void binPrimitive(VertexJob& job, const ScreenPrimitive& p, MeshKind kind)
+{
+    int corners = kind == MESH_WIREFRAME ? 2 : 3;
+    float minX = p.x[0], maxX = p.x[0], minY = p.y[0], maxY = p.y[0];
+    for(int k = 1; k<corners; k++)
+    {
+        minX = std::min(minX, p.x[k]);
+        maxX = std::max(maxX, p.x[k]);
+        minY = std::min(minY, p.y[k]);
+        maxY = std::max(maxY, p.y[k]);
+    }
+    if(maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+        return;
+    int tx0 = (int)std::max(minX, 0.0f) / SOFTWARE_TILE_SIZE;
+    int ty0 = (int)std::max(minY, 0.0f) / SOFTWARE_TILE_SIZE;
+    int tx1 = (int)std::min(maxX, width - 1.0f) / SOFTWARE_TILE_SIZE;
+    int ty1 = (int)std::min(maxY, height - 1.0f) / SOFTWARE_TILE_SIZE;
+    int index = job.primitives.size();
+    job.primitives.push_back(p);
+    for(int ty = ty0; ty<=ty1; ty++)
+        for(int tx = tx0; tx<=tx1; tx++)
+        {
+            int tile = ty * tilesX + tx;
+            job.bins[tile].push_back(index);
+            std::vector<BinRun>& runs = job.runs[tile];
+            if(runs.empty() || runs.back().kind != kind)
+            {
+                BinRun run = { kind, 0 };
+                runs.push_back(run);
+            }
+            runs.back().end = job.bins[tile].size();
+        }
+}
+
+// Turns the faces of one mesh, lit by shadeVertices into job.shaded from
+// vertex lowest on, into window space primitives: clipped to the near and
+// far planes (x and y are left to the tiles), culled by their window
+// winding and binned, filled or as edges.
+template<int CULL, int KIND>
+static void setupMesh(VertexJob& job, const std::vector<parser::Face>& faces, int lowest, CullMode cullMode, MeshKind meshKind)
+{
+    static const float nearPlane[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+    static const float farPlane[4] = { 0.0f, 0.0f, -1.0f, 1.0f };
+    const CullMode cull = CULL == MODE_RUNTIME ? cullMode : (CullMode)CULL;
+    const MeshKind kind = KIND == MODE_RUNTIME ? meshKind : (MeshKind)KIND;
+    const ShadedStreams& shaded = job.shaded;
+    int fSize = faces.size();
+    for(int j = 0; j<fSize; j++)
+    {
+        const parser::Face& face = faces[j];
+        int ids[3] = { face.v0_id - 1 - lowest, face.v1_id - 1 - lowest, face.v2_id - 1 - lowest };
+        ClipVertex corners[3];
+        for(int k = 0; k<3; k++)
+        {
+            for(int r = 0; r<4; r++)
+                corners[k].clip[r] = shaded.clip[r][ids[k]];
+            for(int c = 0; c<3; c++)
+                corners[k].color[c] = shaded.color[c][ids[k]];
+            corners[k].onPlane = false;
+        }
+        ClipVertex polygon[SOFTWARE_MAX_CLIPPED + 1];
+        ClipVertex clipped[SOFTWARE_MAX_CLIPPED + 1];
+        int count = clipPolygon(corners, 3, nearPlane, clipped);
+        count = clipPolygon(clipped, count, farPlane, polygon);
+        if(count < 3)
+            continue;
+
+        // clipping keeps the winding, so the whole polygon decides the
+        // facing; the viewport scale does not change its sign
+        float area = 0.0f;
+        for(int k = 0; k<count; k++)
+        {
+            const float* a = polygon[k].clip;
+            const float* b = polygon[(k + 1) % count].clip;
+            area += (a[0] / a[3]) * (b[1] / b[3]) - (b[0] / b[3]) * (a[1] / a[3]);
+        }
+        if(area == 0.0f)
+            continue;
+        if((cull == CULL_BACK && area < 0.0f) || (cull == CULL_FRONT && area > 0.0f))
+            continue;
+
+        ScreenPrimitive p;
+        p.line = kind == MESH_WIREFRAME;
+        if(kind == MESH_WIREFRAME)
+        {
+            for(int k = 0; k<count; k++)
+            {
+                int next = (k + 1) % count;
+                if(polygon[k].onPlane && polygon[next].onPlane)
+                    continue;
+                toWindow(polygon[k], p, 0);
+                toWindow(polygon[next], p, 1);
+                binPrimitive(job, p, kind);
+            }
+            continue;
+        }
+        // the raster kernels take counter-clockwise triangles; culling
+        // already fixes the winding when it is on
+        bool counterClockwise = cull == CULL_BACK || (cull == CULL_NONE && area > 0.0f);
+        toWindow(polygon[0], p, 0);
+        for(int k = 2; k<count; k++)
+        {
+            toWindow(polygon[k - 1], p, counterClockwise ? 1 : 2);
+            toWindow(polygon[k], p, counterClockwise ? 2 : 1);
+            binPrimitive(job, p, kind);
+        }
+    }
+}
+
+typedef void (*MeshSetup)(VertexJob& job, const std::vector<parser::Face>& faces, int lowest, CullMode cullMode, MeshKind meshKind);
+
+// Indexed by CullMode, then MeshKind
+static const MeshSetup meshSetups[3][2] = {
+    { setupMesh<CULL_NONE, MESH_SOLID>, setupMesh<CULL_NONE, MESH_WIREFRAME> },
+    { setupMesh<CULL_BACK, MESH_SOLID>, setupMesh<CULL_BACK, MESH_WIREFRAME> },
+    { setupMesh<CULL_FRONT, MESH_SOLID>, setupMesh<CULL_FRONT, MESH_WIREFRAME> }
+};
+
+static void runVertexJob(const parser::Scene& scene, mat4x4 view, mat4x4 projection, const LightingSetup& lighting, VertexJob& job)
+{
+    job.primitives.clear();
+    for(size_t t = 0; t<job.bins.size(); t++)
+    {
+        job.bins[t].clear();
+        job.runs[t].clear();
+    }
+    CullMode cullMode = cullModeOf(scene);
+    for(int m = job.meshBegin; m<job.meshEnd; m++)
+    {
+        const parser::Mesh& mesh = scene.meshes[m];
+        const std::vector<parser::Face>& faces = scene.meshFaces(mesh);
+        int fSize = faces.size();
+        if(fSize == 0)
+            continue;
+        // meshes use a contiguous run of the vertices, which is shaded as
+        // a whole so shared corners are lit once
+        int lowest = faces[0].v0_id - 1;
+        int highest = lowest;
+        for(int j = 0; j<fSize; j++)
+        {
+            const parser::Face& face = faces[j];
+            lowest = std::min(lowest, std::min(face.v0_id, std::min(face.v1_id, face.v2_id)) - 1);
+            highest = std::max(highest, std::max(face.v0_id, std::max(face.v1_id, face.v2_id)) - 1);
+        }
+        MaterialSetup material;
+        materialSetupFor(scene, mesh, material);
+        VertexTransform transform;
+        vertexTransformFor(scene, mesh, view, projection, transform);
+        shadeVertices(kernel, streams, lowest, highest - lowest + 1, transform, &lighting, material, job.shaded);
+
+        MeshKind meshKind = meshKindOf(mesh);
+        if(specializedKernels)
+            meshSetups[cullMode][meshKind](job, faces, lowest, cullMode, meshKind);
+        else
+            setupMesh<MODE_RUNTIME, MODE_RUNTIME>(job, faces, lowest, cullMode, meshKind);
+    }
+}
+
+static unsigned char toByte(float value)
+{
+    return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static void writePixel(unsigned char* rgb, int x, int y, const float color[3])
+{
+    unsigned char* pixel = rgb + ((size_t)(height - 1 - y) * width + x) * 3;
+    pixel[0] = toByte(color[0]);
+    pixel[1] = toByte(color[1]);
+    pixel[2] = toByte(color[2]);
+}
+
+// Pixel centers inside all three edges are covered; a center exactly on an
+// edge goes to the triangle for which that edge is a top or left one, so
+// shared edges are drawn once.
+static void rasterTriangle(const ScreenPrimitive& p, int x0, int y0, int x1, int y1, float* depth, unsigned char* rgb)
+{
+    // fan triangles of a barely visible polygon may turn over
+    float area = (p.x[1] - p.x[0]) * (p.y[2] - p.y[0]) - (p.x[2] - p.x[0]) * (p.y[1] - p.y[0]);
+    if(area <= 0.0f)
+        return;
+    const float* vx = p.x;
+    const float* vy = p.y;
+
+    int minX = std::max(x0, (int)floorf(std::min(vx[0], std::min(vx[1], vx[2]))));
+    int maxX = std::min(x1 - 1, (int)ceilf(std::max(vx[0], std::max(vx[1], vx[2]))));
+    int minY = std::max(y0, (int)floorf(std::min(vy[0], std::min(vy[1], vy[2]))));
+    int maxY = std::min(y1 - 1, (int)ceilf(std::max(vy[0], std::max(vy[1], vy[2]))));
+    if(minX > maxX || minY > maxY)
+        return;
+
+    // edge k is opposite vertex k and E_k(vertex k) = area
+    float a[3], b[3], c[3];
+    bool topLeft[3];
+    for(int k = 0; k<3; k++)
+    {
+        int from = (k + 1) % 3;
+        int to = (k + 2) % 3;
+        a[k] = vy[from] - vy[to];
+        b[k] = vx[to] - vx[from];
+        c[k] = -(a[k] * vx[from] + b[k] * vy[from]);
+        topLeft[k] = a[k] > 0.0f || (a[k] == 0.0f && b[k] > 0.0f);
+    }
+    float invArea = 1.0f / area;
+
+    for(int y = minY; y<=maxY; y++)
+    {
+        float py = y + 0.5f;
+        float* depthRow = depth + (y - y0) * SOFTWARE_TILE_SIZE - x0;
+        for(int x = minX; x<=maxX; x++)
+        {
+            float px = x + 0.5f;
+            float e[3];
+            bool inside = true;
+            for(int k = 0; k<3; k++)
+            {
+                e[k] = a[k] * px + b[k] * py + c[k];
+                inside = inside && (e[k] > 0.0f || (e[k] == 0.0f && topLeft[k]));
+            }
+            if(!inside)
+                continue;
+            float w[3] = { e[0] * invArea, e[1] * invArea, e[2] * invArea };
+            float z = w[0] * p.z[0] + w[1] * p.z[1] + w[2] * p.z[2];
+            if(!(z < depthRow[x]))
+                continue;
+            depthRow[x] = z;
+            float invW = w[0] * p.invW[0] + w[1] * p.invW[1] + w[2] * p.invW[2];
+            float color[3];
+            for(int ch = 0; ch<3; ch++)
+                color[ch] = (w[0] * p.color[0][ch] + w[1] * p.color[1][ch] + w[2] * p.color[2][ch]) / invW;
+            writePixel(rgb, x, y, color);
+        }
+    }
+}
+
+// One pixel per column (or row, for steep lines) whose center the line
+// crosses, the last one left out as GL's diamond exit rule does.
+static void rasterLine(const ScreenPrimitive& p, int x0, int y0, int x1, int y1, float* depth, unsigned char* rgb)
+{
+    float dx = p.x[1] - p.x[0];
+    float dy = p.y[1] - p.y[0];
+    bool xMajor = fabsf(dx) >= fabsf(dy);
+    float major0 = xMajor ? p.x[0] : p.y[0];
+    float major1 = xMajor ? p.x[1] : p.y[1];
+    float minor0 = xMajor ? p.y[0] : p.x[0];
+    float dMajor = xMajor ? dx : dy;
+    float dMinor = xMajor ? dy : dx;
+    if(dMajor == 0.0f)
+        return;
+    int first = (int)ceilf(std::min(major0, major1) - 0.5f);
+    int last = (int)ceilf(std::max(major0, major1) - 0.5f) - 1;
+    first = std::max(first, xMajor ? x0 : y0);
+    last = std::min(last, (xMajor ? x1 : y1) - 1);
+    for(int i = first; i<=last; i++)
+    {
+        float t = (i + 0.5f - major0) / dMajor;
+        int minor = (int)floorf(minor0 + t * dMinor);
+        int x = xMajor ? i : minor;
+        int y = xMajor ? minor : i;
+        if(x < x0 || x >= x1 || y < y0 || y >= y1)
+            continue;
+        float z = p.z[0] + t * (p.z[1] - p.z[0]);
+        float& stored = depth[(y - y0) * SOFTWARE_TILE_SIZE + x - x0];
+        if(!(z < stored))
+            continue;
+        stored = z;
+        float invW = p.invW[0] + t * (p.invW[1] - p.invW[0]);
+        float color[3];
+        for(int ch = 0; ch<3; ch++)
+            color[ch] = (p.color[0][ch] + t * (p.color[1][ch] - p.color[0][ch])) / invW;
+        writePixel(rgb, x, y, color);
+    }
+}
+
+template<int KIND>
+static void rasterRun(const std::vector<ScreenPrimitive>& primitives, const int* indices, int count,
+    int x0, int y0, int x1, int y1, float* depth, unsigned char* rgb)
+{
+    for(int i = 0; i<count; i++)
+    {
+        const ScreenPrimitive& p = primitives[indices[i]];
+        bool line = KIND == MODE_RUNTIME ? p.line : KIND == MESH_WIREFRAME;
+        if(line)
+            rasterLine(p, x0, y0, x1, y1, depth, rgb);
+        else
+            rasterTriangle(p, x0, y0, x1, y1, depth, rgb);
+    }
+}
+
+// Clears the tile and draws what was binned to it, job by job, so
+// primitives keep their submission order and equal depths resolve as in GL.
+// Depths stay in the tile unless depthOut, laid out like rgb, takes them.
+static void rasterTile(int tile, const VertexJob* tileJobs, int jobCount, unsigned char* rgb, float* depthOut)
+{
+    int x0 = tile % tilesX * SOFTWARE_TILE_SIZE;
+    int y0 = tile / tilesX * SOFTWARE_TILE_SIZE;
+    int x1 = std::min(x0 + SOFTWARE_TILE_SIZE, width);
+    int y1 = std::min(y0 + SOFTWARE_TILE_SIZE, height);
+    float depth[SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE];
+    std::fill(depth, depth + SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE, 1.0f);
+    for(int y = y0; y<y1; y++)
+        std::fill(rgb + ((size_t)(height - 1 - y) * width + x0) * 3, rgb + ((size_t)(height - 1 - y) * width + x1) * 3, 0);
+
+    for(int j = 0; j<jobCount; j++)
+    {
+        const VertexJob& job = tileJobs[j];
+        const std::vector<int>& bin = job.bins[tile];
+        if(bin.empty())
+            continue;
+        if(!specializedKernels)
+        {
+            rasterRun<MODE_RUNTIME>(job.primitives, &bin[0], bin.size(), x0, y0, x1, y1, depth, rgb);
+            continue;
+        }
+        const std::vector<BinRun>& runs = job.runs[tile];
+        int rSize = runs.size();
+        int begin = 0;
+        for(int r = 0; r<rSize; r++)
+        {
+            if(runs[r].kind == MESH_WIREFRAME)
+                rasterRun<MESH_WIREFRAME>(job.primitives, &bin[begin], runs[r].end - begin, x0, y0, x1, y1, depth, rgb);
+            else
+                rasterRun<MESH_SOLID>(job.primitives, &bin[begin], runs[r].end - begin, x0, y0, x1, y1, depth, rgb);
+            begin = runs[r].end;
+        }
+    }
+    if(depthOut)
+        for(int y = y0; y<y1; y++)
+            std::copy(depth + (y - y0) * SOFTWARE_TILE_SIZE, depth + (y - y0) * SOFTWARE_TILE_SIZE + x1 - x0,
+                depthOut + (size_t)(height - 1 - y) * width + x0);
+}
+
+void initSoftware(const parser::Scene& scene, const std::vector<parser::Vec3f>& normals)
+{
+    buildVertexStreams(scene, normals, streams);
+    kernel = bestVertexKernel();
+}
+
+const char* softwareVertexKernel()
+{
+    return vertexKernelName(kernel);
+}
+
+SoftwareStats renderSoftware(const parser::Scene& scene, std::vector<unsigned char>& rgb)
+{
+    const parser::Camera& camera = scene.camera;
+    width = camera.image_width;
+    height = camera.image_height;
+    tilesX = (width + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+    tilesY = (height + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+    int tiles = tilesX * tilesY;
+    rgb.resize((size_t)width * height * 3);
+
+    int meshes = scene.meshes.size();
+    int jobCount = std::max(1, std::min(meshes, threadCount() * SOFTWARE_JOBS_PER_THREAD));
+    jobs.resize(jobCount);
+    for(int j = 0; j<jobCount; j++)
+    {
+        jobs[j].meshBegin = (long long)meshes * j / jobCount;
+        jobs[j].meshEnd = (long long)meshes * (j + 1) / jobCount;
+        jobs[j].bins.resize(tiles);
+        jobs[j].runs.resize(tiles);
+    }
+
+    LightingSetup lighting;
+    lightingSetupFor(scene, lighting);
+
+    mat4x4 view, projection;
+    cameraViewMatrix(camera, view);
+    cameraProjectionMatrix(camera, projection);
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    parallelFor(jobCount, [&](int j)
+    {
+        runVertexJob(scene, view, projection, lighting, jobs[j]);
+    });
+    std::chrono::time_point<std::chrono::steady_clock> binned = std::chrono::steady_clock::now();
+    unsigned char* pixels = &rgb[0];
+    parallelFor(tiles, [&](int tile)
+    {
+        rasterTile(tile, &jobs[0], jobCount, pixels, NULL);
+    });
+    std::chrono::time_point<std::chrono::steady_clock> end = std::chrono::steady_clock::now();
+
+    SoftwareStats stats = { 0, 0, tiles, 0.0f, 0.0f, 0.0f };
+    stats.setup_ms = std::chrono::duration<float, std::milli>(binned - start).count();
+    stats.raster_ms = std::chrono::duration<float, std::milli>(end - binned).count();
+    for(int j = 0; j<jobCount; j++)
+    {
+        stats.triangles += jobs[j].primitives.size();
+        for(int t = 0; t<tiles; t++)
+            stats.binned += jobs[j].bins[t].size();
+    }
+    return stats;
+}
+
+// Takes the pixels [begin, end) of from where they are nearer. On equal
+// depths the worker with the earlier meshes wins, as the first drawn
+// triangle does under GL_LESS.
+static void compositeRange(SortLastWorker& into, const SortLastWorker& from, bool fromEarlier, int begin, int end)
+{
+    for(int i = begin; i<end; i++)
+    {
+        float depth = from.depth[i];
+        if(depth < into.depth[i] || (fromEarlier && depth == into.depth[i]))
+        {
+            into.depth[i] = depth;
+            into.rgb[3 * i] = from.rgb[3 * i];
+            into.rgb[3 * i + 1] = from.rgb[3 * i + 1];
+            into.rgb[3 * i + 2] = from.rgb[3 * i + 2];
+        }
+    }
+}
+
+SoftwareStats renderSoftwareSortLast(const parser::Scene& scene, int workerCount, std::vector<unsigned char>& rgb)
+{
+    const parser::Camera& camera = scene.camera;
+    width = camera.image_width;
+    height = camera.image_height;
+    tilesX = (width + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+    tilesY = (height + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+    int tiles = tilesX * tilesY;
+    int pixels = width * height;
+    rgb.resize((size_t)pixels * 3);
+
+    int meshes = scene.meshes.size();
+    workerCount = std::max(1, std::min(workerCount, meshes));
+    sortLastWorkers.resize(workerCount);
+    for(int w = 0; w<workerCount; w++)
+    {
+        SortLastWorker& worker = sortLastWorkers[w];
+        worker.job.meshBegin = (long long)meshes * w / workerCount;
+        worker.job.meshEnd = (long long)meshes * (w + 1) / workerCount;
+        worker.job.bins.resize(tiles);
+        worker.job.runs.resize(tiles);
+        worker.rgb.resize((size_t)pixels * 3);
+        worker.depth.resize(pixels);
+        worker.regionBegin = 0;
+        worker.regionEnd = pixels;
+    }
+
+    LightingSetup lighting;
+    lightingSetupFor(scene, lighting);
+    mat4x4 view, projection;
+    cameraViewMatrix(camera, view);
+    cameraProjectionMatrix(camera, projection);
+    parallelFor(workerCount, [&](int w)
+    {
+        SortLastWorker& worker = sortLastWorkers[w];
+        std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+        runVertexJob(scene, view, projection, lighting, worker.job);
+        std::chrono::time_point<std::chrono::steady_clock> binned = std::chrono::steady_clock::now();
+        for(int tile = 0; tile<tiles; tile++)
+            rasterTile(tile, &worker.job, 1, &worker.rgb[0], &worker.depth[0]);
+        worker.setup_ms = std::chrono::duration<float, std::milli>(binned - start).count();
+        worker.raster_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - binned).count();
+    });
+
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    // binary swap wants a power of two: the first extra workers fold into
+    // their left neighbours whole, which keeps every group's meshes
+    // contiguous and the groups in mesh order
+    int swapping = 1;
+    while(swapping * 2 <= workerCount)
+        swapping *= 2;
+    int extra = workerCount - swapping;
+    parallelFor(extra, [&](int k)
+    {
+        compositeRange(sortLastWorkers[2 * k], sortLastWorkers[2 * k + 1], false, 0, pixels);
+    });
+    std::vector<int> leaders;
+    for(int w = 0; w<workerCount; w++)
+        if(w >= 2 * extra || w % 2 == 0)
+            leaders.push_back(w);
+    // each round pairs leaders a bit apart; both hold the same region, the
+    // lower one keeps its first half and the upper one the second, each
+    // taking the partner's pixels of the half it keeps
+    for(int bit = 1; bit<swapping; bit *= 2)
+    {
+        parallelFor(swapping, [&](int position)
+        {
+            int partner = position ^ bit;
+            SortLastWorker& worker = sortLastWorkers[leaders[position]];
+            int middle = worker.regionBegin + (worker.regionEnd - worker.regionBegin) / 2;
+            if(position < partner)
+                worker.regionEnd = middle;
+            else
+                worker.regionBegin = middle;
+            compositeRange(worker, sortLastWorkers[leaders[partner]], partner < position, worker.regionBegin, worker.regionEnd);
+        });
+    }
+    unsigned char* out = &rgb[0];
+    parallelFor(swapping, [&](int position)
+    {
+        const SortLastWorker& worker = sortLastWorkers[leaders[position]];
+        std::copy(worker.rgb.begin() + 3 * (size_t)worker.regionBegin, worker.rgb.begin() + 3 * (size_t)worker.regionEnd, out + 3 * (size_t)worker.regionBegin);
+    });
+
+    SoftwareStats stats = { 0, 0, tiles, 0.0f, 0.0f, 0.0f };
+    stats.composite_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for(int w = 0; w<workerCount; w++)
+    {
+        const SortLastWorker& worker = sortLastWorkers[w];
+        stats.triangles += worker.job.primitives.size();
+        for(int t = 0; t<tiles; t++)
+            stats.binned += worker.job.bins[t].size();
+        stats.setup_ms = std::max(stats.setup_ms, worker.setup_ms);
+        stats.raster_ms = std::max(stats.raster_ms, worker.raster_ms);
+    }
+    return stats;
+}
+
+void benchmarkSoftwareKernels(const parser::Scene& scene, int frames)
+{
+    std::vector<unsigned char> images[2];
+    double setup[2] = { 0.0, 0.0 };
+    double raster[2] = { 0.0, 0.0 };
+    for(int pass = 0; pass<2; pass++)
+    {
+        specializedKernels = pass == 0;
+        renderSoftware(scene, images[pass]);
+    }
+    // alternating frames share whatever else the machine is doing
+    for(int f = 0; f<frames; f++)
+        for(int pass = 0; pass<2; pass++)
+        {
+            specializedKernels = pass == 0;
+            SoftwareStats stats = renderSoftware(scene, images[pass]);
+            setup[pass] += stats.setup_ms;
+            raster[pass] += stats.raster_ms;
+        }
+    specializedKernels = true;
+
+    int differing = 0;
+    size_t size = images[0].size();
+    for(size_t i = 0; i<size; i++)
+        differing += images[0][i] != images[1][i];
+    printf("Raster kernels: %d frames of %dx%d, milliseconds per frame\n", frames, width, height);
+    printf("  %-18s %10s %10s %10s\n", "kernels", "setup", "raster", "total");
+    const char* names[2] = { "specialized", "runtime branches" };
+    for(int pass = 0; pass<2; pass++)
+        printf("  %-18s %10.2f %10.2f %10.2f\n", names[pass], setup[pass] / frames, raster[pass] / frames, (setup[pass] + raster[pass]) / frames);
+    printf("  speedup %.2fx, images %s\n", (setup[1] + raster[1]) / std::max(setup[0] + raster[0], 1e-9),
+        differing ? "differ" : "identical");
+}
+
+void releaseSoftware()
+{
+    jobs.clear();
+    jobs.shrink_to_fit();
+    sortLastWorkers.clear();
+    sortLastWorkers.shrink_to_fit();
+    streams = VertexStreams();
+    width = height = tilesX = tilesY = 0;
+}
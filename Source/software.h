@@ -0,0 +1,53 @@
+#ifndef __HW3__SOFTWARE__
+#define __HW3__SOFTWARE__
+
+#include <vector>
+#include "parser.h"
+
+// Side of the square screen tiles triangles are binned to.
+#define SOFTWARE_TILE_SIZE 64
+// Vertex jobs per thread; more jobs than threads leave room for stealing.
+#define SOFTWARE_JOBS_PER_THREAD 4
+
+struct SoftwareStats
+{
+    int triangles;  // triangles and wireframe edges left after clipping and culling
+    int binned;     // tile references made while binning them
+    int tiles;
+    float setup_ms;     // transform, lighting, clipping and binning
+    float raster_ms;    // sort-last: both are the slowest worker's
+    float composite_ms;
+};
+
+// Copies the scene's vertices and normals into the streams the vertex
+// kernels read, and picks the widest kernel the CPU runs.
+void initSoftware(const parser::Scene& scene, const std::vector<parser::Vec3f>& normals);
+const char* softwareVertexKernel();
+
+// Renders the scene on the CPU the way drawMeshes does with fixed function
+// GL: per vertex lighting from the point lights, smooth shaded, with the
+// scene's face culling and Solid or Wireframe meshes. Sort-middle: vertex
+// jobs transform and light their meshes with the vertex kernels, clip and
+// cull the triangles and bin them to SOFTWARE_TILE_SIZE tiles, then the
+// tiles are rasterized in parallel, each owning its pixels. Work is spread
+// over the thread pool. rgb receives 8 bit pixels of the camera's
+// resolution, top row first.
+// The setup and raster kernels are specialized for every culling mode and
+// mesh kind, picked once per mesh and once per run of a tile's bin.
+SoftwareStats renderSoftware(const parser::Scene& scene, std::vector<unsigned char>& rgb);
+
+// Sort-last: the meshes are split into workerCount contiguous groups, and
+// each worker renders its group alone into a private color and depth
+// buffer. Rendering scales with the geometry instead of the screen. The
+// buffers are then depth composited by binary swap: in every round workers
+// pair up, halve the region they hold and keep the nearer pixels of one
+// half, so all of them stay busy and each ends with 1/n of the image.
+// Workers are items on the thread pool; the image matches renderSoftware.
+SoftwareStats renderSoftwareSortLast(const parser::Scene& scene, int workerCount, std::vector<unsigned char>& rgb);
+
+// --raster-benchmark: frames rendered with the specialized kernels against
+// frames with kernels that test the modes per triangle and per primitive.
+void benchmarkSoftwareKernels(const parser::Scene& scene, int frames);
+void releaseSoftware();
+
+#endif
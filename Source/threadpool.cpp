@@ -0,0 +1,166 @@
+#include "threadpool.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Each participant owns a range of the indices, begin in the low and end in
+// the high 32 bits of one word. The owner takes from the front, a thread
+// whose range ran dry steals the back half of another's with one CAS.
+// Indices are handed out once per job, so a range never repeats a value
+// and the CAS cannot be fooled by ABA.
+struct StealRange
+{
+    std::atomic<unsigned long long> span;
+    char padding[64 - sizeof(std::atomic<unsigned long long>)];
+};
+
+static std::vector<std::thread> workers;
+static StealRange* ranges = NULL;
+static std::mutex mutex;
+static std::condition_variable wake;
+static std::condition_variable finished;
+static const std::function<void(int)>* job = NULL;
+static int busyWorkers = 0;
+static unsigned generation = 0;
+static bool stopping = false;
+
+static unsigned long long packRange(unsigned begin, unsigned end)
+{
+    return ((unsigned long long)end << 32) | begin;
+}
+
+static bool popFront(StealRange& range, int& index)
+{
+    unsigned long long span = range.span.load();
+    for(;;)
+    {
+        unsigned begin = (unsigned)span;
+        unsigned end = (unsigned)(span >> 32);
+        if(begin >= end)
+            return false;
+        if(range.span.compare_exchange_weak(span, packRange(begin + 1, end)))
+        {
+            index = begin;
+            return true;
+        }
+    }
+}
+
+static bool stealBack(int self, int& index)
+{
+    int participants = workers.size() + 1;
+    for(int k = 1; k<participants; k++)
+    {
+        StealRange& victim = ranges[(self + k) % participants];
+        unsigned long long span = victim.span.load();
+        for(;;)
+        {
+            unsigned begin = (unsigned)span;
+            unsigned end = (unsigned)(span >> 32);
+            if(begin >= end)
+                break;
+            unsigned split = end - (end - begin + 1) / 2;
+            if(victim.span.compare_exchange_weak(span, packRange(begin, split)))
+            {
+                // the stolen half becomes this thread's range, minus the
+                // index it runs right away
+                index = split;
+                ranges[self].span.store(packRange(split + 1, end));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void runJob(const std::function<void(int)>& body, int self)
+{
+    int index;
+    while(popFront(ranges[self], index) || stealBack(self, index))
+        body(index);
+}
+
+static void workerMain(int self)
+{
+    unsigned seen = 0;
+    for(;;)
+    {
+        const std::function<void(int)>* body;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(!stopping && generation == seen)
+                wake.wait(lock);
+            if(stopping)
+                return;
+            seen = generation;
+            body = job;
+        }
+        runJob(*body, self);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(--busyWorkers == 0)
+                finished.notify_one();
+        }
+    }
+}
+
+void initThreadPool(int threads)
+{
+    releaseThreadPool();
+    if(threads <= 0)
+        threads = std::thread::hardware_concurrency();
+    stopping = false;
+    ranges = new StealRange[threads];
+    for(int i = 0; i<threads; i++)
+        ranges[i].span = 0;
+    for(int i = 1; i<threads; i++)
+        workers.push_back(std::thread(workerMain, i));
+}
+
+int threadCount()
+{
+    return workers.size() + 1;
+}
+
+void parallelFor(int count, const std::function<void(int)>& body)
+{
+    if(workers.empty() || count <= 1)
+    {
+        for(int i = 0; i<count; i++)
+            body(i);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // contiguous shares keep neighbouring indices on one thread
+        int participants = workers.size() + 1;
+        for(int i = 0; i<participants; i++)
+            ranges[i].span = packRange((unsigned)((long long)count * i / participants), (unsigned)((long long)count * (i + 1) / participants));
+        job = &body;
+        busyWorkers = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    runJob(body, 0);
+    std::unique_lock<std::mutex> lock(mutex);
+    while(busyWorkers)
+        finished.wait(lock);
+    job = NULL;
+}
+
+void releaseThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    int wSize = workers.size();
+    for(int i = 0; i<wSize; i++)
+        workers[i].join();
+    workers.clear();
+    delete[] ranges;
+    ranges = NULL;
+}
@@ -0,0 +1,17 @@
+#ifndef __HW3__THREADPOOL__
+#define __HW3__THREADPOOL__
+
+#include <functional>
+
+// A fixed set of worker threads shared by the CPU side passes. parallelFor
+// gives every thread a contiguous share of the indices and lets a thread
+// that finished its share steal half of what is left of another's, so
+// neighbouring items stay on one thread while uneven ones still balance.
+// The calling thread works too and parallelFor returns once every index is
+// done. Bodies must not call parallelFor themselves.
+void initThreadPool(int threads);   // 0: one thread per hardware thread
+int threadCount();                  // workers plus the calling thread
+void parallelFor(int count, const std::function<void(int)>& body);
+void releaseThreadPool();
+
+#endif
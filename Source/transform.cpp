@@ -0,0 +1,94 @@
+#include "transform.h"
+
+void meshModelMatrix(const parser::Scene& scene, const parser::Mesh& mesh, mat4x4 model)
+{
+    mat4x4_identity(model);
+    int tSize = mesh.transformations.size();
+    for(int j = tSize - 1; j>=0; j--)
+    {
+        const parser::Transformation& transformation = mesh.transformations[j];
+        if(transformation.transformation_type == "Translation")
+        {
+            parser::Vec3f translate = scene.translations[transformation.id - 1];
+            mat4x4_translate_in_place(model, translate.x, translate.y, translate.z);
+        }
+        else if(transformation.transformation_type == "Rotation")
+        {
+            // glRotatef takes degrees, linmath takes radians
+            parser::Vec4f rotation = scene.rotations[transformation.id - 1];
+            mat4x4_rotate(model, model, rotation.y, rotation.z, rotation.w, rotation.x * (float)M_PI / 180.0f);
+        }
+        else if(transformation.transformation_type == "Scaling")
+        {
+            parser::Vec3f scaling = scene.scalings[transformation.id - 1];
+            mat4x4_scale_aniso(model, model, scaling.x, scaling.y, scaling.z);
+        }
+    }
+}
+
+void cameraViewMatrix(const parser::Camera& camera, mat4x4 view)
+{
+    vec3 eye = {camera.position.x, camera.position.y, camera.position.z};
+    vec3 center = {camera.gaze.x * camera.near_distance + camera.position.x,
+                   camera.gaze.y * camera.near_distance + camera.position.y,
+                   camera.gaze.z * camera.near_distance + camera.position.z};
+    vec3 up = {camera.up.x, camera.up.y, camera.up.z};
+    mat4x4_look_at(view, eye, center, up);
+}
+
+void cameraProjectionMatrix(const parser::Camera& camera, mat4x4 projection)
+{
+    mat4x4_frustum(projection, camera.near_plane.x, camera.near_plane.y, camera.near_plane.z, camera.near_plane.w,
+                   camera.near_distance, camera.far_distance);
+}
+
+parser::Camera tileCamera(const parser::Camera& camera, int x, int y, int width, int height)
+{
+    parser::Camera tile = camera;
+    float left = camera.near_plane.x;
+    float spanX = camera.near_plane.y - camera.near_plane.x;
+    float bottom = camera.near_plane.z;
+    float spanY = camera.near_plane.w - camera.near_plane.z;
+    // the near plane's bottom is the image's last row
+    int fromBottom = camera.image_height - y - height;
+    tile.near_plane.x = left + spanX * x / camera.image_width;
+    tile.near_plane.y = left + spanX * (x + width) / camera.image_width;
+    tile.near_plane.z = bottom + spanY * fromBottom / camera.image_height;
+    tile.near_plane.w = bottom + spanY * (fromBottom + height) / camera.image_height;
+    tile.image_width = width;
+    tile.image_height = height;
+    return tile;
+}
+
+parser::Camera orbitCamera(const parser::Camera& camera, const parser::Vec3f& center, float degrees)
+{
+    vec3 axis = { camera.up.x, camera.up.y, camera.up.z };
+    float length = vec3_len(axis);
+    if(length == 0.0f)
+        return camera;
+    vec3_scale(axis, axis, 1.0f / length);
+    // Rodrigues: v cos + (axis x v) sin + axis (axis . v)(1 - cos)
+    float radians = degrees * (float)M_PI / 180.0f;
+    float c = cosf(radians);
+    float s = sinf(radians);
+    parser::Vec3f* vectors[3];
+    parser::Camera orbit = camera;
+    parser::Vec3f offset = { camera.position.x - center.x, camera.position.y - center.y, camera.position.z - center.z };
+    vectors[0] = &offset;
+    vectors[1] = &orbit.gaze;
+    vectors[2] = &orbit.up;
+    for(int i = 0; i<3; i++)
+    {
+        vec3 v = { vectors[i]->x, vectors[i]->y, vectors[i]->z };
+        vec3 cross;
+        vec3_mul_cross(cross, axis, v);
+        float along = vec3_mul_inner(axis, v) * (1.0f - c);
+        vectors[i]->x = v[0] * c + cross[0] * s + axis[0] * along;
+        vectors[i]->y = v[1] * c + cross[1] * s + axis[1] * along;
+        vectors[i]->z = v[2] * c + cross[2] * s + axis[2] * along;
+    }
+    orbit.position.x = center.x + offset.x;
+    orbit.position.y = center.y + offset.y;
+    orbit.position.z = center.z + offset.z;
+    return orbit;
+}
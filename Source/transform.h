@@ -0,0 +1,26 @@
+#ifndef __HW3__TRANSFORM__
+#define __HW3__TRANSFORM__
+
+#include "parser.h"
+#include "linmath.h"
+
+// Composes the mesh's transformation list into one model matrix, in the
+// same order drawMeshes applies them with glTranslatef/glRotatef/glScalef:
+// the first transformation in the list is applied to the vertices first.
+void meshModelMatrix(const parser::Scene& scene, const parser::Mesh& mesh, mat4x4 model);
+
+// The matrices cameraInit loads with gluLookAt and glFrustum.
+void cameraViewMatrix(const parser::Camera& camera, mat4x4 view);
+void cameraProjectionMatrix(const parser::Camera& camera, mat4x4 projection);
+
+// The camera that sees only the pixels [x, x + width) x [y, y + height) of
+// camera's image, rows counted from the top: the near plane window is cut
+// to them and the image shrinks to the tile, so the tile renders the same
+// pixels the whole image has there.
+parser::Camera tileCamera(const parser::Camera& camera, int x, int y, int width, int height);
+
+// The camera turned by degrees around the vertical line through center,
+// its up vector being vertical: position, gaze and up all rotate.
+parser::Camera orbitCamera(const parser::Camera& camera, const parser::Vec3f& center, float degrees);
+
+#endif
@@ -0,0 +1,581 @@
+#include "vertexkernels.h"
+#include "transform.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#if defined(__GNUC__) && defined(__SSE2__)
+#define VERTEX_KERNELS_X86 1
+#include <immintrin.h>
+// the build targets the baseline ISA; wider kernels are compiled for their
+// own and only called after a CPU check
+#define SSE4_TARGET __attribute__((target("sse4.1")))
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+// GL_LIGHT_MODEL_AMBIENT, left at its default by turnOn
+#define GLOBAL_AMBIENT 0.2f
+
+void buildVertexStreams(const parser::Scene& scene, const std::vector<parser::Vec3f>& normals, VertexStreams& streams)
+{
+    int vSize = scene.vertex_data.size();
+    streams.count = vSize;
+    std::vector<float>* arrays[6] = { &streams.x, &streams.y, &streams.z, &streams.nx, &streams.ny, &streams.nz };
+    for(int a = 0; a<6; a++)
+        arrays[a]->assign(vSize + VERTEX_STREAM_PADDING, 0.0f);
+    for(int i = 0; i<vSize; i++)
+    {
+        streams.x[i] = scene.vertex_data[i].x;
+        streams.y[i] = scene.vertex_data[i].y;
+        streams.z[i] = scene.vertex_data[i].z;
+        streams.nx[i] = normals[i].x;
+        streams.ny[i] = normals[i].y;
+        streams.nz[i] = normals[i].z;
+    }
+}
+
+void lightingSetupFor(const parser::Scene& scene, LightingSetup& lighting)
+{
+    lighting.lights = std::min((int)scene.point_lights.size(), MAX_VERTEX_LIGHTS);
+    for(int i = 0; i<lighting.lights; i++)
+    {
+        const parser::PointLight& light = scene.point_lights[i];
+        lighting.position[i][0] = light.position.x;
+        lighting.position[i][1] = light.position.y;
+        lighting.position[i][2] = light.position.z;
+        lighting.intensity[i][0] = light.intensity.x;
+        lighting.intensity[i][1] = light.intensity.y;
+        lighting.intensity[i][2] = light.intensity.z;
+    }
+    lighting.ambient[0] = scene.ambient_light.x;
+    lighting.ambient[1] = scene.ambient_light.y;
+    lighting.ambient[2] = scene.ambient_light.z;
+}
+
+void materialSetupFor(const parser::Scene& scene, const parser::Mesh& mesh, MaterialSetup& material)
+{
+    const parser::Material& source = scene.materials[mesh.material_id - 1];
+    material.ambient[0] = source.ambient.x;
+    material.ambient[1] = source.ambient.y;
+    material.ambient[2] = source.ambient.z;
+    material.diffuse[0] = source.diffuse.x;
+    material.diffuse[1] = source.diffuse.y;
+    material.diffuse[2] = source.diffuse.z;
+    material.specular[0] = source.specular.x;
+    material.specular[1] = source.specular.y;
+    material.specular[2] = source.specular.z;
+    material.shininess = source.phong_exponent;
+}
+
+void vertexTransformFor(const parser::Scene& scene, const parser::Mesh& mesh, mat4x4 view, mat4x4 projection, VertexTransform& transform)
+{
+    mat4x4 model;
+    meshModelMatrix(scene, mesh, model);
+    mat4x4_mul(transform.model_view, view, model);
+    mat4x4_mul(transform.mvp, projection, transform.model_view);
+    // normals go through the model's cofactor matrix, signed so mirrored
+    // models keep their facing, then through the rigid view rotation
+    vec3 m0 = { model[0][0], model[0][1], model[0][2] };
+    vec3 m1 = { model[1][0], model[1][1], model[1][2] };
+    vec3 m2 = { model[2][0], model[2][1], model[2][2] };
+    vec3 cofactor[3];
+    vec3_mul_cross(cofactor[0], m1, m2);
+    vec3_mul_cross(cofactor[1], m2, m0);
+    vec3_mul_cross(cofactor[2], m0, m1);
+    float handedness = vec3_mul_inner(m0, cofactor[0]) < 0.0f ? -1.0f : 1.0f;
+    for(int c = 0; c<3; c++)
+        for(int r = 0; r<3; r++)
+            transform.normal_matrix[c][r] = handedness * (view[0][r] * cofactor[c][0] + view[1][r] * cofactor[c][1] + view[2][r] * cofactor[c][2]);
+}
+
+void shadePoint(const LightingSetup& lighting, const MaterialSetup& material, const float P[3], const float N[3], unsigned int litMask, float color[3])
+{
+    for(int c = 0; c<3; c++)
+        color[c] = material.ambient[c] * GLOBAL_AMBIENT;
+    for(int i = 0; i<lighting.lights; i++)
+    {
+        float L[3];
+        for(int c = 0; c<3; c++)
+            L[c] = lighting.position[i][c] - P[c];
+        float length = sqrtf(L[0] * L[0] + L[1] * L[1] + L[2] * L[2]);
+        if(length > 0.0f)
+            for(int c = 0; c<3; c++)
+                L[c] /= length;
+        float NdotL = N[0] * L[0] + N[1] * L[1] + N[2] * L[2];
+        for(int c = 0; c<3; c++)
+            color[c] += material.ambient[c] * lighting.ambient[c];
+        if(NdotL > 0.0f && (litMask >> i & 1))
+        {
+            float H[3] = { L[0], L[1], L[2] + 1.0f };
+            float hLength = sqrtf(H[0] * H[0] + H[1] * H[1] + H[2] * H[2]);
+            float NdotH = hLength > 0.0f ? std::max((N[0] * H[0] + N[1] * H[1] + N[2] * H[2]) / hLength, 0.0f) : 0.0f;
+            float specular = powf(NdotH, material.shininess);
+            for(int c = 0; c<3; c++)
+                color[c] += lighting.intensity[i][c] * (material.diffuse[c] * NdotL + material.specular[c] * specular);
+        }
+    }
+    for(int c = 0; c<3; c++)
+        color[c] = std::min(std::max(color[c], 0.0f), 1.0f);
+}
+
+static void shadeScalar(const VertexStreams& in, int first, int count, const VertexTransform& t,
+    const LightingSetup* lighting, const MaterialSetup& material, ShadedStreams& out)
+{
+    for(int i = 0; i<count; i++)
+    {
+        int v = first + i;
+        float x = in.x[v], y = in.y[v], z = in.z[v];
+        for(int r = 0; r<4; r++)
+            out.clip[r][i] = t.mvp[0][r] * x + t.mvp[1][r] * y + t.mvp[2][r] * z + t.mvp[3][r];
+        if(!lighting)
+            continue;
+        float P[3], N[3], color[3];
+        for(int r = 0; r<3; r++)
+        {
+            P[r] = t.model_view[0][r] * x + t.model_view[1][r] * y + t.model_view[2][r] * z + t.model_view[3][r];
+            N[r] = t.normal_matrix[0][r] * in.nx[v] + t.normal_matrix[1][r] * in.ny[v] + t.normal_matrix[2][r] * in.nz[v];
+        }
+        float length = sqrtf(N[0] * N[0] + N[1] * N[1] + N[2] * N[2]);
+        if(length > 0.0f)
+            for(int r = 0; r<3; r++)
+                N[r] /= length;
+        shadePoint(*lighting, material, P, N, ~0u, color);
+        for(int c = 0; c<3; c++)
+            out.color[c][i] = color[c];
+    }
+}
+
+#if VERTEX_KERNELS_X86
+// pow(x, s) for the specular term as exp2(s log2 x), x in (0, 1]. log2
+// splits off the exponent and sums the atanh series of the mantissa, exp2
+// rebuilds the exponent and expands e^g around the middle of [0, 1); both
+// are within a few ulps, far below what 8 bit colors resolve.
+// Highlights below 2^-64 are flushed to zero: they cannot show in 8 bit
+// colors, and the denormals smaller ones turn into, in lanes that are
+// masked out or not, would make every lane wait on microcode.
+#define SPECULAR_MIN_EXPONENT -64.0f
+
+// 1 / sqrt(x) from the hardware estimate and one Newton step, good to a
+// few ulps at a fraction of the cost of sqrt and a division.
+SSE4_TARGET static inline __m128 rsqrtSse4(__m128 x)
+{
+    __m128 r = _mm_rsqrt_ps(x);
+    return _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), _mm_mul_ps(r, r))));
+}
+
+SSE4_TARGET static inline __m128 log2Sse4(__m128 x)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128i bits = _mm_castps_si128(x);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+    __m128 large = _mm_cmpgt_ps(m, _mm_set1_ps(1.41421356f));
+    m = _mm_blendv_ps(m, _mm_mul_ps(m, _mm_set1_ps(0.5f)), large);
+    e = _mm_add_ps(e, _mm_and_ps(large, one));
+    __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 series = _mm_set1_ps(1.0f / 9.0f);
+    series = _mm_add_ps(_mm_mul_ps(series, t2), _mm_set1_ps(1.0f / 7.0f));
+    series = _mm_add_ps(_mm_mul_ps(series, t2), _mm_set1_ps(1.0f / 5.0f));
+    series = _mm_add_ps(_mm_mul_ps(series, t2), _mm_set1_ps(1.0f / 3.0f));
+    series = _mm_add_ps(_mm_mul_ps(series, t2), one);
+    return _mm_add_ps(e, _mm_mul_ps(_mm_mul_ps(series, t), _mm_set1_ps(2.0f * 1.44269504f)));
+}
+
+SSE4_TARGET static inline __m128 exp2Sse4(__m128 y)
+{
+    y = _mm_min_ps(_mm_max_ps(y, _mm_set1_ps(SPECULAR_MIN_EXPONENT)), _mm_set1_ps(126.0f));
+    __m128 n = _mm_floor_ps(y);
+    __m128 g = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(y, n), _mm_set1_ps(0.5f)), _mm_set1_ps(0.69314718f));
+    __m128 p = _mm_set1_ps(1.0f / 720.0f);
+    p = _mm_add_ps(_mm_mul_ps(p, g), _mm_set1_ps(1.0f / 120.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, g), _mm_set1_ps(1.0f / 24.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, g), _mm_set1_ps(1.0f / 6.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, g), _mm_set1_ps(0.5f));
+    p = _mm_add_ps(_mm_mul_ps(p, g), _mm_set1_ps(1.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, g), _mm_set1_ps(1.0f));
+    __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23));
+    return _mm_mul_ps(_mm_mul_ps(p, scale), _mm_set1_ps(1.41421356f));
+}
+
+SSE4_TARGET static void shadeSse4(const VertexStreams& in, int first, int count, const VertexTransform& t,
+    const LightingSetup* lighting, const MaterialSetup& material, ShadedStreams& out)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 mvp[4][4], mv[4][3], nm[3][3];
+    for(int c = 0; c<4; c++)
+        for(int r = 0; r<4; r++)
+        {
+            mvp[c][r] = _mm_set1_ps(t.mvp[c][r]);
+            if(r < 3)
+                mv[c][r] = _mm_set1_ps(t.model_view[c][r]);
+            if(c < 3 && r < 3)
+                nm[c][r] = _mm_set1_ps(t.normal_matrix[c][r]);
+        }
+    int lights = lighting ? lighting->lights : 0;
+    __m128 base[3], kd[3], ks[3];
+    for(int c = 0; c<3; c++)
+    {
+        float ambient = GLOBAL_AMBIENT;
+        for(int i = 0; i<lights; i++)
+            ambient += lighting->ambient[c];
+        base[c] = _mm_set1_ps(material.ambient[c] * ambient);
+        kd[c] = _mm_set1_ps(material.diffuse[c]);
+        ks[c] = _mm_set1_ps(material.specular[c]);
+    }
+    __m128 shininess = _mm_set1_ps(material.shininess);
+
+    for(int i = 0; i<count; i += 4)
+    {
+        int v = first + i;
+        __m128 x = _mm_loadu_ps(&in.x[v]);
+        __m128 y = _mm_loadu_ps(&in.y[v]);
+        __m128 z = _mm_loadu_ps(&in.z[v]);
+        for(int r = 0; r<4; r++)
+        {
+            __m128 clip = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mvp[0][r], x), _mm_mul_ps(mvp[1][r], y)), _mm_add_ps(_mm_mul_ps(mvp[2][r], z), mvp[3][r]));
+            _mm_storeu_ps(&out.clip[r][i], clip);
+        }
+        if(!lighting)
+            continue;
+        __m128 nx = _mm_loadu_ps(&in.nx[v]);
+        __m128 ny = _mm_loadu_ps(&in.ny[v]);
+        __m128 nz = _mm_loadu_ps(&in.nz[v]);
+        __m128 P[3], N[3];
+        for(int r = 0; r<3; r++)
+        {
+            P[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mv[0][r], x), _mm_mul_ps(mv[1][r], y)), _mm_add_ps(_mm_mul_ps(mv[2][r], z), mv[3][r]));
+            N[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nm[0][r], nx), _mm_mul_ps(nm[1][r], ny)), _mm_mul_ps(nm[2][r], nz));
+        }
+        __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(N[0], N[0]), _mm_mul_ps(N[1], N[1])), _mm_mul_ps(N[2], N[2]));
+        __m128 scale = _mm_blendv_ps(one, rsqrtSse4(length2), _mm_cmpgt_ps(length2, zero));
+        for(int r = 0; r<3; r++)
+            N[r] = _mm_mul_ps(N[r], scale);
+
+        __m128 color[3] = { base[0], base[1], base[2] };
+        for(int l = 0; l<lights; l++)
+        {
+            __m128 L[3];
+            for(int r = 0; r<3; r++)
+                L[r] = _mm_sub_ps(_mm_set1_ps(lighting->position[l][r]), P[r]);
+            __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(L[0], L[0]), _mm_mul_ps(L[1], L[1])), _mm_mul_ps(L[2], L[2]));
+            __m128 inverse = _mm_blendv_ps(one, rsqrtSse4(distance2), _mm_cmpgt_ps(distance2, zero));
+            for(int r = 0; r<3; r++)
+                L[r] = _mm_mul_ps(L[r], inverse);
+            __m128 NdotL = _mm_add_ps(_mm_add_ps(_mm_mul_ps(N[0], L[0]), _mm_mul_ps(N[1], L[1])), _mm_mul_ps(N[2], L[2]));
+            // H = L + (0, 0, 1), so N.H = N.L + N.z
+            __m128 hz = _mm_add_ps(L[2], one);
+            __m128 h2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(L[0], L[0]), _mm_mul_ps(L[1], L[1])), _mm_mul_ps(hz, hz));
+            __m128 NdotH = _mm_mul_ps(_mm_add_ps(NdotL, N[2]), rsqrtSse4(h2));
+            NdotH = _mm_and_ps(_mm_max_ps(NdotH, zero), _mm_cmpgt_ps(h2, zero));
+            __m128 exponent = _mm_mul_ps(shininess, log2Sse4(NdotH));
+            __m128 visible = _mm_and_ps(_mm_cmpgt_ps(NdotH, zero), _mm_cmpgt_ps(exponent, _mm_set1_ps(SPECULAR_MIN_EXPONENT)));
+            __m128 specular = _mm_and_ps(exp2Sse4(exponent), visible);
+            __m128 lit = _mm_cmpgt_ps(NdotL, zero);
+            for(int c = 0; c<3; c++)
+            {
+                __m128 term = _mm_add_ps(_mm_mul_ps(kd[c], NdotL), _mm_mul_ps(ks[c], specular));
+                color[c] = _mm_add_ps(color[c], _mm_and_ps(lit, _mm_mul_ps(_mm_set1_ps(lighting->intensity[l][c]), term)));
+            }
+        }
+        for(int c = 0; c<3; c++)
+            _mm_storeu_ps(&out.color[c][i], _mm_min_ps(_mm_max_ps(color[c], zero), one));
+    }
+}
+
+AVX2_TARGET static inline __m256 rsqrtAvx2(__m256 x)
+{
+    __m256 r = _mm256_rsqrt_ps(x);
+    return _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), x), _mm256_mul_ps(r, r), _mm256_set1_ps(1.5f)));
+}
+
+AVX2_TARGET static inline __m256 log2Avx2(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256i bits = _mm256_castps_si256(x);
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000)));
+    __m256 large = _mm256_cmp_ps(m, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+    m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), large);
+    e = _mm256_add_ps(e, _mm256_and_ps(large, one));
+    __m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+    __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 series = _mm256_set1_ps(1.0f / 9.0f);
+    series = _mm256_fmadd_ps(series, t2, _mm256_set1_ps(1.0f / 7.0f));
+    series = _mm256_fmadd_ps(series, t2, _mm256_set1_ps(1.0f / 5.0f));
+    series = _mm256_fmadd_ps(series, t2, _mm256_set1_ps(1.0f / 3.0f));
+    series = _mm256_fmadd_ps(series, t2, one);
+    return _mm256_fmadd_ps(_mm256_mul_ps(series, t), _mm256_set1_ps(2.0f * 1.44269504f), e);
+}
+
+AVX2_TARGET static inline __m256 exp2Avx2(__m256 y)
+{
+    y = _mm256_min_ps(_mm256_max_ps(y, _mm256_set1_ps(SPECULAR_MIN_EXPONENT)), _mm256_set1_ps(126.0f));
+    __m256 n = _mm256_floor_ps(y);
+    __m256 g = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(y, n), _mm256_set1_ps(0.5f)), _mm256_set1_ps(0.69314718f));
+    __m256 p = _mm256_set1_ps(1.0f / 720.0f);
+    p = _mm256_fmadd_ps(p, g, _mm256_set1_ps(1.0f / 120.0f));
+    p = _mm256_fmadd_ps(p, g, _mm256_set1_ps(1.0f / 24.0f));
+    p = _mm256_fmadd_ps(p, g, _mm256_set1_ps(1.0f / 6.0f));
+    p = _mm256_fmadd_ps(p, g, _mm256_set1_ps(0.5f));
+    p = _mm256_fmadd_ps(p, g, _mm256_set1_ps(1.0f));
+    p = _mm256_fmadd_ps(p, g, _mm256_set1_ps(1.0f));
+    __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23));
+    return _mm256_mul_ps(_mm256_mul_ps(p, scale), _mm256_set1_ps(1.41421356f));
+}
+
+AVX2_TARGET static void shadeAvx2(const VertexStreams& in, int first, int count, const VertexTransform& t,
+    const LightingSetup* lighting, const MaterialSetup& material, ShadedStreams& out)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 mvp[4][4], mv[4][3], nm[3][3];
+    for(int c = 0; c<4; c++)
+        for(int r = 0; r<4; r++)
+        {
+            mvp[c][r] = _mm256_set1_ps(t.mvp[c][r]);
+            if(r < 3)
+                mv[c][r] = _mm256_set1_ps(t.model_view[c][r]);
+            if(c < 3 && r < 3)
+                nm[c][r] = _mm256_set1_ps(t.normal_matrix[c][r]);
+        }
+    int lights = lighting ? lighting->lights : 0;
+    __m256 base[3], kd[3], ks[3];
+    for(int c = 0; c<3; c++)
+    {
+        float ambient = GLOBAL_AMBIENT;
+        for(int i = 0; i<lights; i++)
+            ambient += lighting->ambient[c];
+        base[c] = _mm256_set1_ps(material.ambient[c] * ambient);
+        kd[c] = _mm256_set1_ps(material.diffuse[c]);
+        ks[c] = _mm256_set1_ps(material.specular[c]);
+    }
+    __m256 shininess = _mm256_set1_ps(material.shininess);
+
+    for(int i = 0; i<count; i += 8)
+    {
+        int v = first + i;
+        __m256 x = _mm256_loadu_ps(&in.x[v]);
+        __m256 y = _mm256_loadu_ps(&in.y[v]);
+        __m256 z = _mm256_loadu_ps(&in.z[v]);
+        for(int r = 0; r<4; r++)
+        {
+            __m256 clip = _mm256_fmadd_ps(mvp[0][r], x, _mm256_fmadd_ps(mvp[1][r], y, _mm256_fmadd_ps(mvp[2][r], z, mvp[3][r])));
+            _mm256_storeu_ps(&out.clip[r][i], clip);
+        }
+        if(!lighting)
+            continue;
+        __m256 nx = _mm256_loadu_ps(&in.nx[v]);
+        __m256 ny = _mm256_loadu_ps(&in.ny[v]);
+        __m256 nz = _mm256_loadu_ps(&in.nz[v]);
+        __m256 P[3], N[3];
+        for(int r = 0; r<3; r++)
+        {
+            P[r] = _mm256_fmadd_ps(mv[0][r], x, _mm256_fmadd_ps(mv[1][r], y, _mm256_fmadd_ps(mv[2][r], z, mv[3][r])));
+            N[r] = _mm256_fmadd_ps(nm[0][r], nx, _mm256_fmadd_ps(nm[1][r], ny, _mm256_mul_ps(nm[2][r], nz)));
+        }
+        __m256 length2 = _mm256_fmadd_ps(N[0], N[0], _mm256_fmadd_ps(N[1], N[1], _mm256_mul_ps(N[2], N[2])));
+        __m256 scale = _mm256_blendv_ps(one, rsqrtAvx2(length2), _mm256_cmp_ps(length2, zero, _CMP_GT_OQ));
+        for(int r = 0; r<3; r++)
+            N[r] = _mm256_mul_ps(N[r], scale);
+
+        __m256 color[3] = { base[0], base[1], base[2] };
+        for(int l = 0; l<lights; l++)
+        {
+            __m256 L[3];
+            for(int r = 0; r<3; r++)
+                L[r] = _mm256_sub_ps(_mm256_set1_ps(lighting->position[l][r]), P[r]);
+            __m256 distance2 = _mm256_fmadd_ps(L[0], L[0], _mm256_fmadd_ps(L[1], L[1], _mm256_mul_ps(L[2], L[2])));
+            __m256 inverse = _mm256_blendv_ps(one, rsqrtAvx2(distance2), _mm256_cmp_ps(distance2, zero, _CMP_GT_OQ));
+            for(int r = 0; r<3; r++)
+                L[r] = _mm256_mul_ps(L[r], inverse);
+            __m256 NdotL = _mm256_fmadd_ps(N[0], L[0], _mm256_fmadd_ps(N[1], L[1], _mm256_mul_ps(N[2], L[2])));
+            __m256 hz = _mm256_add_ps(L[2], one);
+            __m256 h2 = _mm256_fmadd_ps(L[0], L[0], _mm256_fmadd_ps(L[1], L[1], _mm256_mul_ps(hz, hz)));
+            __m256 NdotH = _mm256_mul_ps(_mm256_add_ps(NdotL, N[2]), rsqrtAvx2(h2));
+            NdotH = _mm256_and_ps(_mm256_max_ps(NdotH, zero), _mm256_cmp_ps(h2, zero, _CMP_GT_OQ));
+            __m256 exponent = _mm256_mul_ps(shininess, log2Avx2(NdotH));
+            __m256 visible = _mm256_and_ps(_mm256_cmp_ps(NdotH, zero, _CMP_GT_OQ), _mm256_cmp_ps(exponent, _mm256_set1_ps(SPECULAR_MIN_EXPONENT), _CMP_GT_OQ));
+            __m256 specular = _mm256_and_ps(exp2Avx2(exponent), visible);
+            __m256 lit = _mm256_cmp_ps(NdotL, zero, _CMP_GT_OQ);
+            for(int c = 0; c<3; c++)
+            {
+                __m256 term = _mm256_fmadd_ps(kd[c], NdotL, _mm256_mul_ps(ks[c], specular));
+                color[c] = _mm256_add_ps(color[c], _mm256_and_ps(lit, _mm256_mul_ps(_mm256_set1_ps(lighting->intensity[l][c]), term)));
+            }
+        }
+        for(int c = 0; c<3; c++)
+            _mm256_storeu_ps(&out.color[c][i], _mm256_min_ps(_mm256_max_ps(color[c], zero), one));
+    }
+}
+#endif
+
+bool vertexKernelSupported(VertexKernel kernel)
+{
+#if VERTEX_KERNELS_X86
+    if(kernel == VERTEX_KERNEL_SSE4)
+        return __builtin_cpu_supports("sse4.1");
+    if(kernel == VERTEX_KERNEL_AVX2)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    return kernel == VERTEX_KERNEL_SCALAR;
+}
+
+VertexKernel bestVertexKernel()
+{
+    if(vertexKernelSupported(VERTEX_KERNEL_AVX2))
+        return VERTEX_KERNEL_AVX2;
+    if(vertexKernelSupported(VERTEX_KERNEL_SSE4))
+        return VERTEX_KERNEL_SSE4;
+    return VERTEX_KERNEL_SCALAR;
+}
+
+const char* vertexKernelName(VertexKernel kernel)
+{
+    switch(kernel)
+    {
+    case VERTEX_KERNEL_SSE4:
+        return "sse4.1";
+    case VERTEX_KERNEL_AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+void shadeVertices(VertexKernel kernel, const VertexStreams& in, int first, int count, const VertexTransform& transform,
+    const LightingSetup* lighting, const MaterialSetup& material, ShadedStreams& out)
+{
+    // whole vectors are stored past count
+    size_t size = (count + VERTEX_STREAM_PADDING - 1) / VERTEX_STREAM_PADDING * VERTEX_STREAM_PADDING;
+    for(int r = 0; r<4; r++)
+        if(out.clip[r].size() < size)
+            out.clip[r].resize(size);
+    for(int c = 0; lighting && c<3; c++)
+        if(out.color[c].size() < size)
+            out.color[c].resize(size);
+#if VERTEX_KERNELS_X86
+    if(kernel == VERTEX_KERNEL_AVX2)
+    {
+        shadeAvx2(in, first, count, transform, lighting, material, out);
+        return;
+    }
+    if(kernel == VERTEX_KERNEL_SSE4)
+    {
+        shadeSse4(in, first, count, transform, lighting, material, out);
+        return;
+    }
+#endif
+    shadeScalar(in, first, count, transform, lighting, material, out);
+}
+
+// Vertices per second of one pass over the scene, timed over at least a
+// quarter of a second.
+static double verticesPerSecond(int count, const std::function<void()>& pass)
+{
+    pass();
+    int passes = 0;
+    double seconds = 0.0;
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    while(seconds < 0.25 || passes < 3)
+    {
+        pass();
+        passes++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return (double)count * passes / seconds;
+}
+
+void benchmarkVertexKernels(const parser::Scene& scene, const std::vector<parser::Vec3f>& normals)
+{
+    if(scene.meshes.empty() || scene.vertex_data.empty())
+    {
+        fprintf(stderr, "Error: the scene has no meshes to benchmark\n");
+        return;
+    }
+    VertexStreams streams;
+    buildVertexStreams(scene, normals, streams);
+    int count = streams.count;
+    mat4x4 view, projection;
+    cameraViewMatrix(scene.camera, view);
+    cameraProjectionMatrix(scene.camera, projection);
+    VertexTransform transform;
+    vertexTransformFor(scene, scene.meshes[0], view, projection, transform);
+    LightingSetup lighting;
+    lightingSetupFor(scene, lighting);
+    MaterialSetup material;
+    materialSetupFor(scene, scene.meshes[0], material);
+
+    // the baseline: linmath one vertex at a time from the scene's own
+    // array of structures
+    std::vector<vec4> clip(count);
+    std::vector<vec4> colors(count);
+    mat4x4 normalMatrix;
+    mat4x4_identity(normalMatrix);
+    for(int c = 0; c<3; c++)
+        for(int r = 0; r<3; r++)
+            normalMatrix[c][r] = transform.normal_matrix[c][r];
+    double baseTransform = verticesPerSecond(count, [&]()
+    {
+        for(int v = 0; v<count; v++)
+        {
+            vec4 position = { scene.vertex_data[v].x, scene.vertex_data[v].y, scene.vertex_data[v].z, 1.0f };
+            mat4x4_mul_vec4(clip[v], transform.mvp, position);
+        }
+    });
+    double baseLit = verticesPerSecond(count, [&]()
+    {
+        for(int v = 0; v<count; v++)
+        {
+            vec4 position = { scene.vertex_data[v].x, scene.vertex_data[v].y, scene.vertex_data[v].z, 1.0f };
+            vec4 normal = { normals[v].x, normals[v].y, normals[v].z, 0.0f };
+            vec4 eye, eyeNormal;
+            mat4x4_mul_vec4(clip[v], transform.mvp, position);
+            mat4x4_mul_vec4(eye, transform.model_view, position);
+            mat4x4_mul_vec4(eyeNormal, normalMatrix, normal);
+            float length = sqrtf(eyeNormal[0] * eyeNormal[0] + eyeNormal[1] * eyeNormal[1] + eyeNormal[2] * eyeNormal[2]);
+            if(length > 0.0f)
+                for(int r = 0; r<3; r++)
+                    eyeNormal[r] /= length;
+            shadePoint(lighting, material, eye, eyeNormal, ~0u, colors[v]);
+        }
+    });
+
+    printf("Vertex kernels: %d vertices, %d lights, millions of vertices per second\n", count, lighting.lights);
+    printf("  %-10s %10s %18s %12s\n", "kernel", "transform", "transform + light", "max error");
+    printf("  %-10s %10.1f %18.1f %12s\n", "linmath", baseTransform * 1e-6, baseLit * 1e-6, "-");
+
+    ShadedStreams reference;
+    shadeVertices(VERTEX_KERNEL_SCALAR, streams, 0, count, transform, &lighting, material, reference);
+    VertexKernel kernels[3] = { VERTEX_KERNEL_SCALAR, VERTEX_KERNEL_SSE4, VERTEX_KERNEL_AVX2 };
+    for(int k = 0; k<3; k++)
+    {
+        VertexKernel kernel = kernels[k];
+        if(!vertexKernelSupported(kernel))
+        {
+            printf("  %-10s %10s %18s %12s\n", vertexKernelName(kernel), "-", "-", "unsupported");
+            continue;
+        }
+        ShadedStreams out;
+        double rateTransform = verticesPerSecond(count, [&]()
+        {
+            shadeVertices(kernel, streams, 0, count, transform, NULL, material, out);
+        });
+        double rateLit = verticesPerSecond(count, [&]()
+        {
+            shadeVertices(kernel, streams, 0, count, transform, &lighting, material, out);
+        });
+        // colors against the scalar kernel, positions relative to w
+        float error = 0.0f;
+        for(int v = 0; v<count; v++)
+        {
+            for(int c = 0; c<3; c++)
+                error = std::max(error, fabsf(out.color[c][v] - reference.color[c][v]));
+            for(int r = 0; r<4; r++)
+                error = std::max(error, fabsf(out.clip[r][v] - reference.clip[r][v]) / std::max(fabsf(reference.clip[3][v]), 1e-6f));
+        }
+        printf("  %-10s %10.1f %18.1f %12.2g\n", vertexKernelName(kernel), rateTransform * 1e-6, rateLit * 1e-6, error);
+    }
+}
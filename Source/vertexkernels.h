@@ -0,0 +1,85 @@
+#ifndef __HW3__VERTEXKERNELS__
+#define __HW3__VERTEXKERNELS__
+
+#include <vector>
+#include "parser.h"
+#include "linmath.h"
+
+// Fixed function GL lights at most this many; buildScene enables the first ones.
+#define MAX_VERTEX_LIGHTS 8
+// Streams hold this many vertices past the end, so the widest kernel can
+// read whole vectors at the tail of any range.
+#define VERTEX_STREAM_PADDING 8
+
+enum VertexKernel
+{
+    VERTEX_KERNEL_SCALAR = 0,
+    VERTEX_KERNEL_SSE4 = 1,     // 4 vertices at a time
+    VERTEX_KERNEL_AVX2 = 2      // 8 vertices at a time, with FMA
+};
+
+// Structure of arrays copies of scene.vertex_data and its normals.
+struct VertexStreams
+{
+    int count;
+    std::vector<float> x, y, z;
+    std::vector<float> nx, ny, nz;
+};
+
+// Per vertex results: clip space positions and lit colors.
+struct ShadedStreams
+{
+    std::vector<float> clip[4];
+    std::vector<float> color[3];
+};
+
+// Light positions in eye space; turnOn gives them with an identity
+// modelview, so they are the scene's positions unchanged.
+struct LightingSetup
+{
+    int lights;
+    float position[MAX_VERTEX_LIGHTS][3];
+    float intensity[MAX_VERTEX_LIGHTS][3];
+    float ambient[3];
+};
+
+struct MaterialSetup
+{
+    float ambient[3], diffuse[3], specular[3];
+    float shininess;
+};
+
+// The matrices of one mesh under the camera, column major like linmath.
+struct VertexTransform
+{
+    mat4x4 model_view;
+    mat4x4 mvp;
+    float normal_matrix[3][3];
+};
+
+void buildVertexStreams(const parser::Scene& scene, const std::vector<parser::Vec3f>& normals, VertexStreams& streams);
+void lightingSetupFor(const parser::Scene& scene, LightingSetup& lighting);
+void materialSetupFor(const parser::Scene& scene, const parser::Mesh& mesh, MaterialSetup& material);
+void vertexTransformFor(const parser::Scene& scene, const parser::Mesh& mesh, mat4x4 view, mat4x4 projection, VertexTransform& transform);
+
+// The widest kernel the CPU runs, checked at run time.
+VertexKernel bestVertexKernel();
+bool vertexKernelSupported(VertexKernel kernel);
+const char* vertexKernelName(VertexKernel kernel);
+
+// The lighting below for one point, P and N in eye space with N normalized.
+// Lights whose bit in litMask is clear add only their ambient term.
+void shadePoint(const LightingSetup& lighting, const MaterialSetup& material, const float P[3], const float N[3], unsigned int litMask, float color[3]);
+
+// Transforms vertices [first, first + count) of the streams and evaluates
+// the fixed function lighting drawMeshes uses for each of them: global and
+// per light ambient, diffuse and infinite viewer specular. Results go to
+// out at [0, count). Without lighting only the clip positions are written.
+void shadeVertices(VertexKernel kernel, const VertexStreams& in, int first, int count, const VertexTransform& transform,
+    const LightingSetup* lighting, const MaterialSetup& material, ShadedStreams& out);
+
+// --vertex-benchmark: vertices per second of every kernel the CPU runs over
+// the scene's vertices, next to linmath's mat4x4_mul_vec4 one vertex at a time.
+void benchmarkVertexKernels(const parser::Scene& scene, const std::vector<parser::Vec3f>& normals);
+
+#endif